@@ -4,6 +4,7 @@ App::App()
     : transport(audioEngine.getDeviceManager())
 {
     addAndMakeVisible(mainComponent);
+    mainComponent.setAudioEngine(&audioEngine);
     setSize(1200, 800);
     startTimerHz(30);
 }
@@ -1,7 +1,17 @@
 #include "AudioEngine.h"
 
-AudioEngine::AudioEngine()
+AudioEngine::AudioEngine(DeviceMode mode)
+    : deviceMode(mode)
 {
+    masterGain.beginBlock(masterVolume);
+    
+    if (deviceMode == DeviceMode::Offline)
+    {
+        // No hardware at all: an OfflineRenderer prepares and drives the engine
+        midiHandler.closeMidiInput();
+        return;
+    }
+    
     deviceManager.initialiseWithDefaultDevices(2, 2);
     deviceManager.addAudioCallback(this);
     
@@ -12,16 +22,20 @@ AudioEngine::AudioEngine()
 
 AudioEngine::~AudioEngine()
 {
-    deviceManager.removeAudioCallback(this);
+    if (deviceMode == DeviceMode::Live)
+        deviceManager.removeAudioCallback(this);
 }
 
 void AudioEngine::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
 {
     currentSampleRate = sampleRate;
     bufferSize = samplesPerBlockExpected;
+    prepared = true;
     
     buffer.setSize(2, bufferSize);
     masterBuffer.setSize(2, bufferSize);
+    midiBlock.ensureSize(2048);
+    masterGainRamps.setRampLength(juce::roundToInt(sampleRate * MixKernels::gainRampSeconds));
     
     // Prepare all tracks
     for (auto* track : tracks)
@@ -29,35 +43,61 @@ void AudioEngine::prepareToPlay(int samplesPerBlockExpected, double sampleRate)
         track->prepareToPlay(sampleRate, samplesPerBlockExpected);
     }
     
+    // Bus scratch buffers are sized from the block size
+    publishRenderState();
+    
     // Prepare MIDI handler
     midiHandler.prepareToPlay(sampleRate, samplesPerBlockExpected);
 }
 
 void AudioEngine::getNextAudioBlock(const juce::AudioSourceChannelInfo& bufferToFill)
 {
+    const TimingHistogram::ScopedTimer timer(blockTiming);
+    blockDurationSeconds.store(bufferToFill.numSamples / currentSampleRate, std::memory_order_relaxed);
+    
     bufferToFill.clearActiveBufferRegion();
     
-    // Create MIDI buffer for this block
-    juce::MidiBuffer midiMessages;
+    // Reuse the MIDI buffer reserved in prepareToPlay
+    midiBlock.clear();
     
     // Process MIDI input
-    midiHandler.processNextMidiBlock(midiMessages, bufferToFill.numSamples);
+    midiHandler.processNextMidiBlock(midiBlock, bufferToFill.numSamples);
     
+    renderNextBlock(*bufferToFill.buffer, midiBlock);
+}
+
+void AudioEngine::renderNextBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
     // Process all tracks
-    processTracks(*bufferToFill.buffer, midiMessages);
+    processTracks(buffer, midiMessages);
+    
+    // Apply master volume, ramping wherever it changed during the block
+    masterGainRamps.beginBlock();
+    
+    for (int segment = 0; segment < masterGain.size(); ++segment)
+        masterGainRamps.rampTo({ masterGain.getState(segment) }, masterGain.getEnd(segment, buffer.getNumSamples()));
     
-    // Apply master volume
-    bufferToFill.buffer->applyGain(masterVolume);
+    for (int i = 0; i < masterGainRamps.getNumPieces(); ++i)
+    {
+        const auto& piece = masterGainRamps.getPiece(i);
+        const float startGain = piece.startGain[0];
+        
+        if (piece.increment[0] != 0.0f)
+            buffer.applyGainRamp(piece.startSample, piece.numSamples, startGain, startGain + piece.increment[0] * (float) piece.numSamples);
+        else if (startGain != 1.0f)
+            buffer.applyGain(piece.startSample, piece.numSamples, startGain);
+    }
 }
 
 void AudioEngine::releaseResources()
 {
+    prepared = false;
     buffer.setSize(0, 0);
     masterBuffer.setSize(0, 0);
     
     for (auto* track : tracks)
     {
-        track->prepareToPlay(0, 0);
+        track->releaseResources();
     }
     
     midiHandler.releaseResources();
@@ -65,60 +105,304 @@ void AudioEngine::releaseResources()
 
 void AudioEngine::processTracks(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    if (tracks.isEmpty())
+    // Pins the latest published snapshot for this block. Structural edits on
+    // the message thread publish a new one instead of touching this one, so
+    // this never waits and what it sees can't be deleted underneath it.
+    const RealtimeSnapshot<RenderState>::ReadScope state(renderState);
+    const int numSamples = buffer.getNumSamples();
+    
+    applyParameterChanges(state.get(), numSamples);
+    
+    if (state.get() == nullptr || state->schedule == nullptr || state->schedule->getNumSteps() == 0)
     {
         // No tracks - silence
         buffer.clear();
         return;
     }
     
-    // Clear master buffer
+    // masterBuffer was sized in prepareToPlay; this only adjusts its length
+    masterBuffer.setSize(masterBuffer.getNumChannels(), numSamples, false, false, true);
     masterBuffer.clear();
     
-    // Process each track and mix into master buffer
-    for (auto* track : tracks)
+    // Muted, soloed-out and idle tracks are skipped rather than processed
+    state->schedule->prepareBlock(buffer, midiMessages);
+    renderSchedule(*state->schedule, state->pool.get(), buffer, midiMessages);
+    
+    // Every node rendered into its own reusable slot; the ones routed to the
+    // master are summed straight from there with volume and pan folded in
+    state->schedule->sumIntoMaster(masterBuffer, numSamples);
+    
+    // Copy master buffer to output without resizing the device's buffer
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
     {
-        juce::AudioBuffer<float> trackBuffer(buffer.getNumChannels(), buffer.getNumSamples());
-        trackBuffer.clear();
-        
-        // Copy input buffer for processing
-        trackBuffer.makeCopyOf(buffer);
+        if (channel < masterBuffer.getNumChannels())
+            buffer.copyFrom(channel, 0, masterBuffer, channel, 0, numSamples);
+        else
+            buffer.clear(channel, 0, numSamples);
+    }
+}
+
+void AudioEngine::applyParameterChanges(const RenderState* state, int numSamples)
+{
+    const auto locate = locateRequest.exchange(-1);
+    
+    if (locate >= 0)
+        playhead = locate;
+    
+    PlayheadState playheadState;
+    playheadState.position = playhead;
+    playheadState.playing = playing.load();
+    playheadState.offline = isOffline();
+    
+    if (state != nullptr && state->schedule != nullptr)
+        state->schedule->beginBlock(playheadState);
+    
+    if (playheadState.playing)
+        playhead += numSamples;
+    
+    playheadPosition.store(playhead, std::memory_order_relaxed);
+    
+    masterGain.beginBlock();
+    
+    commandQueue.processDue(blockStartSample, numSamples, [this, state](const EngineCommand& command, int offset)
+    {
+        return applyCommand(state, command, offset);
+    });
+    
+    blockStartSample += numSamples;
+    sampleClock.store(blockStartSample, std::memory_order_relaxed);
+}
+
+bool AudioEngine::applyCommand(const RenderState* state, const EngineCommand& command, int sampleOffset)
+{
+    if (command.type == EngineCommand::Type::MasterVolume)
+    {
+        masterGain.changeAt(sampleOffset) = command.value;
+        return true;
+    }
+    
+    if (state != nullptr && state->schedule != nullptr && state->schedule->containsTrack(command.track))
+    {
+        // A track in the snapshot is alive, but may be a new one allocated
+        // where the command's track was before it was removed
+        if (command.track->getId() == command.trackId)
+            command.track->applyCommand(command, sampleOffset);
         
-        // Process track
-        track->processBlock(trackBuffer, midiMessages);
+        return true;
+    }
+    
+    // The track isn't in the snapshot being rendered. If the snapshot is at
+    // least as new as the command, the track has been removed and may already
+    // be gone, so the command is dropped without touching it. Otherwise the
+    // track was added after this snapshot and the command waits a block.
+    return state != nullptr && state->topologyVersion >= command.topologyVersion;
+}
+
+void AudioEngine::renderSchedule(RenderSchedule& scheduleToRender, RenderThreadPool* pool,
+                                 const juce::AudioBuffer<float>& input, const juce::MidiBuffer& midiMessages)
+{
+    renderJob.schedule = &scheduleToRender;
+    renderJob.input = &input;
+    renderJob.midiMessages = &midiMessages;
+    
+    if (scheduleToRender.getNumSteps() < parallelRenderThreshold.load(std::memory_order_relaxed))
+        pool = nullptr;
+    
+    // Levels run in order; the steps inside a level don't depend on each other
+    for (int level = 0; level < scheduleToRender.getNumLevels(); ++level)
+    {
+        renderJob.levelStart = scheduleToRender.getLevelStart(level);
+        const int levelSize = scheduleToRender.getLevelSize(level);
         
-        // Mix into master buffer
-        for (int channel = 0; channel < masterBuffer.getNumChannels(); ++channel)
+        if (pool != nullptr && levelSize > 1)
+        {
+            pool->runBatch(renderJob, levelSize);
+        }
+        else
         {
-            masterBuffer.addFrom(channel, 0, trackBuffer, channel, 0, buffer.getNumSamples());
+            for (int i = 0; i < levelSize; ++i)
+            {
+                renderJob.runJob(i);
+            }
         }
     }
+}
+
+void AudioEngine::LevelRenderJob::runJob(int jobIndex)
+{
+    schedule->renderStep(levelStart + jobIndex, *input, *midiMessages);
+}
+
+void AudioEngine::publishRenderState(std::unique_ptr<Track> removedTrack)
+{
+    auto newState = std::make_unique<RenderState>();
+    newState->schedule = graph.compile(masterBuffer.getNumChannels() > 0 ? masterBuffer.getNumChannels() : 2,
+                                       bufferSize);
+    newState->pool = renderPool;
+    newState->topologyVersion = ++topologyVersion;
     
-    // Copy master buffer to output
-    buffer.makeCopyOf(masterBuffer);
+    // Commands queued from here on may refer to tracks in the new snapshot
+    commandQueue.setTopologyVersion(topologyVersion);
+    renderState.publish(std::move(newState), std::move(removedTrack));
+}
+
+const RenderSchedule* AudioEngine::getPublishedSchedule() const
+{
+    auto* state = renderState.getLatest();
+    return state != nullptr ? state->schedule.get() : nullptr;
+}
+
+void AudioEngine::setParallelRendering(bool shouldRenderInParallel, int numWorkers)
+{
+    renderPool.reset();
+    
+    if (shouldRenderInParallel)
+    {
+        if (numWorkers <= 0)
+            numWorkers = juce::jmax(1, juce::SystemStats::getNumPhysicalCpus() - 1);
+        
+        renderPool = std::make_shared<RenderThreadPool>(numWorkers);
+    }
+    
+    // The previous pool lives on in the retired snapshot until the audio
+    // thread has let go of it, and its threads are stopped by the release pool
+    publishRenderState();
+}
+
+void AudioEngine::setParallelRenderThreshold(int minimumTracks)
+{
+    parallelRenderThreshold = juce::jmax(1, minimumTracks);
+}
+
+AudioEngine::DspLoad AudioEngine::getDspLoad() const
+{
+    DspLoad load;
+    const double blockSeconds = blockDurationSeconds.load(std::memory_order_relaxed);
+    
+    if (blockSeconds <= 0.0)
+        return load;
+    
+    const auto timing = blockTiming.getSummary();
+    const double toPercent = 100.0 / blockSeconds;
+    
+    load.numBlocks = timing.count;
+    load.currentPercent = (double) blockTiming.getLastCycles() / CycleClock::getCyclesPerSecond() * toPercent;
+    load.p50Percent = timing.p50Seconds * toPercent;
+    load.p99Percent = timing.p99Seconds * toPercent;
+    load.maxPercent = timing.maxSeconds * toPercent;
+    return load;
+}
+
+void AudioEngine::resetTimingStatistics()
+{
+    blockTiming.reset();
+    
+    for (auto* track : tracks)
+    {
+        track->getRenderTiming().reset();
+        
+        auto& chain = track->getEffectChain();
+        
+        for (int i = 0; i < chain.getNumEffects(); ++i)
+            chain.getEffect(i)->getProcessTiming().reset();
+    }
 }
 
 // Track management
 Track* AudioEngine::addTrack(const juce::String& name, Track::TrackType type)
 {
     auto* newTrack = new Track(name, type);
+    newTrack->setCommandQueue(&commandQueue);
     tracks.add(newTrack);
     
     // Prepare the new track
     newTrack->prepareToPlay(currentSampleRate, bufferSize);
     
+    graph.addNode(newTrack);
+    publishRenderState();
+    
     return newTrack;
 }
 
+Track* AudioEngine::addBus(const juce::String& name)
+{
+    return addTrack(name, Track::BusTrack);
+}
+
 void AudioEngine::removeTrack(int index)
 {
     if (index >= 0 && index < tracks.size())
     {
-        tracks.remove(index);
+        std::unique_ptr<Track> removedTrack(tracks.removeAndReturn(index));
+        graph.removeNode(removedTrack.get());
+        
+        // The track is deleted on the release pool's thread, so flush any
+        // change message still queued for the message thread now
+        removedTrack->dispatchPendingMessages();
+        
+        // The audio thread may still be rendering it from the previous
+        // snapshot; it goes away only once nothing can reach it
+        publishRenderState(std::move(removedTrack));
     }
 }
 
-void AudioEngine::setMasterVolume(float volume)
+// Routing
+bool AudioEngine::setTrackOutput(Track* track, Track* bus)
+{
+    return applyGraphEdit(graph.setMainOutput(track, bus));
+}
+
+bool AudioEngine::addSend(Track* source, Track* bus, float gain)
+{
+    return applyGraphEdit(graph.addSend(source, bus, gain));
+}
+
+bool AudioEngine::setSendGain(Track* source, Track* bus, float gain)
+{
+    return applyGraphEdit(graph.setSendGain(source, bus, gain));
+}
+
+bool AudioEngine::removeSend(Track* source, Track* bus)
+{
+    return applyGraphEdit(graph.removeSend(source, bus));
+}
+
+bool AudioEngine::addSidechain(Track* source, Track* destination)
+{
+    return applyGraphEdit(graph.addSidechain(source, destination));
+}
+
+bool AudioEngine::removeSidechain(Track* source, Track* destination)
+{
+    return applyGraphEdit(graph.removeSidechain(source, destination));
+}
+
+bool AudioEngine::updateLatencyCompensation()
+{
+    return applyGraphEdit(graph.haveLatenciesChanged());
+}
+
+int AudioEngine::getLatencySamples() const
+{
+    auto* schedule = getPublishedSchedule();
+    return schedule != nullptr ? schedule->getLatencySamples() : 0;
+}
+
+bool AudioEngine::applyGraphEdit(bool graphChanged)
+{
+    if (graphChanged)
+        publishRenderState();
+    
+    return graphChanged;
+}
+
+void AudioEngine::setMasterVolume(float volume, juce::int64 atSample)
 {
     masterVolume = juce::jlimit(0.0f, 2.0f, volume);
+    
+    EngineCommand command;
+    command.type = EngineCommand::Type::MasterVolume;
+    command.value = masterVolume;
+    command.timestamp = atSample;
+    commandQueue.push(command);
 }
@@ -4,12 +4,29 @@
 #include "../midi/MidiHandler.h"
 #include "../tracks/Track.h"
 #include "../plugins/PluginManager.h"
+#include "RenderThreadPool.h"
+#include "RenderGraph.h"
+#include "RealtimeSnapshot.h"
+#include "EngineCommandQueue.h"
+#include "MixKernels.h"
+#include "TimingHistogram.h"
 
 class AudioEngine : public juce::AudioIODeviceCallback
 {
 public:
-    AudioEngine();
+    enum class DeviceMode
+    {
+        Live,       // opens the default audio device and renders from its callback
+        Offline     // no device at all; blocks are pulled by an OfflineRenderer
+    };
+
+    explicit AudioEngine(DeviceMode mode = DeviceMode::Live);
     ~AudioEngine() override;
+    
+    bool isOffline() const { return deviceMode == DeviceMode::Offline; }
+    double getSampleRate() const { return currentSampleRate; }
+    int getBlockSize() const { return bufferSize; }
+    bool isPrepared() const { return prepared; }
 
     juce::AudioDeviceManager& getDeviceManager() { return deviceManager; }
     MidiHandler& getMidiHandler() { return midiHandler; }
@@ -23,29 +40,155 @@ public:
 
     // Track management
     Track* addTrack(const juce::String& name, Track::TrackType type);
+    Track* addBus(const juce::String& name);
     void removeTrack(int index);
     int getNumTracks() const { return tracks.size(); }
-    Track* getTrack(int index) { return tracks[index].get(); }
+    Track* getTrack(int index) { return tracks[index]; }
+    
+    // Routing. Every track feeds the master until routed to a bus; sends add
+    // post-fader feeds into further buses. Edits that would create a feedback
+    // loop are refused and return false.
+    bool setTrackOutput(Track* track, Track* bus);
+    bool addSend(Track* source, Track* bus, float gain);
+    bool setSendGain(Track* source, Track* bus, float gain);
+    bool removeSend(Track* source, Track* bus);
+    bool addSidechain(Track* source, Track* destination);
+    bool removeSidechain(Track* source, Track* destination);
+    const RenderGraph& getRenderGraph() const { return graph; }
     
-    // Master output
-    void setMasterVolume(float volume);
+    // Latency compensation. Every path to the master is delayed to match the
+    // slowest one; track latencies are read whenever the routing changes.
+    // After changing one some other way (loading a plugin, adding an effect
+    // with lookahead), call updateLatencyCompensation(), which only
+    // recompiles if a latency actually changed.
+    bool updateLatencyCompensation();
+    int getLatencySamples() const;
+    
+    // Master output. Like the track setters, the change is queued for the
+    // audio thread and applied at the given engine sample position, or as
+    // soon as possible.
+    void setMasterVolume(float volume, juce::int64 atSample = -1);
     float getMasterVolume() const { return masterVolume; }
+    
+    // Clip playback. The playhead is in samples on the session timeline and
+    // only moves while playing; a locate takes effect at the next block.
+    void play() { playing = true; }
+    void stop() { playing = false; }
+    bool isPlaying() const { return playing.load(); }
+    void setPlayheadPosition(juce::int64 position) { locateRequest = juce::jmax((juce::int64) 0, position); }
+    juce::int64 getPlayheadPosition() const { return playheadPosition.load(); }
+    
+    // Parameter changes in flight to the audio thread
+    juce::int64 getSampleClock() const { return sampleClock.load(); }
+    EngineCommandQueue::Stats getCommandQueueStats() const { return commandQueue.getStats(); }
+    void resetCommandQueueStats() { commandQueue.resetStats(); }
+    
+    // Parallel rendering (off by default). Tracks are spread over a pool of
+    // real-time worker threads; sessions with fewer tracks than the threshold
+    // keep rendering serially on the audio thread. A worker count of 0 uses
+    // one worker per physical core, leaving one for the audio thread.
+    void setParallelRendering(bool shouldRenderInParallel, int numWorkers = 0);
+    bool isParallelRenderingEnabled() const { return renderPool != nullptr; }
+    int getNumRenderWorkers() const { return renderPool != nullptr ? renderPool->getNumWorkers() : 0; }
+    void setParallelRenderThreshold(int minimumTracks);
+    int getParallelRenderThreshold() const { return parallelRenderThreshold.load(); }
+    
+    // DSP load: the time the device callback takes per block, as a share of
+    // the block's duration. Percentiles cover every block since the last
+    // reset. Per-track and per-effect timings are kept by
+    // Track::getRenderTiming() and Effect::getProcessTiming().
+    struct DspLoad
+    {
+        juce::uint64 numBlocks = 0;
+        double currentPercent = 0.0;
+        double p50Percent = 0.0;
+        double p99Percent = 0.0;
+        double maxPercent = 0.0;
+    };
+    
+    DspLoad getDspLoad() const;
+    TimingHistogram::Summary getBlockTiming() const { return blockTiming.getSummary(); }
+    void resetTimingStatistics();
 
 private:
+    const DeviceMode deviceMode;
     juce::AudioDeviceManager deviceManager;
     juce::AudioBuffer<float> buffer;
     juce::AudioBuffer<float> masterBuffer;
+    juce::MidiBuffer midiBlock;
     Transport* transport = nullptr;
     MidiHandler midiHandler;
     PluginManager pluginManager;
     
     double currentSampleRate = 44100.0;
     int bufferSize = 512;
+    bool prepared = false;
     float masterVolume = 1.0f;
     
+    // Message thread to audio thread parameter changes. The audio thread keeps
+    // its own copy of the master volume and counts samples for timestamping.
+    EngineCommandQueue commandQueue;
+    BlockSegments<float> masterGain;
+    GainRampPlanner<1> masterGainRamps;
+    juce::int64 blockStartSample = 0;
+    std::atomic<juce::int64> sampleClock { 0 };
+    
+    // The timeline playhead, owned by the audio thread; play, stop and
+    // locate requests reach it through the atomics
+    std::atomic<bool> playing { false };
+    std::atomic<juce::int64> locateRequest { -1 };
+    std::atomic<juce::int64> playheadPosition { 0 };
+    juce::int64 playhead = 0;
+    
     juce::OwnedArray<Track> tracks;
     
+    RenderGraph graph;
+    
+    // Everything the audio thread needs for a block, published as one
+    // immutable snapshot whenever the topology or the pool changes
+    struct RenderState
+    {
+        std::unique_ptr<RenderSchedule> schedule;
+        std::shared_ptr<RenderThreadPool> pool;
+        juce::uint32 topologyVersion = 0;
+    };
+    
+    RealtimeSnapshot<RenderState> renderState;
+    
+    struct LevelRenderJob : public RenderThreadPool::Job
+    {
+        void runJob(int jobIndex) override;
+        
+        RenderSchedule* schedule = nullptr;
+        int levelStart = 0;
+        const juce::AudioBuffer<float>* input = nullptr;
+        const juce::MidiBuffer* midiMessages = nullptr;
+    };
+    
+    LevelRenderJob renderJob;
+    std::shared_ptr<RenderThreadPool> renderPool;
+    std::atomic<int> parallelRenderThreshold { 8 };
+    juce::uint32 topologyVersion = 0;
+    
+    TimingHistogram blockTiming;
+    std::atomic<double> blockDurationSeconds { 0.0 };
+    
+    // Compiles the graph and publishes it; a removed track is handed over as
+    // garbage and deleted once the audio thread can no longer reach it
+    void publishRenderState(std::unique_ptr<Track> removedTrack = nullptr);
+    const RenderSchedule* getPublishedSchedule() const;
+    bool applyGraphEdit(bool graphChanged);
+    void applyParameterChanges(const RenderState* state, int numSamples);
+    bool applyCommand(const RenderState* state, const EngineCommand& command, int sampleOffset);
+    void renderSchedule(RenderSchedule& scheduleToRender, RenderThreadPool* pool,
+                        const juce::AudioBuffer<float>& input, const juce::MidiBuffer& midiMessages);
     void processTracks(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+    
+    // Tracks plus master volume: everything the device callback renders
+    void renderNextBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+
+    friend class AudioEngineTest;
+    friend class OfflineRenderer;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioEngine)
 };
@@ -0,0 +1,51 @@
+#include "DeferredReleasePool.h"
+
+namespace
+{
+    constexpr int collectionIntervalMs = 100;
+}
+
+DeferredReleasePool::DeferredReleasePool()
+    : juce::Thread("Deferred Release Pool")
+{
+    startThread(juce::Thread::Priority::low);
+}
+
+DeferredReleasePool::~DeferredReleasePool()
+{
+    stopThread(2000);
+
+    // Clients are expected to have removed themselves by now
+    jassert(clients.isEmpty());
+}
+
+void DeferredReleasePool::addClient(Client* client)
+{
+    const juce::ScopedLock lock(clientLock);
+    clients.addIfNotAlreadyThere(client);
+}
+
+void DeferredReleasePool::removeClient(Client* client)
+{
+    const juce::ScopedLock lock(clientLock);
+    clients.removeFirstMatchingValue(client);
+}
+
+void DeferredReleasePool::collectNow()
+{
+    const juce::ScopedLock lock(clientLock);
+
+    for (auto* client : clients)
+    {
+        client->collectGarbage();
+    }
+}
+
+void DeferredReleasePool::run()
+{
+    while (!threadShouldExit())
+    {
+        collectNow();
+        wait(collectionIntervalMs);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <JuceHeader.h>
+
+// A background thread that periodically asks its clients to free whatever the
+// audio thread has finished with. Nothing that can run on the audio thread
+// ever deletes anything; it just stops referring to it, and the pool cleans up
+// a little later.
+//
+// Use it through juce::SharedResourcePointer<DeferredReleasePool> so that all
+// engines, tracks and effect chains in the process share one thread.
+class DeferredReleasePool : private juce::Thread
+{
+public:
+    struct Client
+    {
+        virtual ~Client() = default;
+
+        // Called on the pool's thread (or from collectNow()); never concurrently
+        virtual void collectGarbage() = 0;
+    };
+
+    DeferredReleasePool();
+    ~DeferredReleasePool() override;
+
+    void addClient(Client* client);
+
+    // Blocks until any collection in progress has finished, so a client can
+    // safely be destroyed once this returns
+    void removeClient(Client* client);
+
+    // Runs a collection pass immediately on the calling thread
+    void collectNow();
+
+private:
+    void run() override;
+
+    juce::CriticalSection clientLock;
+    juce::Array<Client*> clients;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DeferredReleasePool)
+};
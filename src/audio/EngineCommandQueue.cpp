@@ -0,0 +1,124 @@
+#include "EngineCommandQueue.h"
+
+EngineCommandQueue::EngineCommandQueue(int capacity)
+{
+    const auto size = (size_t) juce::nextPowerOfTwo(juce::jmax(2, capacity));
+
+    cells.reset(new Cell[size]);
+    mask = size - 1;
+
+    for (size_t i = 0; i < size; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+
+    // Everything in the ring can end up waiting here at once
+    pending.ensureStorageAllocated((int) size);
+}
+
+bool EngineCommandQueue::push(EngineCommand command)
+{
+    command.enqueueTicks = juce::Time::getHighResolutionTicks();
+    command.topologyVersion = topologyVersion.load();
+
+    auto position = enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+
+    // Bounded MPMC ring in the style of Dmitry Vyukov's: each cell's sequence
+    // tells producers whether it is free for this lap
+    for (;;)
+    {
+        cell = &cells[position & mask];
+        const auto sequence = cell->sequence.load(std::memory_order_acquire);
+        const auto difference = (intptr_t) sequence - (intptr_t) position;
+
+        if (difference == 0)
+        {
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (difference < 0)
+        {
+            enqueueFailures.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->command = command;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    commandsEnqueued.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool EngineCommandQueue::pop(EngineCommand& command)
+{
+    auto& cell = cells[dequeuePosition & mask];
+
+    if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+        return false;
+
+    command = cell.command;
+    cell.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+    ++dequeuePosition;
+    return true;
+}
+
+void EngineCommandQueue::drainIntoPending()
+{
+    EngineCommand command;
+
+    while (pending.size() < pending.getNumAllocated() && pop(command))
+    {
+        // Most commands are "as soon as possible" or arrive in time order, so
+        // the insertion point is nearly always the end
+        int index = pending.size();
+
+        while (index > 0 && pending.getReference(index - 1).timestamp > command.timestamp)
+            --index;
+
+        pending.insert(index, command);
+    }
+}
+
+void EngineCommandQueue::recordLatency(juce::int64 ticks)
+{
+    commandsApplied.fetch_add(1, std::memory_order_relaxed);
+    totalLatencyTicks.fetch_add(ticks, std::memory_order_relaxed);
+
+    auto previousMax = maxLatencyTicks.load(std::memory_order_relaxed);
+
+    while (ticks > previousMax
+           && !maxLatencyTicks.compare_exchange_weak(previousMax, ticks, std::memory_order_relaxed))
+    {
+    }
+}
+
+EngineCommandQueue::Stats EngineCommandQueue::getStats() const
+{
+    Stats stats;
+    stats.commandsEnqueued = commandsEnqueued.load();
+    stats.enqueueFailures = enqueueFailures.load();
+    stats.commandsApplied = commandsApplied.load();
+
+    const auto ticksToMs = [](juce::int64 ticks)
+    {
+        return juce::Time::highResolutionTicksToSeconds(ticks) * 1000.0;
+    };
+
+    if (stats.commandsApplied > 0)
+        stats.averageDrainLatencyMs = ticksToMs(totalLatencyTicks.load()) / (double) stats.commandsApplied;
+
+    stats.maxDrainLatencyMs = ticksToMs(maxLatencyTicks.load());
+    return stats;
+}
+
+void EngineCommandQueue::resetStats()
+{
+    commandsEnqueued.store(0);
+    enqueueFailures.store(0);
+    commandsApplied.store(0);
+    totalLatencyTicks.store(0);
+    maxLatencyTicks.store(0);
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include <JuceHeader.h>
+
+class Track;
+
+// A parameter change sent from the UI (or automation) to the audio thread.
+// The timestamp is in engine samples (see AudioEngine::getSampleClock());
+// a negative timestamp means "as soon as possible".
+struct EngineCommand
+{
+    enum class Type
+    {
+        TrackVolume,
+        TrackPan,
+        TrackMute,
+        TrackSolo,
+        MasterVolume
+    };
+
+    Type type = Type::MasterVolume;
+    Track* track = nullptr;
+    juce::uint32 trackId = 0;   // Track::getId(), in case the address has been reused
+    float value = 0.0f;
+    juce::int64 timestamp = -1;
+
+    // Filled in by the queue
+    juce::int64 enqueueTicks = 0;
+    juce::uint32 topologyVersion = 0;
+};
+
+// The values a set of parameters takes during one block, as a short run of
+// segments that each start at a sample offset. Lets sample-accurate changes be
+// applied by the mixer without splitting the block into separate renders.
+template <typename StateType, int maxSegments = 8>
+class BlockSegments
+{
+public:
+    struct Segment
+    {
+        int startSample = 0;
+        StateType state {};
+    };
+
+    // Starts a new block from the state the previous block ended with
+    void beginBlock() { beginBlock(getFinalState()); }
+
+    void beginBlock(const StateType& initialState)
+    {
+        segments[0] = { 0, initialState };
+        numSegments = 1;
+    }
+
+    // Returns the state to modify for a change taking effect at the given
+    // offset. Changes must arrive in time order; once the segment budget is
+    // used up, later changes land in the last segment.
+    StateType& changeAt(int sampleOffset)
+    {
+        auto& last = segments[(size_t) numSegments - 1];
+
+        if (sampleOffset <= last.startSample || numSegments == maxSegments)
+            return last.state;
+
+        segments[(size_t) numSegments] = { sampleOffset, last.state };
+        return segments[(size_t) numSegments++].state;
+    }
+
+    int size() const { return numSegments; }
+    int getStart(int index) const { return segments[(size_t) index].startSample; }
+    int getEnd(int index, int numSamples) const { return index + 1 < numSegments ? segments[(size_t) index + 1].startSample : numSamples; }
+    const StateType& getState(int index) const { return segments[(size_t) index].state; }
+    const StateType& getFinalState() const { return segments[(size_t) numSegments - 1].state; }
+
+private:
+    std::array<Segment, (size_t) maxSegments> segments {};
+    int numSegments = 1;
+};
+
+// A bounded, lock-free multi-producer / single-consumer queue carrying
+// EngineCommands to the audio thread.
+//
+// Any thread may push(). The audio thread calls processDue() once at the start
+// of each block: it drains the queue into a preallocated list ordered by
+// timestamp and hands back every command that falls inside the block, with
+// its sample offset. Commands stamped for a later block wait in that list.
+// Nothing here allocates or blocks after construction.
+class EngineCommandQueue
+{
+public:
+    struct Stats
+    {
+        juce::uint64 commandsEnqueued = 0;
+        juce::uint64 enqueueFailures = 0;
+        juce::uint64 commandsApplied = 0;
+        double averageDrainLatencyMs = 0.0;
+        double maxDrainLatencyMs = 0.0;
+    };
+
+    explicit EngineCommandQueue(int capacity = 4096);
+
+    // Any thread. Returns false, and counts a failure, if the queue is full.
+    bool push(EngineCommand command);
+
+    // Stamped on every command pushed from now on, so the audio thread can
+    // tell whether a command is newer than the track list it is rendering
+    void setTopologyVersion(juce::uint32 version) { topologyVersion.store(version); }
+
+    // Audio thread only. Calls bool apply(const EngineCommand&, int sampleOffset)
+    // for every command due in [blockStart, blockStart + numSamples), in
+    // timestamp order. A command for which apply returns false is kept and
+    // offered again, at offset 0, in the next block.
+    template <typename ApplyFunction>
+    void processDue(juce::int64 blockStart, int numSamples, ApplyFunction&& apply)
+    {
+        drainIntoPending();
+
+        const auto blockEnd = blockStart + numSamples;
+        const auto nowTicks = juce::Time::getHighResolutionTicks();
+        int numDue = 0;
+        int numKept = 0;
+
+        while (numDue < pending.size() && pending.getReference(numDue).timestamp < blockEnd)
+        {
+            const auto command = pending.getReference(numDue++);
+            const auto offset = juce::jlimit((juce::int64) 0, (juce::int64) numSamples - 1, command.timestamp - blockStart);
+
+            if (apply(command, (int) offset))
+                recordLatency(nowTicks - command.enqueueTicks);
+            else
+                pending.getReference(numKept++) = command;
+        }
+
+        pending.removeRange(numKept, numDue - numKept);
+    }
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    void drainIntoPending();
+    bool pop(EngineCommand& command);
+    void recordLatency(juce::int64 ticks);
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence { 0 };
+        EngineCommand command;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    std::atomic<juce::uint32> topologyVersion { 0 };
+    alignas(64) std::atomic<size_t> enqueuePosition { 0 };
+    alignas(64) size_t dequeuePosition = 0;
+
+    // Audio thread only, kept sorted by timestamp
+    juce::Array<EngineCommand> pending;
+
+    std::atomic<juce::uint64> commandsEnqueued { 0 };
+    std::atomic<juce::uint64> enqueueFailures { 0 };
+    std::atomic<juce::uint64> commandsApplied { 0 };
+    std::atomic<juce::int64> totalLatencyTicks { 0 };
+    std::atomic<juce::int64> maxLatencyTicks { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EngineCommandQueue)
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <JuceHeader.h>
+
+// The mixer's inner loop: accumulate a source channel into a destination
+// while applying a linearly ramping gain, in a single pass over the samples.
+// The vector implementation (AVX, SSE or NEON) is picked once, at first use,
+// from what the CPU supports.
+namespace MixKernels
+{
+    // How long gain changes take to ramp in
+    constexpr double gainRampSeconds = 0.002;
+
+    // Anything quieter than this (about -100dB) counts as silence: tracks
+    // and effects sleep on it, and the mixer skips it
+    constexpr float silenceThreshold = 1.0e-5f;
+
+    // dest[i] += src[i] * (startGain + i * gainIncrement)
+    void addWithGainRamp(float* dest, const float* src, int numSamples, float startGain, float gainIncrement);
+
+    // Name of the implementation in use, for diagnostics and benchmarks
+    const char* getImplementationName();
+}
+
+// Turns a block's gain changes into short linear ramps, so that volume, pan
+// and mute changes don't click. A ramp that doesn't finish within a block
+// carries on into the next one.
+//
+// Each block, call beginBlock() and then rampTo() once per segment of
+// constant target gain, in order; the result is a list of pieces with a start
+// gain and a per-sample increment for each channel.
+template <int numChannels>
+class GainRampPlanner
+{
+public:
+    using Gains = std::array<float, (size_t) numChannels>;
+
+    struct Piece
+    {
+        int startSample = 0;
+        int numSamples = 0;
+        Gains startGain {};
+        Gains increment {};
+    };
+
+    // Room for a ramp and a steady run for each of BlockSegments' segments
+    static constexpr int maxPieces = 16;
+
+    void setRampLength(int numSamples) { rampLength = juce::jmax(1, numSamples); }
+
+    // Jumps straight to the given gains on the next rampTo()
+    void reset() { hasGains = false; rampSamplesLeft = 0; }
+
+    // Starts the next ramp from these gains, e.g. from silence
+    void reset(const Gains& gains)
+    {
+        current = target = gains;
+        hasGains = true;
+        rampSamplesLeft = 0;
+    }
+
+    void beginBlock()
+    {
+        numPieces = 0;
+        position = 0;
+    }
+
+    // Covers [previous end, endSample) heading for the given gains
+    void rampTo(const Gains& newTarget, int endSample)
+    {
+        if (!hasGains)
+            reset(newTarget);
+
+        if (newTarget != target)
+        {
+            target = newTarget;
+            rampSamplesLeft = rampLength;
+
+            for (size_t channel = 0; channel < (size_t) numChannels; ++channel)
+                increment[channel] = (target[channel] - current[channel]) / (float) rampLength;
+        }
+
+        while (position < endSample && numPieces < maxPieces)
+        {
+            auto& piece = pieces[(size_t) numPieces++];
+            piece.startSample = position;
+            piece.startGain = current;
+
+            if (rampSamplesLeft > 0)
+            {
+                piece.numSamples = juce::jmin(rampSamplesLeft, endSample - position);
+                piece.increment = increment;
+                rampSamplesLeft -= piece.numSamples;
+
+                for (size_t channel = 0; channel < (size_t) numChannels; ++channel)
+                    current[channel] = rampSamplesLeft > 0 ? current[channel] + increment[channel] * (float) piece.numSamples
+                                                           : target[channel];
+            }
+            else
+            {
+                piece.numSamples = endSample - position;
+                piece.increment = {};
+            }
+
+            position += piece.numSamples;
+        }
+    }
+
+    int getNumPieces() const { return numPieces; }
+    const Piece& getPiece(int index) const { return pieces[(size_t) index]; }
+
+    // True if every gain in the block is zero
+    bool isSilent() const
+    {
+        for (int i = 0; i < numPieces; ++i)
+        {
+            for (size_t channel = 0; channel < (size_t) numChannels; ++channel)
+            {
+                const auto& piece = pieces[(size_t) i];
+
+                if (piece.startGain[channel] != 0.0f || piece.increment[channel] != 0.0f)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::array<Piece, (size_t) maxPieces> pieces {};
+    int numPieces = 0;
+    int position = 0;
+
+    int rampLength = 64;
+    int rampSamplesLeft = 0;
+    bool hasGains = false;
+    Gains current {}, target {}, increment {};
+};
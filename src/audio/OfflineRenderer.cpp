@@ -0,0 +1,125 @@
+#include "OfflineRenderer.h"
+
+OfflineRenderer::OfflineRenderer(AudioEngine& engineToRender)
+    : engine(engineToRender)
+{
+    // Driving an engine that a live device is also calling would race it
+    jassert(engine.isOffline());
+    
+    formatManager.registerBasicFormats();
+}
+
+OfflineRenderer::RenderStats OfflineRenderer::renderToFile(const juce::File& outputFile, const Settings& settings,
+                                                           ProgressCallback progressCallback)
+{
+    RenderStats stats;
+    
+    auto* format = formatManager.findFormatForFileExtension(outputFile.getFileExtension());
+    
+    if (format == nullptr)
+    {
+        stats.errorMessage = "Unsupported output format: " + outputFile.getFileName();
+        return stats;
+    }
+    
+    outputFile.deleteFile();
+    auto stream = std::make_unique<juce::FileOutputStream>(outputFile);
+    
+    if (!stream->openedOk())
+    {
+        stats.errorMessage = "Couldn't open " + outputFile.getFullPathName() + " for writing";
+        return stats;
+    }
+    
+    std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), settings.sampleRate,
+                                                                            (unsigned int) settings.numChannels,
+                                                                            settings.bitsPerSample, {}, 0));
+    
+    if (writer == nullptr)
+    {
+        stats.errorMessage = "The output format doesn't support these settings";
+        return stats;
+    }
+    
+    // The writer owns the stream from here on
+    stream.release();
+    
+    return renderToWriter(writer.get(), settings, std::move(progressCallback));
+}
+
+OfflineRenderer::RenderStats OfflineRenderer::renderToWriter(juce::AudioFormatWriter* writer, const Settings& settings,
+                                                             ProgressCallback progressCallback)
+{
+    RenderStats stats;
+    
+    if (settings.sampleRate <= 0.0 || settings.blockSize <= 0 || settings.numChannels <= 0)
+    {
+        stats.errorMessage = "Invalid render settings";
+        return stats;
+    }
+    
+    const auto totalSamples = (juce::int64) std::ceil(settings.lengthSeconds * settings.sampleRate);
+    
+    const bool wasPrepared = engine.isPrepared();
+    const double previousSampleRate = engine.getSampleRate();
+    const int previousBlockSize = engine.getBlockSize();
+    
+    engine.prepareToPlay(settings.blockSize, settings.sampleRate);
+    
+    if (inputSource != nullptr)
+        inputSource->prepareToPlay(settings.blockSize, settings.sampleRate);
+    
+    // With no device there is no input: unless there is an input source, every
+    // block starts out silent
+    juce::AudioBuffer<float> block(settings.numChannels, settings.blockSize);
+    juce::MidiBuffer midiMessages;
+    
+    const double startTime = juce::Time::getMillisecondCounterHiRes();
+    
+    while (stats.samplesRendered < totalSamples)
+    {
+        const int numSamples = (int) juce::jmin((juce::int64) settings.blockSize, totalSamples - stats.samplesRendered);
+        
+        block.setSize(settings.numChannels, numSamples, false, false, true);
+        midiMessages.clear();
+        
+        if (inputSource != nullptr)
+            inputSource->getNextAudioBlock(juce::AudioSourceChannelInfo(&block, 0, numSamples));
+        else
+            block.clear();
+        
+        engine.renderNextBlock(block, midiMessages);
+        
+        if (writer != nullptr && !writer->writeFromAudioSampleBuffer(block, 0, numSamples))
+        {
+            stats.errorMessage = "Writing the rendered audio failed";
+            break;
+        }
+        
+        stats.samplesRendered += numSamples;
+        
+        if (progressCallback && !progressCallback((double) stats.samplesRendered / (double) totalSamples))
+        {
+            stats.errorMessage = "Render cancelled";
+            break;
+        }
+    }
+    
+    if (writer != nullptr)
+        writer->flush();
+    
+    stats.wallClockSeconds = (juce::Time::getMillisecondCounterHiRes() - startTime) * 0.001;
+    stats.audioSeconds = (double) stats.samplesRendered / settings.sampleRate;
+    stats.realtimeFactor = stats.wallClockSeconds > 0.0 ? stats.audioSeconds / stats.wallClockSeconds : 0.0;
+    stats.succeeded = stats.errorMessage.isEmpty();
+    
+    if (wasPrepared)
+        engine.prepareToPlay(previousBlockSize, previousSampleRate);
+    else
+        engine.releaseResources();
+    
+    if (inputSource != nullptr)
+        inputSource->releaseResources();
+    
+    return stats;
+}
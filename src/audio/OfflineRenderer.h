@@ -0,0 +1,63 @@
+#pragma once
+#include <JuceHeader.h>
+#include "AudioEngine.h"
+
+// Renders an engine's master output to an audio file as fast as the CPU
+// allows, with no audio device involved.
+//
+// The engine should be constructed with AudioEngine::DeviceMode::Offline: the
+// renderer prepares it at the requested sample rate and block size and then
+// pulls blocks from it in a plain loop on the calling thread. Afterwards the
+// engine is prepared as it was before the render, or released if it wasn't.
+class OfflineRenderer
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 44100.0;
+        int blockSize = 512;
+        int numChannels = 2;
+        int bitsPerSample = 24;
+        double lengthSeconds = 0.0;
+    };
+
+    struct RenderStats
+    {
+        bool succeeded = false;
+        juce::String errorMessage;
+        juce::int64 samplesRendered = 0;
+        double audioSeconds = 0.0;
+        double wallClockSeconds = 0.0;
+
+        // Seconds of audio produced per second of wall-clock time
+        double realtimeFactor = 0.0;
+    };
+
+    // Called after every block with the fraction rendered so far. Returning
+    // false cancels the render.
+    using ProgressCallback = std::function<bool(double progress)>;
+
+    explicit OfflineRenderer(AudioEngine& engineToRender);
+
+    // Feeds the engine's input from a source instead of silence, e.g. to
+    // stand in for a live input when benchmarking. The source isn't owned
+    // and is prepared and released around each render.
+    void setInputSource(juce::AudioSource* source) { inputSource = source; }
+
+    // The output format is chosen from the file extension (WAV, AIFF, ...).
+    // An existing file is replaced.
+    RenderStats renderToFile(const juce::File& outputFile, const Settings& settings,
+                             ProgressCallback progressCallback = nullptr);
+
+    // Renders into an already opened writer, which stays owned by the caller.
+    // A null writer renders without writing anything, e.g. to measure speed.
+    RenderStats renderToWriter(juce::AudioFormatWriter* writer, const Settings& settings,
+                               ProgressCallback progressCallback = nullptr);
+
+private:
+    AudioEngine& engine;
+    juce::AudioSource* inputSource = nullptr;
+    juce::AudioFormatManager formatManager;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OfflineRenderer)
+};
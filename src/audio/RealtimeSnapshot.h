@@ -0,0 +1,147 @@
+#pragma once
+#include <JuceHeader.h>
+#include "DeferredReleasePool.h"
+
+// An immutable object published by a writer thread and read, wait-free, by a
+// single real-time reader thread (RCU style).
+//
+// The writer builds a complete new object and publish()es it with one atomic
+// pointer swap. The previous object is retired, together with any garbage
+// that must outlive it (e.g. tracks it still points to), and is only deleted by
+// the DeferredReleasePool once the reader can no longer be using it. The
+// reader announces which object it is using through a hazard pointer, so it
+// never locks, never waits and never frees anything.
+template <typename ObjectType>
+class RealtimeSnapshot : private DeferredReleasePool::Client
+{
+public:
+    RealtimeSnapshot()
+    {
+        releasePool->addClient(this);
+    }
+
+    ~RealtimeSnapshot() override
+    {
+        releasePool->removeClient(this);
+
+        // The reader must be gone by now
+        jassert(inUse.load() == nullptr);
+        retired.clear();
+        delete current.exchange(nullptr);
+    }
+
+    // Pins the current object for the reader for as long as the scope lives.
+    // Only one thread may read at a time.
+    class ReadScope
+    {
+    public:
+        explicit ReadScope(RealtimeSnapshot& snapshotToRead)
+            : owner(snapshotToRead),
+              object(owner.acquire())
+        {
+        }
+
+        ~ReadScope()
+        {
+            owner.inUse.store(nullptr);
+        }
+
+        ObjectType* get() const { return object; }
+        ObjectType* operator->() const { return object; }
+
+    private:
+        RealtimeSnapshot& owner;
+        ObjectType* const object;
+
+        JUCE_DECLARE_NON_COPYABLE(ReadScope)
+    };
+
+    // Writer side: replaces the current object. The garbage is destroyed
+    // together with the retired object, once the reader has moved on.
+    template <typename GarbageType = ObjectType>
+    void publish(std::unique_ptr<ObjectType> next, std::unique_ptr<GarbageType> garbage = nullptr)
+    {
+        auto entry = std::make_unique<RetiredEntry>();
+        entry->garbage.reset(new GarbageHolder<GarbageType>(std::move(garbage)));
+
+        const juce::ScopedLock lock(retiredLock);
+        entry->object.reset(current.exchange(next.release()));
+        retired.add(entry.release());
+    }
+
+    // Writer side: the most recently published object
+    const ObjectType* getLatest() const { return current.load(); }
+
+    int getNumRetired() const
+    {
+        const juce::ScopedLock lock(retiredLock);
+        return retired.size();
+    }
+
+private:
+    ObjectType* acquire()
+    {
+        // Classic hazard-pointer handshake: announce, then confirm that the
+        // object is still current, so a concurrent collectGarbage() either sees
+        // the announcement or we see the newer object and retry
+        auto* object = current.load();
+
+        for (;;)
+        {
+            inUse.store(object);
+            auto* latest = current.load();
+
+            if (latest == object)
+                return object;
+
+            object = latest;
+        }
+    }
+
+    void collectGarbage() override
+    {
+        const juce::ScopedLock lock(retiredLock);
+        auto* objectInUse = inUse.load();
+
+        // Entries are retired oldest first. Everything older than the object
+        // being read can go; that object and everything newer must wait,
+        // since the garbage of a newer entry may still be reachable from it.
+        // With no reader at all everything can go, including an entry for the
+        // null object the snapshot starts out with.
+        int numToRelease = 0;
+
+        while (numToRelease < retired.size()
+               && (objectInUse == nullptr || retired[numToRelease]->object.get() != objectInUse))
+            ++numToRelease;
+
+        retired.removeRange(0, numToRelease);
+    }
+
+    struct GarbageHolderBase
+    {
+        virtual ~GarbageHolderBase() = default;
+    };
+
+    template <typename GarbageType>
+    struct GarbageHolder : public GarbageHolderBase
+    {
+        explicit GarbageHolder(std::unique_ptr<GarbageType> g) : garbage(std::move(g)) {}
+        std::unique_ptr<GarbageType> garbage;
+    };
+
+    struct RetiredEntry
+    {
+        // The garbage may be referenced by the object, so it goes last
+        std::unique_ptr<GarbageHolderBase> garbage;
+        std::unique_ptr<ObjectType> object;
+    };
+
+    std::atomic<ObjectType*> current { nullptr };
+    std::atomic<ObjectType*> inUse { nullptr };
+
+    juce::CriticalSection retiredLock;
+    juce::OwnedArray<RetiredEntry> retired;
+    juce::SharedResourcePointer<DeferredReleasePool> releasePool;
+
+    JUCE_DECLARE_NON_COPYABLE(RealtimeSnapshot)
+};
@@ -0,0 +1,627 @@
+#include "RenderGraph.h"
+#include "MixKernels.h"
+
+RenderSchedule::CompensationDelay::CompensationDelay(int numChannels, int delay, int maxBlockSize)
+    : maxPieceSize(juce::jmax(1, maxBlockSize)), delaySamples(delay)
+{
+    line.setInterpolation(DelayLine::Interpolation::None);
+    line.prepare(numChannels, delay + maxPieceSize);
+    delayed.setSize(numChannels, maxPieceSize);
+}
+
+void RenderSchedule::CompensationDelay::process(const juce::AudioBuffer<float>* source, int numSamples)
+{
+    delayed.setSize(delayed.getNumChannels(), numSamples, false, false, true);
+
+    // A silent block goes in as zeros, written from the output it then
+    // overwrites
+    if (source == nullptr)
+        delayed.clear();
+
+    const int numChannels = source != nullptr ? juce::jmin(line.getNumChannels(), source->getNumChannels())
+                                              : line.getNumChannels();
+
+    // The line is a piece longer than the delay, so the read never reaches
+    // samples the piece hasn't written yet
+    for (int start = 0; start < numSamples; start += maxPieceSize)
+    {
+        const int pieceSize = juce::jmin(maxPieceSize, numSamples - start);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const auto& input = source != nullptr ? *source : delayed;
+            line.write(channel, input.getReadPointer(channel, start), pieceSize);
+            line.read(channel, delayed.getWritePointer(channel, start), pieceSize,
+                      (float) (delaySamples + pieceSize));
+        }
+    }
+}
+
+bool RenderSchedule::containsTrack(const Track* track) const
+{
+    return std::binary_search(sortedTracks.begin(), sortedTracks.end(), track, std::less<const Track*>());
+}
+
+void RenderSchedule::beginBlock(const PlayheadState& playhead)
+{
+    for (auto* step : steps)
+        step->track->beginBlock(playhead);
+}
+
+void RenderSchedule::prepareBlock(const juce::AudioBuffer<float>& engineInput, const juce::MidiBuffer& midiMessages)
+{
+    bool anySoloed = false;
+
+    for (auto* step : steps)
+    {
+        step->track->planGainRamps(engineInput.getNumSamples());
+        anySoloed = anySoloed || step->track->isSoloedThisBlock();
+    }
+
+    for (auto* step : steps)
+    {
+        step->audible = !anySoloed || step->track->isSoloedThisBlock();
+
+        for (int i = 0; i < step->soloRelatives.size() && !step->audible; ++i)
+            step->audible = steps.getUnchecked(step->soloRelatives.getUnchecked(i))->track->isSoloedThisBlock();
+    }
+
+    // Backwards, so every sidechain destination is decided before its sources:
+    // a step nobody hears still renders if it keys one that is rendered
+    for (int stepIndex = steps.size(); --stepIndex >= 0;)
+    {
+        auto& step = *steps.getUnchecked(stepIndex);
+
+        // A recording track captures ahead of its fader, so it renders even
+        // when muted, soloed out or faded all the way down
+        step.needsRender = step.track->isRecording();
+
+        if (step.track->isSilentThisBlock())
+            continue;
+
+        step.needsRender = step.needsRender || step.audible;
+
+        for (int i = 0; i < step.sidechainDestinations.size() && !step.needsRender; ++i)
+            step.needsRender = steps.getUnchecked(step.sidechainDestinations.getUnchecked(i))->needsRender;
+    }
+
+    engineInputIsSilent = midiMessages.isEmpty() && isSilent(engineInput, engineInput.getNumSamples());
+}
+
+bool RenderSchedule::isSilent(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+    {
+        if (buffer.getMagnitude(channel, 0, numSamples) > MixKernels::silenceThreshold)
+            return false;
+    }
+    return true;
+}
+
+void RenderSchedule::renderStep(int stepIndex, const juce::AudioBuffer<float>& engineInput,
+                                const juce::MidiBuffer& midiMessages)
+{
+    auto& step = *steps.getUnchecked(stepIndex);
+    step.renderedThisBlock = false;
+
+    if (!step.needsRender)
+    {
+        step.track->skipBlock();
+        return;
+    }
+
+    const int numSamples = engineInput.getNumSamples();
+    const juce::AudioBuffer<float>* sidechain = nullptr;
+
+    if (!step.sidechainSources.isEmpty())
+    {
+        // Sized at compile time; this only adjusts the length
+        step.sidechainInput.setSize(step.sidechainInput.getNumChannels(), numSamples, false, false, true);
+        step.sidechainInput.clear();
+
+        for (auto source : step.sidechainSources)
+            addPostFader(step.sidechainInput, { source, 1.0f, nullptr }, numSamples, false);
+
+        sidechain = &step.sidechainInput;
+    }
+
+    if (step.isBus)
+    {
+        step.busInput.setSize(step.busInput.getNumChannels(), numSamples, false, false, true);
+        step.busInput.clear();
+
+        bool anyInputRendered = false;
+
+        for (const auto& input : step.audioInputs)
+            anyInputRendered = addPostFader(step.busInput, input, numSamples, true) || anyInputRendered;
+
+        if (step.track->shouldSleep(!anyInputRendered || isSilent(step.busInput, numSamples), midiMessages, numSamples))
+            return;
+
+        step.track->renderBlock(step.busInput, midiMessages, sidechain);
+    }
+    else
+    {
+        if (step.track->shouldSleep(engineInputIsSilent, midiMessages, numSamples))
+            return;
+
+        step.track->renderBlock(engineInput, midiMessages, sidechain);
+    }
+
+    step.renderedThisBlock = true;
+}
+
+void RenderSchedule::sumIntoMaster(juce::AudioBuffer<float>& master, int numSamples) const
+{
+    for (const auto& input : masterInputs)
+        addPostFader(master, input, numSamples, true);
+}
+
+bool RenderSchedule::addPostFader(juce::AudioBuffer<float>& destination, const Input& input,
+                                  int numSamples, bool isAudioRoute) const
+{
+    const auto& source = *steps.getUnchecked(input.sourceStep);
+    auto* compensation = input.compensation.get();
+
+    // A soloed-out step may still render to key a sidechain, and a silent
+    // one to record, but neither is heard
+    if (!source.renderedThisBlock || source.track->isSilentThisBlock() || (isAudioRoute && !source.audible))
+    {
+        // Keep the delay moving in step with the others; whatever it still
+        // holds was faded out or had died away already
+        if (compensation != nullptr)
+            compensation->process(nullptr, numSamples);
+
+        return false;
+    }
+
+    const auto* sourceOutput = &source.track->getRenderedBlock();
+
+    if (compensation != nullptr)
+    {
+        compensation->process(sourceOutput, numSamples);
+        sourceOutput = &compensation->delayed;
+    }
+
+    const int numChannels = juce::jmin(destination.getNumChannels(), sourceOutput->getNumChannels());
+
+    // One pass per channel: volume, pan and mute, ramping wherever they
+    // changed, are applied while summing
+    const auto& ramps = source.track->getGainRamps();
+    jassert(numChannels <= 2);
+
+    for (int i = 0; i < ramps.getNumPieces(); ++i)
+    {
+        const auto& piece = ramps.getPiece(i);
+        jassert(piece.startSample + piece.numSamples <= numSamples);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            MixKernels::addWithGainRamp(destination.getWritePointer(channel, piece.startSample),
+                                        sourceOutput->getReadPointer(channel, piece.startSample),
+                                        piece.numSamples,
+                                        input.gain * piece.startGain[(size_t) channel],
+                                        input.gain * piece.increment[(size_t) channel]);
+        }
+    }
+
+    return true;
+}
+
+//==============================================================================
+void RenderGraph::addNode(Track* track)
+{
+    if (track == nullptr || nodes.contains(track))
+        return;
+
+    nodes.add(track);
+    mainOutputs.add(nullptr);
+}
+
+void RenderGraph::removeNode(Track* track)
+{
+    const int index = nodes.indexOf(track);
+
+    if (index < 0)
+        return;
+
+    nodes.remove(index);
+    mainOutputs.remove(index);
+
+    // Anything that was routed into a removed bus falls back to the master
+    for (int i = 0; i < mainOutputs.size(); ++i)
+    {
+        if (mainOutputs[i] == track)
+            mainOutputs.set(i, nullptr);
+    }
+
+    for (int i = connections.size(); --i >= 0;)
+    {
+        const auto& connection = connections.getReference(i);
+
+        if (connection.source == track || connection.destination == track)
+            connections.remove(i);
+    }
+}
+
+bool RenderGraph::setMainOutput(Track* source, Track* bus)
+{
+    const int index = nodes.indexOf(source);
+
+    if (index < 0 || (bus != nullptr && !canFeed(source, bus)))
+        return false;
+
+    mainOutputs.set(index, bus);
+    return true;
+}
+
+Track* RenderGraph::getMainOutput(const Track* source) const
+{
+    return mainOutputs[nodes.indexOf(const_cast<Track*>(source))];
+}
+
+bool RenderGraph::addSend(Track* source, Track* bus, float gain)
+{
+    if (!nodes.contains(source) || !canFeed(source, bus)
+        || indexOfConnection(source, bus, ConnectionType::Send) >= 0)
+        return false;
+
+    connections.add({ source, bus, ConnectionType::Send, juce::jlimit(0.0f, 2.0f, gain) });
+    return true;
+}
+
+bool RenderGraph::setSendGain(Track* source, Track* bus, float gain)
+{
+    const int index = indexOfConnection(source, bus, ConnectionType::Send);
+
+    if (index < 0)
+        return false;
+
+    connections.getReference(index).gain = juce::jlimit(0.0f, 2.0f, gain);
+    return true;
+}
+
+bool RenderGraph::removeSend(Track* source, Track* bus)
+{
+    const int index = indexOfConnection(source, bus, ConnectionType::Send);
+
+    if (index < 0)
+        return false;
+
+    connections.remove(index);
+    return true;
+}
+
+bool RenderGraph::addSidechain(Track* source, Track* destination)
+{
+    if (!nodes.contains(source) || !nodes.contains(destination)
+        || wouldCreateCycle(source, destination)
+        || indexOfConnection(source, destination, ConnectionType::Sidechain) >= 0)
+        return false;
+
+    connections.add({ source, destination, ConnectionType::Sidechain, 1.0f });
+    return true;
+}
+
+bool RenderGraph::removeSidechain(Track* source, Track* destination)
+{
+    const int index = indexOfConnection(source, destination, ConnectionType::Sidechain);
+
+    if (index < 0)
+        return false;
+
+    connections.remove(index);
+    return true;
+}
+
+bool RenderGraph::wouldCreateCycle(const Track* source, const Track* destination) const
+{
+    if (source == destination)
+        return true;
+
+    // Walk upstream from the source; reaching the destination means the
+    // destination already feeds the source
+    juce::Array<Track*> visited, pending;
+    collectInputs(source, pending);
+
+    while (!pending.isEmpty())
+    {
+        auto* node = pending.getLast();
+        pending.removeLast();
+
+        if (node == destination)
+            return true;
+
+        if (!visited.contains(node))
+        {
+            visited.add(node);
+            collectInputs(node, pending);
+        }
+    }
+
+    return false;
+}
+
+bool RenderGraph::haveLatenciesChanged() const
+{
+    if (compiledLatencies.size() != nodes.size())
+        return true;
+
+    for (int i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i]->getLatencySamples() != compiledLatencies[i])
+            return true;
+    }
+    return false;
+}
+
+std::unique_ptr<RenderSchedule> RenderGraph::compile(int numChannels, int maxBlockSize)
+{
+    auto schedule = std::make_unique<RenderSchedule>();
+
+    // Level of a node = length of the longest path feeding it. Nodes are
+    // resolved repeatedly until stable; the graph is acyclic by construction,
+    // so this terminates after at most one pass per level.
+    juce::Array<int> levels;
+    levels.insertMultiple(0, -1, nodes.size());
+
+    int numResolved = 0;
+    int numLevels = 0;
+
+    while (numResolved < nodes.size())
+    {
+        const int resolvedBefore = numResolved;
+
+        for (int i = 0; i < nodes.size(); ++i)
+        {
+            if (levels[i] >= 0)
+                continue;
+
+            juce::Array<Track*> inputs;
+            collectInputs(nodes[i], inputs);
+
+            int level = 0;
+            bool ready = true;
+
+            for (auto* input : inputs)
+            {
+                const int inputLevel = levels[nodes.indexOf(input)];
+
+                // Inputs resolved during this same pass don't count yet, so
+                // every node lands on the earliest level it can run at
+                if (inputLevel < 0 || inputLevel >= numLevels)
+                {
+                    ready = false;
+                    break;
+                }
+
+                level = juce::jmax(level, inputLevel + 1);
+            }
+
+            if (ready)
+            {
+                levels.set(i, level);
+                ++numResolved;
+            }
+        }
+
+        if (numResolved == resolvedBefore)
+        {
+            jassertfalse; // a cycle slipped through; drop the unresolved nodes
+            break;
+        }
+
+        ++numLevels;
+    }
+
+    juce::Array<int> stepForNode;
+    stepForNode.insertMultiple(0, -1, nodes.size());
+
+    for (int level = 0; level < numLevels; ++level)
+    {
+        schedule->levelStarts.add(schedule->steps.size());
+
+        for (int i = 0; i < nodes.size(); ++i)
+        {
+            if (levels[i] != level)
+                continue;
+
+            auto* step = schedule->steps.add(new RenderSchedule::Step());
+            step->track = nodes[i];
+            step->isBus = nodes[i]->isBus();
+            stepForNode.set(i, schedule->steps.size() - 1);
+        }
+    }
+
+    schedule->levelStarts.add(schedule->steps.size());
+
+    // Path latencies, in step order so that every input is known before the
+    // nodes it feeds: a node's output lags the engine input by its own latency
+    // plus that of its slowest audio input
+    compiledLatencies.clearQuick();
+    juce::Array<int> inputLatency, outputLatency;
+    inputLatency.insertMultiple(0, 0, nodes.size());
+    outputLatency.insertMultiple(0, 0, nodes.size());
+
+    for (auto* node : nodes)
+        compiledLatencies.add(node->getLatencySamples());
+
+    for (auto* step : schedule->steps)
+    {
+        const int i = nodes.indexOf(step->track);
+        juce::Array<Track*> inputs;
+
+        for (int source = 0; source < nodes.size(); ++source)
+            if (mainOutputs[source] == nodes[i])
+                inputs.add(nodes[source]);
+
+        for (const auto& connection : connections)
+            if (connection.destination == nodes[i] && connection.type == ConnectionType::Send)
+                inputs.add(connection.source);
+
+        for (auto* input : inputs)
+            inputLatency.set(i, juce::jmax(inputLatency[i], outputLatency[nodes.indexOf(input)]));
+
+        outputLatency.set(i, inputLatency[i] + compiledLatencies[i]);
+    }
+
+    for (int i = 0; i < nodes.size(); ++i)
+    {
+        if (stepForNode[i] >= 0 && mainOutputs[i] == nullptr)
+            schedule->latencySamples = juce::jmax(schedule->latencySamples, outputLatency[i]);
+    }
+
+    // Delays for the feeds that arrive early. Ones whose length hasn't
+    // changed are carried over, so an edit elsewhere in the graph doesn't
+    // interrupt them.
+    std::map<FeedKey, std::shared_ptr<RenderSchedule::CompensationDelay>> nextCompensations;
+
+    auto compensate = [&](int sourceNode, const Track* destination, bool isSend, int arrival)
+    {
+        const int delay = arrival - outputLatency[sourceNode];
+        std::shared_ptr<RenderSchedule::CompensationDelay> compensation;
+
+        if (delay > 0)
+        {
+            const FeedKey key { nodes[sourceNode], destination, isSend };
+            auto existing = compensations.find(key);
+
+            if (existing != compensations.end() && existing->second->delaySamples == delay
+                && existing->second->delayed.getNumChannels() == numChannels
+                && existing->second->maxPieceSize >= maxBlockSize)
+                compensation = existing->second;
+            else
+                compensation = std::make_shared<RenderSchedule::CompensationDelay>(numChannels, delay, maxBlockSize);
+
+            nextCompensations[key] = compensation;
+        }
+
+        return compensation;
+    };
+
+    // Wire up the inputs now that every node has a step index
+    for (int i = 0; i < nodes.size(); ++i)
+    {
+        const int stepIndex = stepForNode[i];
+
+        if (stepIndex < 0)
+            continue;
+
+        auto* destination = mainOutputs[i];
+
+        if (destination == nullptr)
+        {
+            schedule->masterInputs.add({ stepIndex, 1.0f, compensate(i, nullptr, false, schedule->latencySamples) });
+        }
+        else
+        {
+            const int busNode = nodes.indexOf(destination);
+            const int busStep = stepForNode[busNode];
+
+            if (busStep >= 0)
+                schedule->steps[busStep]->audioInputs.add({ stepIndex, 1.0f, compensate(i, destination, false, inputLatency[busNode]) });
+        }
+    }
+
+    for (const auto& connection : connections)
+    {
+        const int sourceNode = nodes.indexOf(connection.source);
+        const int destinationNode = nodes.indexOf(connection.destination);
+        const int sourceStep = stepForNode[sourceNode];
+        const int destinationStep = stepForNode[destinationNode];
+
+        if (sourceStep < 0 || destinationStep < 0)
+            continue;
+
+        auto* step = schedule->steps[destinationStep];
+
+        if (connection.type == ConnectionType::Send)
+            step->audioInputs.add({ sourceStep, connection.gain,
+                                    compensate(sourceNode, connection.destination, true, inputLatency[destinationNode]) });
+        else
+            step->sidechainSources.add(sourceStep);
+    }
+
+    compensations = std::move(nextCompensations);
+
+    for (int stepIndex = 0; stepIndex < schedule->steps.size(); ++stepIndex)
+    {
+        auto* step = schedule->steps[stepIndex];
+
+        for (auto source : step->sidechainSources)
+            schedule->steps[source]->sidechainDestinations.add(stepIndex);
+
+        // Solo follows the audio routing: a soloed track keeps the buses it
+        // feeds audible, and a soloed bus keeps the tracks feeding it audible
+        juce::Array<int> upstream;
+
+        for (const auto& input : step->audioInputs)
+            upstream.add(input.sourceStep);
+
+        while (!upstream.isEmpty())
+        {
+            const int source = upstream.getLast();
+            upstream.removeLast();
+
+            if (step->soloRelatives.contains(source))
+                continue;
+
+            step->soloRelatives.add(source);
+            schedule->steps[source]->soloRelatives.add(stepIndex);
+
+            for (const auto& input : schedule->steps[source]->audioInputs)
+                upstream.add(input.sourceStep);
+        }
+    }
+
+    // Scratch buffers are allocated here, off the audio thread
+    for (auto* step : schedule->steps)
+    {
+        if (step->isBus)
+            step->busInput.setSize(numChannels, maxBlockSize);
+
+        if (!step->sidechainSources.isEmpty())
+            step->sidechainInput.setSize(numChannels, maxBlockSize);
+
+        schedule->sortedTracks.push_back(step->track);
+    }
+
+    std::sort(schedule->sortedTracks.begin(), schedule->sortedTracks.end(), std::less<const Track*>());
+
+    return schedule;
+}
+
+int RenderGraph::indexOfConnection(const Track* source, const Track* destination, ConnectionType type) const
+{
+    for (int i = 0; i < connections.size(); ++i)
+    {
+        const auto& connection = connections.getReference(i);
+
+        if (connection.source == source && connection.destination == destination && connection.type == type)
+            return i;
+    }
+    return -1;
+}
+
+bool RenderGraph::canFeed(const Track* source, const Track* destination) const
+{
+    return destination != nullptr
+        && containsNode(destination)
+        && destination->isBus()
+        && !wouldCreateCycle(source, destination);
+}
+
+void RenderGraph::collectInputs(const Track* node, juce::Array<Track*>& inputs) const
+{
+    for (int i = 0; i < nodes.size(); ++i)
+    {
+        if (mainOutputs[i] == node)
+            inputs.addIfNotAlreadyThere(nodes[i]);
+    }
+
+    for (const auto& connection : connections)
+    {
+        if (connection.destination == node)
+            inputs.addIfNotAlreadyThere(connection.source);
+    }
+}
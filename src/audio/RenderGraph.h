@@ -0,0 +1,195 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../tracks/Track.h"
+#include "../effects/DelayLine.h"
+
+// A compiled, ready-to-run form of the RenderGraph.
+//
+// Steps are stored in topological order and grouped into levels: every step in
+// a level depends only on steps from earlier levels, so a whole level can be
+// rendered concurrently. Buses are single steps, so they are computed once per
+// block however many tracks feed them. Only the audio thread touches a
+// schedule once it has been handed over.
+class RenderSchedule
+{
+public:
+    // Delays a feed by the latency its destination's other inputs have and
+    // it hasn't, so they all line up. A feed whose delay is unchanged keeps
+    // the same instance, and its contents, from one schedule to the next.
+    struct CompensationDelay
+    {
+        CompensationDelay(int numChannels, int delay, int maxBlockSize);
+
+        // Audio thread: delays the block into `delayed`, or a silent block if
+        // there's no source. A block longer than the schedule was compiled for
+        // goes through the line in pieces it has room for.
+        void process(const juce::AudioBuffer<float>* source, int numSamples);
+
+        DelayLine line;
+        const int maxPieceSize;
+        juce::AudioBuffer<float> delayed;
+        const int delaySamples;
+    };
+
+    struct Input
+    {
+        int sourceStep = 0;
+        float gain = 1.0f;
+        std::shared_ptr<CompensationDelay> compensation;
+    };
+
+    struct Step
+    {
+        Track* track = nullptr;
+
+        // Tracks read the engine input; buses sum their audio inputs instead
+        bool isBus = false;
+        juce::Array<Input> audioInputs;
+        juce::Array<int> sidechainSources;
+
+        juce::AudioBuffer<float> busInput;
+        juce::AudioBuffer<float> sidechainInput;
+
+        // Steps whose sidechain this step feeds, and the steps upstream or
+        // downstream of it along audio routes, which keep it audible when soloed
+        juce::Array<int> sidechainDestinations;
+        juce::Array<int> soloRelatives;
+
+        // Decided per block by prepareBlock(): whether the step can be heard
+        // given the solo state, and whether it needs rendering at all
+        bool audible = true;
+        bool needsRender = true;
+
+        // Set while rendering: false when the step was skipped or asleep
+        bool renderedThisBlock = false;
+    };
+
+    int getNumSteps() const { return steps.size(); }
+    int getNumLevels() const { return levelStarts.size() - 1; }
+    int getLevelStart(int level) const { return levelStarts.getUnchecked(level); }
+    int getLevelSize(int level) const { return levelStarts.getUnchecked(level + 1) - levelStarts.getUnchecked(level); }
+
+    // How far the master sum lags the engine input: the latency of the
+    // slowest path to the master
+    int getLatencySamples() const { return latencySamples; }
+
+    // Audio thread, once per command: a binary search of the schedule's
+    // tracks, sorted by address when it was compiled
+    bool containsTrack(const Track* track) const;
+
+    // Starts a new block of mix parameters on every track; parameter changes
+    // for the block are applied after this and before any step is rendered.
+    // Tracks' clips play from the playhead's position.
+    void beginBlock(const PlayheadState& playhead);
+
+    // Evaluates mute and solo once the block's parameter changes are in, and
+    // checks whether the engine input is silent. Steps that are muted or
+    // soloed out are then skipped entirely.
+    void prepareBlock(const juce::AudioBuffer<float>& engineInput, const juce::MidiBuffer& midiMessages);
+
+    // Renders one step. Its inputs must have been rendered already.
+    void renderStep(int stepIndex, const juce::AudioBuffer<float>& engineInput, const juce::MidiBuffer& midiMessages);
+
+    // Adds the post-fader output of every step routed to the master.
+    void sumIntoMaster(juce::AudioBuffer<float>& master, int numSamples) const;
+
+private:
+    friend class RenderGraph;
+
+    // Returns false if the source wasn't rendered, or isn't heard and this
+    // is an audio (rather than sidechain) route
+    bool addPostFader(juce::AudioBuffer<float>& destination, const Input& input,
+                      int numSamples, bool isAudioRoute) const;
+    static bool isSilent(const juce::AudioBuffer<float>& buffer, int numSamples);
+
+    juce::OwnedArray<Step> steps;
+    std::vector<const Track*> sortedTracks;
+    bool engineInputIsSilent = false;
+    juce::Array<int> levelStarts;
+    juce::Array<Input> masterInputs;
+    int latencySamples = 0;
+
+    JUCE_LEAK_DETECTOR(RenderSchedule)
+};
+
+// The engine's processing topology, edited on the message thread.
+//
+// Nodes are tracks and buses (tracks of type BusTrack). Every node has a main
+// output that feeds either the master or a bus, and may additionally feed
+// buses through post-fader sends, or any node through a sidechain connection.
+// Edits that would create a cycle are refused. compile() turns the current
+// state into a RenderSchedule; nothing here is walked on the audio thread.
+//
+// compile() also compensates for latency: every node's path latency is its
+// own plus that of its slowest audio input, and each faster feed into a bus
+// or the master is delayed to match.
+class RenderGraph
+{
+public:
+    enum class ConnectionType
+    {
+        Send,
+        Sidechain
+    };
+
+    struct Connection
+    {
+        Track* source = nullptr;
+        Track* destination = nullptr;
+        ConnectionType type = ConnectionType::Send;
+        float gain = 1.0f;
+    };
+
+    void addNode(Track* track);
+    void removeNode(Track* track);
+    bool containsNode(const Track* track) const { return nodes.contains(const_cast<Track*>(track)); }
+    int getNumNodes() const { return nodes.size(); }
+
+    // Routes a node's main output to a bus, or to the master for nullptr
+    bool setMainOutput(Track* source, Track* bus);
+    Track* getMainOutput(const Track* source) const;
+
+    bool addSend(Track* source, Track* bus, float gain);
+    bool setSendGain(Track* source, Track* bus, float gain);
+    bool removeSend(Track* source, Track* bus);
+
+    bool addSidechain(Track* source, Track* destination);
+    bool removeSidechain(Track* source, Track* destination);
+
+    const juce::Array<Connection>& getConnections() const { return connections; }
+
+    // True if source already depends, directly or indirectly, on destination
+    bool wouldCreateCycle(const Track* source, const Track* destination) const;
+
+    std::unique_ptr<RenderSchedule> compile(int numChannels, int maxBlockSize);
+
+    // True if a node's latency has changed since the last compile(), e.g.
+    // after a plugin was loaded or an effect's lookahead changed
+    bool haveLatenciesChanged() const;
+
+private:
+    int indexOfConnection(const Track* source, const Track* destination, ConnectionType type) const;
+    bool canFeed(const Track* source, const Track* destination) const;
+    void collectInputs(const Track* node, juce::Array<Track*>& inputs) const;
+
+    juce::Array<Track*> nodes;
+    juce::Array<Track*> mainOutputs; // parallel to nodes, nullptr = master
+    juce::Array<Connection> connections;
+
+    // What the last compile() saw: node latencies, parallel to nodes, and the
+    // compensation delays it made, keyed by feed (destination nullptr = master)
+    struct FeedKey
+    {
+        const Track* source = nullptr;
+        const Track* destination = nullptr;
+        bool isSend = false;
+
+        bool operator<(const FeedKey& other) const
+        {
+            return std::tie(source, destination, isSend) < std::tie(other.source, other.destination, other.isSend);
+        }
+    };
+
+    juce::Array<int> compiledLatencies;
+    std::map<FeedKey, std::shared_ptr<RenderSchedule::CompensationDelay>> compensations;
+};
@@ -0,0 +1,200 @@
+#include "RenderThreadPool.h"
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+#endif
+
+namespace
+{
+    inline void pauseCpu() noexcept
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #else
+        std::this_thread::yield();
+       #endif
+    }
+
+    // How long an idle worker keeps polling for the next batch before it goes
+    // to sleep. Blocks arrive every few milliseconds while playing, so a short
+    // spin avoids a kernel wake-up on most of them.
+    constexpr double workerSpinSeconds = 0.0002;
+}
+
+//==============================================================================
+class RenderThreadPool::Worker : public juce::Thread
+{
+public:
+    Worker(RenderThreadPool& ownerPool, int lane)
+        : juce::Thread("Render Worker " + juce::String(lane + 1)),
+          pool(ownerPool),
+          laneIndex(lane)
+    {
+    }
+
+    void run() override
+    {
+        auto lastGeneration = pool.batchGeneration.load();
+
+        while (!threadShouldExit())
+        {
+            const auto generation = pool.batchGeneration.load();
+
+            if (generation == lastGeneration)
+            {
+                waitForNextBatch(lastGeneration);
+                continue;
+            }
+
+            // Announce ourselves before touching the lanes, then make sure the
+            // batch we saw is still the one being run: runBatch() won't reset
+            // the lanes while anyone is registered here.
+            pool.workersInBatch.fetch_add(1);
+
+            if (pool.batchOpen.load() && pool.batchGeneration.load() == generation)
+                pool.drainLanes(laneIndex);
+
+            pool.workersInBatch.fetch_sub(1);
+            lastGeneration = generation;
+        }
+    }
+
+    void wake()
+    {
+        if (sleeping.exchange(false))
+            wakeEvent.signal();
+    }
+
+private:
+    void waitForNextBatch(juce::uint32 lastGeneration)
+    {
+        const auto spinUntil = juce::Time::getHighResolutionTicks()
+                             + juce::Time::secondsToHighResolutionTicks(workerSpinSeconds);
+
+        while (juce::Time::getHighResolutionTicks() < spinUntil)
+        {
+            if (pool.batchGeneration.load() != lastGeneration)
+                return;
+
+            pauseCpu();
+        }
+
+        sleeping.store(true);
+
+        // Re-check after publishing the flag so a batch started in between
+        // is never missed; wake() leaves the event signalled if we get there first
+        if (pool.batchGeneration.load() == lastGeneration)
+            wakeEvent.wait(50);
+
+        sleeping.store(false);
+    }
+
+    RenderThreadPool& pool;
+    const int laneIndex;
+    std::atomic<bool> sleeping { false };
+    juce::WaitableEvent wakeEvent;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Worker)
+};
+
+//==============================================================================
+RenderThreadPool::RenderThreadPool(int numWorkers)
+{
+    numWorkers = juce::jmax(1, numWorkers);
+
+    // One lane per worker plus one for the thread calling runBatch()
+    numLanes = numWorkers + 1;
+    lanes.reset(new Lane[(size_t) numLanes]);
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        auto* worker = workers.add(new Worker(*this, i));
+
+        if (!worker->startRealtimeThread(juce::Thread::RealtimeOptions{}))
+            worker->startThread(juce::Thread::Priority::highest);
+    }
+}
+
+RenderThreadPool::~RenderThreadPool()
+{
+    for (auto* worker : workers)
+    {
+        worker->signalThreadShouldExit();
+        worker->wake();
+    }
+
+    for (auto* worker : workers)
+    {
+        worker->stopThread(1000);
+    }
+}
+
+void RenderThreadPool::runBatch(Job& job, int numJobs)
+{
+    if (numJobs <= 0)
+        return;
+
+    currentJob = &job;
+
+    for (int i = 0; i < numLanes; ++i)
+    {
+        lanes[i].next.store(numJobs * i / numLanes, std::memory_order_relaxed);
+        lanes[i].end = numJobs * (i + 1) / numLanes;
+    }
+
+    jobsRemaining.store(numJobs, std::memory_order_relaxed);
+    batchOpen.store(true);
+
+    // Publishes the lanes and the job to the workers
+    batchGeneration.fetch_add(1);
+    wakeSleepingWorkers();
+
+    drainLanes(numLanes - 1);
+
+    while (jobsRemaining.load(std::memory_order_acquire) > 0)
+        pauseCpu();
+
+    // Every job is done, but a worker may still be scanning the lanes for
+    // more; wait for it to leave before the next batch reuses them
+    batchOpen.store(false);
+
+    while (workersInBatch.load() > 0)
+        pauseCpu();
+
+    currentJob = nullptr;
+}
+
+void RenderThreadPool::drainLanes(int homeLane)
+{
+    for (int offset = 0; offset < numLanes; ++offset)
+    {
+        auto& lane = lanes[(homeLane + offset) % numLanes];
+
+        while (tryRunOneFrom(lane))
+        {
+        }
+    }
+}
+
+bool RenderThreadPool::tryRunOneFrom(Lane& lane)
+{
+    if (lane.next.load(std::memory_order_relaxed) >= lane.end)
+        return false;
+
+    const int jobIndex = lane.next.fetch_add(1, std::memory_order_relaxed);
+
+    if (jobIndex >= lane.end)
+        return false;
+
+    currentJob->runJob(jobIndex);
+    jobsRemaining.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void RenderThreadPool::wakeSleepingWorkers()
+{
+    for (auto* worker : workers)
+    {
+        worker->wake();
+    }
+}
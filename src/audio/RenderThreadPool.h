@@ -0,0 +1,57 @@
+#pragma once
+#include <JuceHeader.h>
+
+// A small pool of real-time worker threads that the audio callback hands a
+// batch of independent jobs to, once per block.
+//
+// Each batch is split into one contiguous lane per thread. A thread drains its
+// own lane first and then steals from the others, so a lane holding one heavy
+// track doesn't leave the rest of the pool idle. The calling (audio) thread
+// works through a lane of its own instead of just waiting.
+class RenderThreadPool
+{
+public:
+    struct Job
+    {
+        virtual ~Job() = default;
+
+        // Called exactly once per index in [0, numJobs) of the batch, from any
+        // thread in the pool. Must be real-time safe.
+        virtual void runJob(int jobIndex) = 0;
+    };
+
+    explicit RenderThreadPool(int numWorkers);
+    ~RenderThreadPool();
+
+    int getNumWorkers() const { return workers.size(); }
+
+    // Runs every job of the batch across the workers and the calling thread and
+    // returns once all of them have finished. Only one thread may call this.
+    void runBatch(Job& job, int numJobs);
+
+private:
+    class Worker;
+
+    struct Lane
+    {
+        alignas(64) std::atomic<int> next { 0 };
+        int end = 0;
+    };
+
+    // Takes jobs from the given lane first, then from every other lane
+    void drainLanes(int homeLane);
+    bool tryRunOneFrom(Lane& lane);
+    void wakeSleepingWorkers();
+
+    juce::OwnedArray<Worker> workers;
+    std::unique_ptr<Lane[]> lanes;
+    int numLanes = 0;
+
+    Job* currentJob = nullptr;
+    alignas(64) std::atomic<int> jobsRemaining { 0 };
+    alignas(64) std::atomic<juce::uint32> batchGeneration { 0 };
+    std::atomic<bool> batchOpen { false };
+    std::atomic<int> workersInBatch { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderThreadPool)
+};
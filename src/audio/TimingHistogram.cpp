@@ -0,0 +1,159 @@
+#include "TimingHistogram.h"
+
+#if JUCE_MSVC
+ #include <intrin.h>
+#elif JUCE_INTEL
+ #include <x86intrin.h>
+#endif
+
+namespace
+{
+    struct Calibration
+    {
+        const juce::uint64 startCycles = CycleClock::now();
+        const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+    };
+
+    const Calibration& getCalibration()
+    {
+        static const Calibration calibration;
+        return calibration;
+    }
+
+    int getHighestBit(juce::uint64 value) noexcept
+    {
+       #if JUCE_MSVC
+        unsigned long index = 0;
+        _BitScanReverse64(&index, value);
+        return (int) index;
+       #else
+        return 63 - __builtin_clzll(value);
+       #endif
+    }
+}
+
+juce::uint64 CycleClock::now() noexcept
+{
+   #if JUCE_INTEL
+    return (juce::uint64) __rdtsc();
+   #elif JUCE_ARM && defined(__aarch64__) && (JUCE_GCC || JUCE_CLANG)
+    juce::uint64 value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+   #else
+    return (juce::uint64) juce::Time::getHighResolutionTicks();
+   #endif
+}
+
+double CycleClock::getCyclesPerSecond()
+{
+   #if JUCE_INTEL || (JUCE_ARM && defined(__aarch64__) && (JUCE_GCC || JUCE_CLANG))
+    // The counters run at a constant rate on anything recent; measure it
+    // against the timer over everything since the first use, which is
+    // usually long enough to be very precise
+    const auto& calibration = getCalibration();
+    const auto minimumTicks = juce::Time::secondsToHighResolutionTicks(0.01);
+
+    while (juce::Time::getHighResolutionTicks() - calibration.startTicks < minimumTicks)
+        juce::Thread::yield();
+
+    const auto elapsedCycles = (double) (CycleClock::now() - calibration.startCycles);
+    const auto elapsedTicks = (double) (juce::Time::getHighResolutionTicks() - calibration.startTicks);
+    return elapsedCycles * (double) juce::Time::getHighResolutionTicksPerSecond() / elapsedTicks;
+   #else
+    return (double) juce::Time::getHighResolutionTicksPerSecond();
+   #endif
+}
+
+//==============================================================================
+TimingHistogram::TimingHistogram()
+{
+    // Starts the calibration period as early as possible
+    getCalibration();
+}
+
+int TimingHistogram::getBucket(juce::uint64 cycles) noexcept
+{
+    if (cycles < (juce::uint64) subBuckets)
+        return (int) cycles;
+
+    const int highestBit = getHighestBit(cycles);
+    const int subBucket = (int) (cycles >> (highestBit - subBucketBits)) & (subBuckets - 1);
+    return (highestBit - subBucketBits + 1) * subBuckets + subBucket;
+}
+
+double TimingHistogram::getBucketMidpoint(int bucket) noexcept
+{
+    if (bucket < subBuckets)
+        return (double) bucket;
+
+    const int shift = bucket / subBuckets - 1;
+    const double lower = std::ldexp((double) (subBuckets + bucket % subBuckets), shift);
+    return lower + std::ldexp(0.5, shift);
+}
+
+void TimingHistogram::record(juce::uint64 cycles) noexcept
+{
+    buckets[(size_t) getBucket(cycles)].fetch_add(1, std::memory_order_relaxed);
+    lastCycles.store(cycles, std::memory_order_relaxed);
+
+    auto previousMax = maxCycles.load(std::memory_order_relaxed);
+
+    while (cycles > previousMax
+           && !maxCycles.compare_exchange_weak(previousMax, cycles, std::memory_order_relaxed))
+    {
+    }
+}
+
+double TimingHistogram::getPercentileCycles(const std::array<juce::uint64, (size_t) numBuckets>& counts,
+                                            juce::uint64 total, double fraction) const
+{
+    const auto rank = (juce::uint64) std::ceil(fraction * (double) total);
+    juce::uint64 seen = 0;
+
+    for (int bucket = 0; bucket < numBuckets; ++bucket)
+    {
+        seen += counts[(size_t) bucket];
+
+        if (seen >= rank)
+            return getBucketMidpoint(bucket);
+    }
+    return (double) maxCycles.load(std::memory_order_relaxed);
+}
+
+TimingHistogram::Summary TimingHistogram::getSummary() const
+{
+    // Take one copy of the counts so the percentiles agree with each other
+    std::array<juce::uint64, (size_t) numBuckets> counts;
+    juce::uint64 total = 0;
+
+    for (size_t bucket = 0; bucket < counts.size(); ++bucket)
+    {
+        counts[bucket] = buckets[bucket].load(std::memory_order_relaxed);
+        total += counts[bucket];
+    }
+
+    Summary summary;
+    summary.count = total;
+
+    if (total == 0)
+        return summary;
+
+    const double secondsPerCycle = 1.0 / CycleClock::getCyclesPerSecond();
+    const double maxSeconds = (double) maxCycles.load(std::memory_order_relaxed) * secondsPerCycle;
+
+    // Bucket midpoints can overshoot the largest value actually seen
+    summary.p50Seconds = juce::jmin(maxSeconds, getPercentileCycles(counts, total, 0.5) * secondsPerCycle);
+    summary.p99Seconds = juce::jmin(maxSeconds, getPercentileCycles(counts, total, 0.99) * secondsPerCycle);
+    summary.maxSeconds = maxSeconds;
+    return summary;
+}
+
+void TimingHistogram::reset()
+{
+    for (auto& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+
+    maxCycles.store(0);
+    lastCycles.store(0);
+}
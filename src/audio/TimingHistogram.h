@@ -0,0 +1,74 @@
+#pragma once
+#include <JuceHeader.h>
+
+// A cheap timestamp for timing audio-thread work: the CPU's time-stamp counter
+// where there is one, the high resolution timer otherwise. Cycle counts are
+// converted to seconds only when statistics are read.
+struct CycleClock
+{
+    static juce::uint64 now() noexcept;
+
+    // Calibrated against the high resolution timer; message thread only, as
+    // the first call may spin for a few milliseconds
+    static double getCyclesPerSecond();
+};
+
+// A lock-free histogram of durations, recorded on the audio thread (or a
+// render worker) and summarised on the message thread.
+//
+// Buckets are logarithmic with eight steps per octave, so percentiles are
+// accurate to within about 10% across the full range of cycle counts.
+// Recording is a couple of relaxed atomic adds; reading never blocks it.
+class TimingHistogram
+{
+public:
+    struct Summary
+    {
+        juce::uint64 count = 0;
+        double p50Seconds = 0.0;
+        double p99Seconds = 0.0;
+        double maxSeconds = 0.0;
+    };
+
+    TimingHistogram();
+
+    void record(juce::uint64 cycles) noexcept;
+    juce::uint64 getLastCycles() const noexcept { return lastCycles.load(std::memory_order_relaxed); }
+
+    Summary getSummary() const;
+
+    // Clears the statistics; samples recorded concurrently may be lost
+    void reset();
+
+    // Records the lifetime of the scope
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(TimingHistogram& histogramToUse) noexcept
+            : histogram(histogramToUse), start(CycleClock::now()) {}
+
+        ~ScopedTimer() { histogram.record(CycleClock::now() - start); }
+
+    private:
+        TimingHistogram& histogram;
+        const juce::uint64 start;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedTimer)
+    };
+
+private:
+    static constexpr int subBucketBits = 3;
+    static constexpr int subBuckets = 1 << subBucketBits;
+    static constexpr int numBuckets = (64 - subBucketBits + 1) * subBuckets;
+
+    static int getBucket(juce::uint64 cycles) noexcept;
+    static double getBucketMidpoint(int bucket) noexcept;
+    double getPercentileCycles(const std::array<juce::uint64, (size_t) numBuckets>& counts,
+                               juce::uint64 total, double fraction) const;
+
+    std::array<std::atomic<juce::uint32>, (size_t) numBuckets> buckets {};
+    std::atomic<juce::uint64> maxCycles { 0 };
+    std::atomic<juce::uint64> lastCycles { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TimingHistogram)
+};
@@ -0,0 +1,57 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Hands the latest version of a value from one writer thread to one real-time
+// reader thread without locks, waits or allocation.
+//
+// Three preallocated slots rotate between the writer, the reader and a shared
+// middle slot: the writer fills its slot and swaps it into the middle, and the
+// reader swaps the middle out when it is newer than what it has. Unlike a
+// plain double buffer neither side ever has to wait for the other to finish
+// with a slot. Versions published in between two reads are skipped.
+template <typename ValueType>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+
+    // Fills every slot, e.g. to size containers up front. Only safe while
+    // neither side is using the buffer.
+    void fill(const ValueType& value)
+    {
+        for (auto& slot : slots)
+            slot = value;
+    }
+
+    // Writer side: fill this, then publish() it
+    ValueType& getWriteSlot() { return slots[(size_t) writeIndex]; }
+
+    void publish()
+    {
+        writeIndex = middle.exchange(writeIndex | newDataFlag, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // Reader side: takes the latest published value, if there is one newer
+    // than the current read slot. Returns true if it did.
+    bool acquireLatest()
+    {
+        if ((middle.load(std::memory_order_relaxed) & newDataFlag) == 0)
+            return false;
+
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const ValueType& getReadSlot() const { return slots[(size_t) readIndex]; }
+
+private:
+    static constexpr int indexMask = 3;
+    static constexpr int newDataFlag = 4;
+
+    std::array<ValueType, 3> slots {};
+    int writeIndex = 0;
+    int readIndex = 1;
+    std::atomic<int> middle { 2 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TripleBuffer)
+};
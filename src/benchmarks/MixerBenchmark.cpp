@@ -0,0 +1,399 @@
+#include <JuceHeader.h>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "../audio/AudioEngine.h"
+#include "../audio/OfflineRenderer.h"
+#include "../audio/MixKernels.h"
+#include "../audio/TimingHistogram.h"
+#include "../effects/CompressorEffect.h"
+#include "../effects/DelayEffect.h"
+#include "../effects/EQEffect.h"
+#include "../effects/ReverbEffect.h"
+#include "../effects/StaticEffectChain.h"
+
+// Headless mixer benchmark: renders offline engines with N tracks of M effects
+// each, across block sizes and sample rates, and prints one JSON document with
+// the cost per sample, the block time percentiles against the real-time
+// deadline, and heap allocations per block.
+//
+//   MixerBenchmark --tracks=8,32,128 --effects=0,3 --block-sizes=64,256,1024
+//                  --sample-rates=44100,96000 --seconds=10 --workers=0
+//                  --output=results.json [--fused]
+//
+// --workers=0 renders serially; any other value renders in parallel with that
+// many workers (-1 for one per physical core). --fused puts every delay, EQ
+// and reverb in a row into one DelayEqReverbChain instead of three effects.
+
+//==============================================================================
+// Every heap allocation in the process is counted, so allocations made on the
+// render path show up in the results. That means every form of operator new:
+// plain, nothrow and over-aligned (as for SIMD types), single and array.
+static std::atomic<juce::uint64> allocationCount { 0 };
+
+static void* countedAllocate(std::size_t size, std::size_t alignment) noexcept
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    size = size == 0 ? 1 : size;
+
+    if (alignment <= alignof(std::max_align_t))
+        return std::malloc(size);
+
+   #if JUCE_WINDOWS
+    return _aligned_malloc(size, alignment);
+   #else
+    // aligned_alloc() wants a whole number of alignments
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+   #endif
+}
+
+static void countedFree(void* memory, std::size_t alignment) noexcept
+{
+   #if JUCE_WINDOWS
+    if (alignment > alignof(std::max_align_t))
+    {
+        _aligned_free(memory);
+        return;
+    }
+   #else
+    juce::ignoreUnused(alignment);
+   #endif
+
+    std::free(memory);
+}
+
+static void* countedAllocateOrThrow(std::size_t size, std::size_t alignment)
+{
+    if (auto* memory = countedAllocate(size, alignment))
+        return memory;
+
+    throw std::bad_alloc();
+}
+
+constexpr std::size_t defaultAlignment = alignof(std::max_align_t);
+
+void* operator new(std::size_t size)                                       { return countedAllocateOrThrow(size, defaultAlignment); }
+void* operator new[](std::size_t size)                                     { return countedAllocateOrThrow(size, defaultAlignment); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept       { return countedAllocate(size, defaultAlignment); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept     { return countedAllocate(size, defaultAlignment); }
+void* operator new(std::size_t size, std::align_val_t alignment)           { return countedAllocateOrThrow(size, (std::size_t) alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment)         { return countedAllocateOrThrow(size, (std::size_t) alignment); }
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size, (std::size_t) alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return countedAllocate(size, (std::size_t) alignment);
+}
+
+void operator delete(void* memory) noexcept                                         { countedFree(memory, defaultAlignment); }
+void operator delete[](void* memory) noexcept                                       { countedFree(memory, defaultAlignment); }
+void operator delete(void* memory, std::size_t) noexcept                            { countedFree(memory, defaultAlignment); }
+void operator delete[](void* memory, std::size_t) noexcept                          { countedFree(memory, defaultAlignment); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept                  { countedFree(memory, defaultAlignment); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept                { countedFree(memory, defaultAlignment); }
+void operator delete(void* memory, std::align_val_t alignment) noexcept             { countedFree(memory, (std::size_t) alignment); }
+void operator delete[](void* memory, std::align_val_t alignment) noexcept           { countedFree(memory, (std::size_t) alignment); }
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept   { countedFree(memory, (std::size_t) alignment); }
+void operator delete[](void* memory, std::size_t, std::align_val_t alignment) noexcept { countedFree(memory, (std::size_t) alignment); }
+
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    countedFree(memory, (std::size_t) alignment);
+}
+
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    countedFree(memory, (std::size_t) alignment);
+}
+
+namespace
+{
+    //==========================================================================
+    // Loops a few seconds of pre-generated noise, so the input never goes
+    // silent and no track is allowed to sleep
+    class NoiseSource : public juce::AudioSource
+    {
+    public:
+        void prepareToPlay(int, double sampleRate) override
+        {
+            noise.setSize(2, juce::jmax(1, (int) sampleRate));
+            juce::Random random(1234);
+
+            for (int channel = 0; channel < noise.getNumChannels(); ++channel)
+                for (int i = 0; i < noise.getNumSamples(); ++i)
+                    noise.setSample(channel, i, (random.nextFloat() * 2.0f - 1.0f) * 0.25f);
+
+            position = 0;
+        }
+
+        void releaseResources() override {}
+
+        void getNextAudioBlock(const juce::AudioSourceChannelInfo& info) override
+        {
+            int done = 0;
+
+            while (done < info.numSamples)
+            {
+                const int numThisTime = juce::jmin(info.numSamples - done, noise.getNumSamples() - position);
+
+                for (int channel = 0; channel < info.buffer->getNumChannels(); ++channel)
+                    info.buffer->copyFrom(channel, info.startSample + done,
+                                          noise, channel % noise.getNumChannels(), position, numThisTime);
+
+                done += numThisTime;
+                position = (position + numThisTime) % noise.getNumSamples();
+            }
+        }
+
+    private:
+        juce::AudioBuffer<float> noise;
+        int position = 0;
+    };
+
+    //==========================================================================
+    struct Options
+    {
+        juce::Array<int> trackCounts { 8, 32, 128 };
+        juce::Array<int> effectCounts { 0, 3 };
+        juce::Array<int> blockSizes { 64, 256, 1024 };
+        juce::Array<int> sampleRates { 44100, 96000 };
+        double seconds = 10.0;
+        int workers = 0;
+        bool fused = false;
+        juce::File outputFile;
+    };
+
+    juce::Array<int> parseList(const juce::ArgumentList& args, const juce::String& option, const juce::Array<int>& defaults)
+    {
+        const auto text = args.getValueForOption(option);
+
+        if (text.isEmpty())
+            return defaults;
+
+        juce::Array<int> values;
+
+        for (const auto& item : juce::StringArray::fromTokens(text, ",", ""))
+            if (item.trim().isNotEmpty())
+                values.add(item.trim().getIntValue());
+
+        return values;
+    }
+
+    Options parseOptions(const juce::ArgumentList& args)
+    {
+        Options options;
+        options.trackCounts = parseList(args, "--tracks", options.trackCounts);
+        options.effectCounts = parseList(args, "--effects", options.effectCounts);
+        options.blockSizes = parseList(args, "--block-sizes", options.blockSizes);
+        options.sampleRates = parseList(args, "--sample-rates", options.sampleRates);
+
+        if (args.containsOption("--seconds"))
+            options.seconds = juce::jmax(0.1, args.getValueForOption("--seconds").getDoubleValue());
+
+        if (args.containsOption("--workers"))
+            options.workers = args.getValueForOption("--workers").getIntValue();
+
+        options.fused = args.containsOption("--fused");
+
+        if (args.containsOption("--output"))
+            options.outputFile = args.getFileForOption("--output");
+
+        return options;
+    }
+
+    //==========================================================================
+    struct RunConfig
+    {
+        int numTracks = 0;
+        int effectsPerTrack = 0;
+        int blockSize = 0;
+        int sampleRate = 0;
+        int workers = 0;
+        bool fused = false;
+    };
+
+    std::unique_ptr<Effect> createEffect(int index)
+    {
+        switch (index % 4)
+        {
+            case 0:  return std::make_unique<DelayEffect>();
+            case 1:  return std::make_unique<EQEffect>();
+            case 2:  return std::make_unique<ReverbEffect>();
+            default: return std::make_unique<CompressorEffect>();
+        }
+    }
+
+    juce::var runBenchmark(const RunConfig& config, double seconds)
+    {
+        AudioEngine engine(AudioEngine::DeviceMode::Offline);
+
+        for (int i = 0; i < config.numTracks; ++i)
+        {
+            auto* track = engine.addTrack("Track " + juce::String(i + 1), Track::AudioTrack);
+            track->setVolume(0.5f);
+            track->setPan(juce::jmap((float) i, 0.0f, (float) juce::jmax(1, config.numTracks - 1), -1.0f, 1.0f));
+
+            for (int e = 0; e < config.effectsPerTrack; ++e)
+            {
+                // A delay, EQ and reverb in a row, as createEffect() makes them
+                if (config.fused && e % 4 == 0 && e + 3 <= config.effectsPerTrack)
+                {
+                    track->getEffectChain().addEffect(std::make_unique<DelayEqReverbChain>());
+                    e += 2;
+                }
+                else
+                {
+                    track->getEffectChain().addEffect(createEffect(e));
+                }
+            }
+        }
+
+        if (config.workers != 0)
+        {
+            engine.setParallelRendering(true, juce::jmax(0, config.workers));
+            engine.setParallelRenderThreshold(1);
+        }
+
+        // The first blocks fault in buffers and settle the parameter queue
+        constexpr int warmupBlocks = 16;
+        const int measuredBlocks = juce::jmax(1, (int) (seconds * config.sampleRate / config.blockSize));
+        const int totalBlocks = warmupBlocks + measuredBlocks;
+
+        OfflineRenderer::Settings settings;
+        settings.sampleRate = config.sampleRate;
+        settings.blockSize = config.blockSize;
+        settings.numChannels = 2;
+
+        // Just short of a whole number of blocks, so the last one isn't partial
+        settings.lengthSeconds = ((double) totalBlocks * config.blockSize - 0.5) / config.sampleRate;
+
+        NoiseSource input;
+        OfflineRenderer renderer(engine);
+        renderer.setInputSource(&input);
+
+        TimingHistogram blockTiming;
+        int blockIndex = 0;
+        juce::uint64 measuredAllocations = 0;
+        juce::uint64 totalCycles = 0;
+        juce::uint64 lastCycles = 0;
+        juce::uint64 lastAllocations = 0;
+
+        // Blocks are timed between progress callbacks, which bracket exactly one
+        // renderNextBlock() each since nothing is being written
+        auto stats = renderer.renderToWriter(nullptr, settings, [&](double)
+        {
+            const auto nowCycles = CycleClock::now();
+            const auto nowAllocations = allocationCount.load(std::memory_order_relaxed);
+
+            if (blockIndex >= warmupBlocks)
+            {
+                blockTiming.record(nowCycles - lastCycles);
+                totalCycles += nowCycles - lastCycles;
+                measuredAllocations += nowAllocations - lastAllocations;
+            }
+
+            ++blockIndex;
+            lastAllocations = allocationCount.load(std::memory_order_relaxed);
+            lastCycles = CycleClock::now();
+            return true;
+        });
+
+        jassert(blockIndex == totalBlocks);
+
+        const auto timing = blockTiming.getSummary();
+        const auto secondsPerCycle = 1.0 / CycleClock::getCyclesPerSecond();
+        const auto measuredSamples = (double) measuredBlocks * config.blockSize;
+        const auto meanSeconds = (double) totalCycles * secondsPerCycle / measuredBlocks;
+        const auto deadlineSeconds = (double) config.blockSize / config.sampleRate;
+        const auto nsPerSample = (double) totalCycles * secondsPerCycle * 1.0e9 / measuredSamples;
+
+        auto* run = new juce::DynamicObject();
+        run->setProperty("tracks", config.numTracks);
+        run->setProperty("effectsPerTrack", config.effectsPerTrack);
+        run->setProperty("fused", config.fused);
+        run->setProperty("blockSize", config.blockSize);
+        run->setProperty("sampleRate", config.sampleRate);
+        run->setProperty("workers", engine.getNumRenderWorkers());
+        run->setProperty("blocks", measuredBlocks);
+        run->setProperty("nsPerSample", nsPerSample);
+        run->setProperty("nsPerTrackSample", config.numTracks > 0 ? nsPerSample / config.numTracks : 0.0);
+        run->setProperty("blockMeanUs", meanSeconds * 1.0e6);
+        run->setProperty("blockP50Us", timing.p50Seconds * 1.0e6);
+        run->setProperty("blockP99Us", timing.p99Seconds * 1.0e6);
+        run->setProperty("blockMaxUs", timing.maxSeconds * 1.0e6);
+        run->setProperty("deadlineUs", deadlineSeconds * 1.0e6);
+        run->setProperty("headroomPercent", 100.0 * (1.0 - timing.p99Seconds / deadlineSeconds));
+        run->setProperty("allocationsPerBlock", (double) measuredAllocations / measuredBlocks);
+        run->setProperty("realtimeFactor", stats.realtimeFactor);
+
+        if (!stats.succeeded)
+            run->setProperty("error", stats.errorMessage);
+
+        return juce::var(run);
+    }
+
+    juce::var describeMachine()
+    {
+        auto* machine = new juce::DynamicObject();
+        machine->setProperty("cpu", juce::SystemStats::getCpuModel());
+        machine->setProperty("cores", juce::SystemStats::getNumPhysicalCpus());
+        machine->setProperty("os", juce::SystemStats::getOperatingSystemName());
+        machine->setProperty("mixKernel", juce::String(MixKernels::getImplementationName()));
+        machine->setProperty("juceVersion", juce::SystemStats::getJUCEVersion());
+        return juce::var(machine);
+    }
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const juce::ArgumentList args(argc, argv);
+    const auto options = parseOptions(args);
+
+    auto result = describeMachine();
+    juce::Array<juce::var> runs;
+
+    for (auto sampleRate : options.sampleRates)
+    {
+        for (auto blockSize : options.blockSizes)
+        {
+            for (auto numTracks : options.trackCounts)
+            {
+                for (auto effectsPerTrack : options.effectCounts)
+                {
+                    RunConfig config { numTracks, effectsPerTrack, blockSize, sampleRate, options.workers, options.fused };
+
+                    std::cerr << "tracks=" << numTracks << " effects=" << effectsPerTrack
+                              << " block=" << blockSize << " rate=" << sampleRate << std::endl;
+
+                    runs.add(runBenchmark(config, options.seconds));
+                }
+            }
+        }
+    }
+
+    result.getDynamicObject()->setProperty("runs", runs);
+    const auto json = juce::JSON::toString(result);
+
+    if (options.outputFile != juce::File())
+    {
+        if (!options.outputFile.replaceWithText(json))
+        {
+            std::cerr << "Couldn't write " << options.outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include "BiquadCascade.h"
+
+BiquadCascade::Coefficients BiquadCascade::Coefficients::fromArray(const std::array<float, 6>& raw)
+{
+    const float scale = 1.0f / raw[3];
+    return { raw[0] * scale, raw[1] * scale, raw[2] * scale, raw[4] * scale, raw[5] * scale };
+}
+
+BiquadCascade::Coefficients BiquadCascade::Coefficients::interpolate(const Coefficients& start, const Coefficients& end,
+                                                                     float proportion)
+{
+    auto lerp = [proportion](float a, float b) { return a + (b - a) * proportion; };
+    return { lerp(start.b0, end.b0), lerp(start.b1, end.b1), lerp(start.b2, end.b2),
+             lerp(start.a1, end.a1), lerp(start.a2, end.a2) };
+}
+
+bool BiquadCascade::Coefficients::operator==(const Coefficients& other) const
+{
+    return b0 == other.b0 && b1 == other.b1 && b2 == other.b2 && a1 == other.a1 && a2 == other.a2;
+}
+
+void BiquadCascade::prepare(int newNumChannels, int newNumStages, int maximumBlockSize)
+{
+    numChannels = juce::jmax(1, newNumChannels);
+    numGroups = (numChannels + lanesPerVector - 1) / lanesPerVector;
+    numStages = juce::jmax(0, newNumStages);
+
+    stages.assign((size_t) (numGroups * numStages), {});
+    state.assign((size_t) (numGroups * numStages * 2), Vector::expand(0.0f));
+    interleaved.assign((size_t) juce::jmax(1, maximumBlockSize), Vector::expand(0.0f));
+
+    for (int stage = 0; stage < numStages; ++stage)
+        setCoefficients(stage, Coefficients());
+}
+
+void BiquadCascade::reset()
+{
+    std::fill(state.begin(), state.end(), Vector::expand(0.0f));
+}
+
+void BiquadCascade::setCoefficients(int stage, const Coefficients& coefficients)
+{
+    jassert(juce::isPositiveAndBelow(stage, numStages));
+
+    for (int group = 0; group < numGroups; ++group)
+    {
+        auto& target = getStage(stage, group);
+        target.b0 = Vector::expand(coefficients.b0);
+        target.b1 = Vector::expand(coefficients.b1);
+        target.b2 = Vector::expand(coefficients.b2);
+        target.a1 = Vector::expand(coefficients.a1);
+        target.a2 = Vector::expand(coefficients.a2);
+    }
+}
+
+void BiquadCascade::setCoefficients(int stage, int channel, const Coefficients& coefficients)
+{
+    jassert(juce::isPositiveAndBelow(stage, numStages) && juce::isPositiveAndBelow(channel, numChannels));
+
+    auto& target = getStage(stage, channel / lanesPerVector);
+    const auto lane = (size_t) (channel % lanesPerVector);
+    target.b0.set(lane, coefficients.b0);
+    target.b1.set(lane, coefficients.b1);
+    target.b2.set(lane, coefficients.b2);
+    target.a1.set(lane, coefficients.a1);
+    target.a2.set(lane, coefficients.a2);
+}
+
+void BiquadCascade::process(juce::AudioBuffer<float>& buffer)
+{
+    process(buffer, 0, buffer.getNumSamples());
+}
+
+void BiquadCascade::process(juce::AudioBuffer<float>& buffer, int startSample, int numSamplesToProcess)
+{
+    if (numStages == 0)
+        return;
+
+    const int channelsToProcess = juce::jmin(numChannels, buffer.getNumChannels());
+    const int sliceSize = (int) interleaved.size();
+    const int end = startSample + numSamplesToProcess;
+
+    for (int start = startSample; start < end; start += sliceSize)
+    {
+        const int numSamples = juce::jmin(sliceSize, end - start);
+
+        for (int group = 0; group * lanesPerVector < channelsToProcess; ++group)
+        {
+            float* channels[lanesPerVector] = {};
+            const int firstChannel = group * lanesPerVector;
+            const int numChannelsInGroup = juce::jmin(lanesPerVector, channelsToProcess - firstChannel);
+
+            for (int lane = 0; lane < numChannelsInGroup; ++lane)
+                channels[lane] = buffer.getWritePointer(firstChannel + lane, start);
+
+            processGroup(group, channels, numChannelsInGroup, numSamples);
+        }
+    }
+}
+
+void BiquadCascade::processGroup(int group, float* const* channels, int numChannelsInGroup, int numSamples)
+{
+    auto* lanes = reinterpret_cast<float*>(interleaved.data());
+
+    // Unused lanes stay at zero, so their filter state never leaves zero
+    if (numChannelsInGroup < lanesPerVector)
+        std::fill(lanes, lanes + numSamples * lanesPerVector, 0.0f);
+
+    for (int lane = 0; lane < numChannelsInGroup; ++lane)
+        for (int i = 0; i < numSamples; ++i)
+            lanes[i * lanesPerVector + lane] = channels[lane][i];
+
+    const Stage* groupStages = &getStage(0, group);
+    Vector* groupState = state.data() + group * numStages * 2;
+
+    // Every stage for one sample before moving on: one trip over the block,
+    // with the state in cache throughout
+    for (int i = 0; i < numSamples; ++i)
+    {
+        Vector x = interleaved[(size_t) i];
+
+        for (int stage = 0; stage < numStages; ++stage)
+        {
+            const auto& c = groupStages[stage];
+            Vector& s1 = groupState[stage * 2];
+            Vector& s2 = groupState[stage * 2 + 1];
+
+            const Vector y = c.b0 * x + s1;
+            s1 = c.b1 * x - c.a1 * y + s2;
+            s2 = c.b2 * x - c.a2 * y;
+            x = y;
+        }
+
+        interleaved[(size_t) i] = x;
+    }
+
+    for (int lane = 0; lane < numChannelsInGroup; ++lane)
+        for (int i = 0; i < numSamples; ++i)
+            channels[lane][i] = lanes[i * lanesPerVector + lane];
+}
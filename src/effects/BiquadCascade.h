@@ -0,0 +1,74 @@
+#pragma once
+#include <JuceHeader.h>
+
+// A chain of biquad filters run in a single pass over the audio, with the
+// channels side by side in SIMD registers: each lane of a register is one
+// channel, so a stereo (or quad) signal costs the same as a mono one.
+//
+// Every lane has its own coefficients, so a lane doesn't have to be a channel
+// of the same signal: several tracks with the same number of stages can share
+// one cascade, one lane each.
+class BiquadCascade
+{
+public:
+    using Vector = juce::dsp::SIMDRegister<float>;
+    static constexpr int lanesPerVector = (int) Vector::SIMDNumElements;
+
+    // Normalised so that a0 = 1
+    struct Coefficients
+    {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f;
+        float a1 = 0.0f, a2 = 0.0f;
+
+        // From JUCE's {b0, b1, b2, a0, a1, a2} layout
+        static Coefficients fromArray(const std::array<float, 6>& raw);
+
+        // A straight line between two stable filters stays stable: the
+        // region of stable (a1, a2) is a triangle, and triangles are convex
+        static Coefficients interpolate(const Coefficients& start, const Coefficients& end, float proportion);
+
+        bool operator==(const Coefficients& other) const;
+        bool operator!=(const Coefficients& other) const { return !operator==(other); }
+    };
+
+    BiquadCascade() = default;
+
+    // Allocates everything; new stages start out as pass-through
+    void prepare(int numChannels, int numStages, int maximumBlockSize);
+    void reset();
+
+    int getNumChannels() const { return numChannels; }
+    int getNumStages() const { return numStages; }
+
+    // Sets a stage for every channel, or for just one
+    void setCoefficients(int stage, const Coefficients& coefficients);
+    void setCoefficients(int stage, int channel, const Coefficients& coefficients);
+
+    // Filters the first getNumChannels() channels in place
+    void process(juce::AudioBuffer<float>& buffer);
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
+private:
+    struct Stage
+    {
+        Vector b0, b1, b2, a1, a2;
+    };
+
+    Stage& getStage(int stage, int group) { return stages[(size_t) (group * numStages + stage)]; }
+
+    void processGroup(int group, float* const* channels, int numChannelsInGroup, int numSamples);
+
+    int numChannels = 0;
+    int numGroups = 0;
+    int numStages = 0;
+
+    // Indexed [group][stage]: coefficients and the two state variables of the
+    // transposed direct form II
+    std::vector<Stage> stages;
+    std::vector<Vector> state;
+
+    // The block, interleaved so that one sample of every lane is one register
+    std::vector<Vector> interleaved;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BiquadCascade)
+};
@@ -0,0 +1,241 @@
+#include "CompressorEffect.h"
+
+CompressorEffect::CompressorEffect()
+    : Effect("Compressor", Type::Compressor)
+{
+    lookaheadLine.setInterpolation(DelayLine::Interpolation::None);
+    prepareToPlay(currentSampleRate, 512);
+}
+
+void CompressorEffect::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    currentSampleRate = sampleRate;
+    updateCoefficients();
+
+    const int maximumLookaheadSamples = (int) std::ceil(maximumLookaheadMs / 1000.0 * sampleRate);
+    lookaheadLine.prepare(2, maximumLookaheadSamples + juce::jmax(1, samplesPerBlock));
+    detectorBuffer.setSize(2, juce::jmax(1, samplesPerBlock));
+
+    reset();
+}
+
+void CompressorEffect::reset()
+{
+    lookaheadLine.reset();
+    reduction = 0.0f;
+    meanSquare = 0.0f;
+    currentGain = juce::Decibels::decibelsToGain(makeupDb);
+    gainReductionDb = 0.0f;
+}
+
+void CompressorEffect::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    process(buffer, buffer);
+}
+
+void CompressorEffect::processBlockWithSidechain(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                                                 const juce::AudioBuffer<float>& sidechain)
+{
+    jassert(sidechain.getNumSamples() >= buffer.getNumSamples());
+    process(buffer, sidechain);
+}
+
+void CompressorEffect::detect(const juce::AudioBuffer<float>& key, int start, int numSamples)
+{
+    // Every channel drives the same gain, so a loud left side also turns the
+    // right side down and the stereo image stays put
+    float* linked = detectorBuffer.getWritePointer(0);
+    float* rectified = detectorBuffer.getWritePointer(1);
+    const int numKeyChannels = key.getNumChannels();
+
+    if (detector == Detector::Peak)
+    {
+        juce::FloatVectorOperations::abs(linked, key.getReadPointer(0, start), numSamples);
+
+        for (int channel = 1; channel < numKeyChannels; ++channel)
+        {
+            juce::FloatVectorOperations::abs(rectified, key.getReadPointer(channel, start), numSamples);
+            juce::FloatVectorOperations::max(linked, linked, rectified, numSamples);
+        }
+    }
+    else
+    {
+        const float* first = key.getReadPointer(0, start);
+        juce::FloatVectorOperations::multiply(linked, first, first, numSamples);
+
+        for (int channel = 1; channel < numKeyChannels; ++channel)
+        {
+            const float* samples = key.getReadPointer(channel, start);
+            juce::FloatVectorOperations::addWithMultiply(linked, samples, samples, numSamples);
+        }
+
+        if (numKeyChannels > 1)
+            juce::FloatVectorOperations::multiply(linked, 1.0f / (float) numKeyChannels, numSamples);
+    }
+}
+
+void CompressorEffect::process(juce::AudioBuffer<float>& buffer, const juce::AudioBuffer<float>& key)
+{
+    if (key.getNumChannels() == 0)
+        return;
+
+    const int numChannels = juce::jmin(buffer.getNumChannels(), lookaheadLine.getNumChannels());
+    const int numSamples = buffer.getNumSamples();
+    const int lookahead = lookaheadSamples.load();
+    const float makeup = makeupDb;
+
+    for (int sliceStart = 0; sliceStart < numSamples;)
+    {
+        const int sliceLength = juce::jmin(numSamples - sliceStart, detectorBuffer.getNumSamples());
+        const float* linked = detectorBuffer.getReadPointer(0);
+
+        detect(key, sliceStart, sliceLength);
+
+        // The detector has already seen the samples the delayed audio has yet to reach
+        if (lookahead > 0)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                float* channelData = buffer.getWritePointer(channel, sliceStart);
+                lookaheadLine.write(channel, channelData, sliceLength);
+                lookaheadLine.read(channel, channelData, sliceLength, (float) (lookahead + sliceLength));
+            }
+        }
+
+        for (int start = 0; start < sliceLength; start += controlInterval)
+        {
+            const int length = juce::jmin(controlInterval, sliceLength - start);
+            float levelDb;
+
+            if (detector == Detector::Peak)
+            {
+                levelDb = juce::Decibels::gainToDecibels(juce::FloatVectorOperations::findMaximum(linked + start, length));
+            }
+            else
+            {
+                float sum = 0.0f;
+
+                for (int i = 0; i < length; ++i)
+                    sum += linked[start + i];
+
+                const float mean = sum / (float) length;
+                meanSquare = mean + rmsCoefficient * (meanSquare - mean);
+                levelDb = juce::Decibels::gainToDecibels(std::sqrt(meanSquare));
+            }
+
+            // Ballistics on the gain reduction itself: attack while it grows,
+            // release while it shrinks
+            const float target = computeReduction(levelDb);
+            float coefficient = target > reduction ? attackCoefficient : releaseCoefficient;
+
+            if (length != controlInterval)
+                coefficient = std::pow(coefficient, (float) length / (float) controlInterval);
+
+            reduction = target + coefficient * (reduction - target);
+
+            if (reduction < 1.0e-6f)
+                reduction = 0.0f;
+
+            // Ramp to the new gain across the interval
+            const float nextGain = juce::Decibels::decibelsToGain(makeup - reduction);
+            const float increment = (nextGain - currentGain) / (float) length;
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                float* channelData = buffer.getWritePointer(channel, sliceStart + start);
+
+                if (increment == 0.0f)
+                {
+                    juce::FloatVectorOperations::multiply(channelData, nextGain, length);
+                }
+                else
+                {
+                    for (int i = 0; i < length; ++i)
+                        channelData[i] *= currentGain + increment * (float) (i + 1);
+                }
+            }
+
+            currentGain = nextGain;
+        }
+
+        sliceStart += sliceLength;
+    }
+
+    gainReductionDb = reduction;
+}
+
+double CompressorEffect::getTailLengthSeconds() const
+{
+    // Only what is still in the lookahead delay
+    return lookaheadMs / 1000.0;
+}
+
+float CompressorEffect::computeReduction(float levelDb) const
+{
+    // Standard soft-knee gain computer; the reduction grows quadratically
+    // across the knee and linearly above it
+    const float overshoot = levelDb - thresholdDb;
+    const float slope = 1.0f - 1.0f / ratio;
+
+    if (2.0f * overshoot <= -kneeDb)
+        return 0.0f;
+
+    if (2.0f * std::abs(overshoot) < kneeDb)
+    {
+        const float intoKnee = overshoot + kneeDb * 0.5f;
+        return slope * intoKnee * intoKnee / (2.0f * kneeDb);
+    }
+
+    return slope * overshoot;
+}
+
+void CompressorEffect::updateCoefficients()
+{
+    // Per control interval rather than per sample
+    const double intervalsPerSecond = currentSampleRate / controlInterval;
+
+    attackCoefficient = (float) std::exp(-1.0 / (attackMs / 1000.0 * intervalsPerSecond));
+    releaseCoefficient = (float) std::exp(-1.0 / (releaseMs / 1000.0 * intervalsPerSecond));
+    rmsCoefficient = (float) std::exp(-1.0 / (0.01 * intervalsPerSecond));
+
+    lookaheadSamples = juce::roundToInt(lookaheadMs / 1000.0 * currentSampleRate);
+}
+
+void CompressorEffect::setThreshold(float newThresholdDb)
+{
+    thresholdDb = juce::jlimit(-60.0f, 0.0f, newThresholdDb);
+}
+
+void CompressorEffect::setRatio(float newRatio)
+{
+    ratio = juce::jlimit(1.0f, 100.0f, newRatio);
+}
+
+void CompressorEffect::setKnee(float newKneeDb)
+{
+    kneeDb = juce::jlimit(0.0f, 24.0f, newKneeDb);
+}
+
+void CompressorEffect::setAttack(float newAttackMs)
+{
+    attackMs = juce::jlimit(0.1f, 500.0f, newAttackMs);
+    updateCoefficients();
+}
+
+void CompressorEffect::setRelease(float newReleaseMs)
+{
+    releaseMs = juce::jlimit(1.0f, 5000.0f, newReleaseMs);
+    updateCoefficients();
+}
+
+void CompressorEffect::setMakeupGain(float newMakeupDb)
+{
+    makeupDb = juce::jlimit(0.0f, 24.0f, newMakeupDb);
+}
+
+void CompressorEffect::setLookahead(float newLookaheadMs)
+{
+    // Changing the latency mid-playback skips or repeats a few milliseconds
+    lookaheadMs = juce::jlimit(0.0f, maximumLookaheadMs, newLookaheadMs);
+    updateCoefficients();
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "Effect.h"
+#include "DelayLine.h"
+
+// A feed-forward compressor and limiter, cheap enough to sit on every track.
+//
+// Level detection is vectorised across the block: the channels are rectified
+// (or squared) and linked with vector operations, and the detector takes the
+// maximum over short control intervals. The gain computer and the
+// attack/release ballistics then run once per interval rather than once per
+// sample, and the gain is ramped linearly across each interval. With
+// lookahead, the audio is delayed so the gain has already come down by the
+// time a transient arrives; the delay is the effect's latency.
+class CompressorEffect : public Effect
+{
+public:
+    enum class Detector
+    {
+        Peak,
+        Rms
+    };
+
+    CompressorEffect();
+    ~CompressorEffect() override = default;
+
+    void prepareToPlay(double sampleRate, int samplesPerBlock) override;
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
+    void reset() override;
+    double getTailLengthSeconds() const override;
+
+    // Compresses buffer according to the level of sidechain instead of its
+    // own, e.g. to duck a bass under the kick. The sidechain needs at least
+    // as many samples as the buffer.
+    void processBlockWithSidechain(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                                   const juce::AudioBuffer<float>& sidechain) override;
+
+    // Compressor parameters
+    void setThreshold(float thresholdDb);
+    void setRatio(float ratio);              // 1 to 100; 100 acts as a limiter
+    void setKnee(float kneeDb);
+    void setAttack(float attackMs);
+    void setRelease(float releaseMs);
+    void setMakeupGain(float makeupDb);
+    void setLookahead(float lookaheadMs);    // up to maximumLookaheadMs
+    void setDetector(Detector newDetector) { detector = newDetector; }
+
+    float getThreshold() const { return thresholdDb; }
+    float getRatio() const { return ratio; }
+    float getKnee() const { return kneeDb; }
+    float getAttack() const { return attackMs; }
+    float getRelease() const { return releaseMs; }
+    float getMakeupGain() const { return makeupDb; }
+    float getLookahead() const { return lookaheadMs; }
+    Detector getDetector() const { return detector; }
+
+    // The lookahead, in samples
+    int getLatencySamples() const override { return lookaheadSamples.load(); }
+
+    // The most recent gain reduction, for metering from any thread
+    float getGainReduction() const { return gainReductionDb.load(); }
+
+    static constexpr float maximumLookaheadMs = 10.0f;
+
+private:
+    // The gain computer and ballistics run once per interval of this many samples
+    static constexpr int controlInterval = 16;
+
+    float thresholdDb = -18.0f;
+    float ratio = 4.0f;
+    float kneeDb = 6.0f;
+    float attackMs = 10.0f;
+    float releaseMs = 100.0f;
+    float makeupDb = 0.0f;
+    float lookaheadMs = 0.0f;
+    Detector detector = Detector::Peak;
+
+    double currentSampleRate = 44100.0;
+    std::atomic<int> lookaheadSamples { 0 };
+    std::atomic<float> gainReductionDb { 0.0f };
+
+    // Per-interval smoothing coefficients, derived from the times above
+    float attackCoefficient = 0.0f;
+    float releaseCoefficient = 0.0f;
+    float rmsCoefficient = 0.0f;
+
+    // Audio thread state
+    float reduction = 0.0f;       // dB, positive
+    float meanSquare = 0.0f;
+    float currentGain = 1.0f;
+    DelayLine lookaheadLine;
+
+    // The linked detector signal and a channel's rectified samples
+    juce::AudioBuffer<float> detectorBuffer;
+
+    void updateCoefficients();
+    float computeReduction(float levelDb) const;
+    void process(juce::AudioBuffer<float>& buffer, const juce::AudioBuffer<float>& key);
+    void detect(const juce::AudioBuffer<float>& key, int start, int numSamples);
+};
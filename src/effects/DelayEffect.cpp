@@ -1,74 +1,100 @@
 #include "DelayEffect.h"
 
 DelayEffect::DelayEffect()
-    : Effect("Delay", Type::DELAY)
+    : Effect("Delay", Type::Delay)
 {
-    delayBufferLength = static_cast<int>(std::ceil(currentSampleRate * 2.0)); // 2 seconds max delay
-    delayBuffer.setSize(2, delayBufferLength);
-    delayBuffer.clear();
+    prepareToPlay(currentSampleRate, 512);
 }
 
 void DelayEffect::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     currentSampleRate = sampleRate;
-    updateDelayParameters();
     
-    delayBufferLength = static_cast<int>(std::ceil(sampleRate * 2.0));
-    delayBuffer.setSize(2, delayBufferLength);
-    delayBuffer.clear();
+    delayLine.prepare(2, static_cast<int>(std::ceil(sampleRate * 2.0)) + 1); // 2 seconds max delay
+    scratchBuffer.setSize(3, juce::jmax(1, samplesPerBlock));
     
-    delayReadIndex = 0;
-    delayWriteIndex = 0;
+    delaySamples.reset(sampleRate, 0.05);
+    delaySamples.setCurrentAndTargetValue(getTargetDelaySamples());
 }
 
 void DelayEffect::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    if (!enabled) return;
-    
-    const int numChannels = buffer.getNumChannels();
+    const int numChannels = juce::jmin(buffer.getNumChannels(), delayLine.getNumChannels());
     const int numSamples = buffer.getNumSamples();
+    const float wetGain = wetLevel * mix;
+    
+    delaySamples.setTargetValue(getTargetDelaySamples());
     
-    for (int channel = 0; channel < numChannels; ++channel)
+    for (int sliceStart = 0; sliceStart < numSamples;)
     {
-        float* channelData = buffer.getWritePointer(channel);
-        float* delayData = delayBuffer.getWritePointer(channel);
+        const int sliceLength = juce::jmin(numSamples - sliceStart, scratchBuffer.getNumSamples());
+        float* delayed = scratchBuffer.getWritePointer(0);
+        float* feedbackInput = scratchBuffer.getWritePointer(1);
+        float* delayTimes = scratchBuffer.getWritePointer(2);
+        
+        // Every channel follows the same glide. A steady delay reads each
+        // run with a few vector multiply-adds.
+        const bool gliding = delaySamples.isSmoothing();
+        const float steadyDelay = delaySamples.getCurrentValue();
+        const float targetDelay = delaySamples.getTargetValue();
+        
+        if (gliding)
+            for (int i = 0; i < sliceLength; ++i)
+                delayTimes[i] = delaySamples.getNextValue();
         
-        for (int sample = 0; sample < numSamples; ++sample)
+        for (int channel = 0; channel < numChannels; ++channel)
         {
-            const float inputSample = channelData[sample];
+            float* channelData = buffer.getWritePointer(channel, sliceStart);
             
-            // Read from delay buffer
-            float delayedSample = delayData[delayReadIndex];
+            // Runs are short enough that everything they read has already
+            // been written, feedback included
+            for (int runStart = 0; runStart < sliceLength;)
+            {
+                const float shortestDelay = gliding ? juce::jmin(delayTimes[runStart], targetDelay) : steadyDelay;
+                const int runLength = juce::jmin(sliceLength - runStart, delayLine.getMaximumRunLength(shortestDelay));
+                
+                if (gliding)
+                    delayLine.read(channel, delayed + runStart, runLength, delayTimes + runStart);
+                else
+                    delayLine.read(channel, delayed + runStart, runLength, steadyDelay);
+                
+                juce::FloatVectorOperations::copy(feedbackInput, channelData + runStart, runLength);
+                juce::FloatVectorOperations::addWithMultiply(feedbackInput, delayed + runStart, feedback, runLength);
+                delayLine.write(channel, feedbackInput, runLength);
+                
+                runStart += runLength;
+            }
             
-            // Calculate output
-            float wet = delayedSample * wetLevel;
-            float dry = inputSample * dryLevel;
-            float output = dry + (wet * mix);
-            
-            // Write to delay buffer with feedback
-            float feedbackSample = inputSample + (delayedSample * feedback);
-            delayData[delayWriteIndex] = feedbackSample;
-            
-            channelData[sample] = output;
-            
-            // Update indices
-            delayReadIndex = (delayReadIndex + 1) % delayBufferLength;
-            delayWriteIndex = (delayWriteIndex + 1) % delayBufferLength;
+            juce::FloatVectorOperations::multiply(channelData, dryLevel, sliceLength);
+            juce::FloatVectorOperations::addWithMultiply(channelData, delayed, wetGain, sliceLength);
         }
+        
+        sliceStart += sliceLength;
     }
 }
 
 void DelayEffect::reset()
 {
-    delayBuffer.clear();
-    delayReadIndex = 0;
-    delayWriteIndex = 0;
+    delayLine.reset();
+    delaySamples.setCurrentAndTargetValue(getTargetDelaySamples());
+}
+
+double DelayEffect::getTailLengthSeconds() const
+{
+    // Each repeat is the previous one scaled by the feedback; count the
+    // repeats it takes to fall by 60dB
+    const double delaySeconds = delayTimeMs / 1000.0;
+
+    if (feedback <= 0.0f)
+        return delaySeconds;
+
+    return delaySeconds * (1.0 + std::log(0.001) / std::log((double) feedback));
 }
 
 void DelayEffect::setDelayTime(float delayTimeMs)
 {
+    // Picked up, and glided to, by the next processBlock()
     this->delayTimeMs = juce::jlimit(1.0f, 2000.0f, delayTimeMs);
-    updateDelayParameters();
 }
 
 void DelayEffect::setFeedback(float feedback)
@@ -91,12 +117,7 @@ void DelayEffect::setDryLevel(float dryLevel)
     this->dryLevel = juce::jlimit(0.0f, 1.0f, dryLevel);
 }
 
-void DelayEffect::updateDelayParameters()
+float DelayEffect::getTargetDelaySamples() const
 {
-    delaySamples = static_cast<int>(std::ceil((delayTimeMs / 1000.0) * currentSampleRate));
-    
-    if (delaySamples >= delayBufferLength)
-        delaySamples = delayBufferLength - 1;
-    
-    delayReadIndex = (delayWriteIndex - delaySamples + delayBufferLength) % delayBufferLength;
+    return (float) (delayTimeMs / 1000.0 * currentSampleRate);
 }
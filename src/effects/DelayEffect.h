@@ -1,5 +1,6 @@
 #pragma once
 #include "Effect.h"
+#include "DelayLine.h"
 
 class DelayEffect : public Effect
 {
@@ -10,6 +11,7 @@ public:
     void prepareToPlay(double sampleRate, int samplesPerBlock) override;
     void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
     void reset() override;
+    double getTailLengthSeconds() const override;
 
     // Delay parameters
     void setDelayTime(float delayTimeMs);
@@ -32,12 +34,14 @@ private:
     float dryLevel = 1.0f;
     
     double currentSampleRate = 44100.0;
-    int delaySamples = 22050;
     
-    juce::AudioBuffer<float> delayBuffer;
-    int delayBufferLength = 0;
-    int delayReadIndex = 0;
-    int delayWriteIndex = 0;
+    // One line per channel; delay time changes glide rather than jump
+    DelayLine delayLine;
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Linear> delaySamples;
     
-    void updateDelayParameters();
+    // The delayed signal, what is fed back into the line, and the per-sample
+    // delay times while the delay is gliding
+    juce::AudioBuffer<float> scratchBuffer;
+    
+    float getTargetDelaySamples() const;
 };
@@ -0,0 +1,135 @@
+#include "DelayLine.h"
+
+void DelayLine::prepare(int numChannels, int maximumDelaySamples)
+{
+    maximumDelay = juce::jmax(2, maximumDelaySamples);
+
+    // A power of two lets positions wrap with a mask; the spare samples hold
+    // the oldest interpolation taps at the maximum delay
+    const int size = juce::nextPowerOfTwo(maximumDelay + 4);
+    mask = size - 1;
+
+    buffer.setSize(juce::jmax(1, numChannels), size);
+    writePositions.assign((size_t) buffer.getNumChannels(), 0);
+    reset();
+}
+
+void DelayLine::reset()
+{
+    buffer.clear();
+    std::fill(writePositions.begin(), writePositions.end(), 0);
+}
+
+int DelayLine::getMaximumRunLength(float delaySamples) const
+{
+    return juce::jmax(1, getTaps(delaySamples).newestDelay);
+}
+
+DelayLine::Taps DelayLine::getTaps(float delaySamples) const noexcept
+{
+    const float delay = juce::jlimit(getMinimumDelay(), getMaximumDelay(), delaySamples);
+    Taps taps;
+
+    switch (interpolation)
+    {
+        case Interpolation::None:
+            taps.newestDelay = juce::roundToInt(delay);
+            taps.weights[0] = 1.0f;
+            break;
+
+        case Interpolation::Linear:
+        {
+            taps.newestDelay = (int) delay;
+            const float fraction = delay - (float) taps.newestDelay;
+            taps.numTaps = fraction > 0.0f ? 2 : 1;
+            taps.weights[0] = 1.0f - fraction;
+            taps.weights[1] = fraction;
+            break;
+        }
+
+        case Interpolation::Lagrange3:
+        {
+            // Four taps around the delay, which sits between the second and
+            // third of them where the polynomial fits best
+            taps.newestDelay = (int) delay - 1;
+            const float t = delay - (float) taps.newestDelay;
+            taps.numTaps = 4;
+            taps.weights[0] = -(t - 1.0f) * (t - 2.0f) * (t - 3.0f) / 6.0f;
+            taps.weights[1] = t * (t - 2.0f) * (t - 3.0f) * 0.5f;
+            taps.weights[2] = -t * (t - 1.0f) * (t - 3.0f) * 0.5f;
+            taps.weights[3] = t * (t - 1.0f) * (t - 2.0f) / 6.0f;
+            break;
+        }
+    }
+
+    return taps;
+}
+
+void DelayLine::copyRun(const float* channelData, float* dest, int numSamples,
+                        int position, float gain, bool addToDest) const
+{
+    while (numSamples > 0)
+    {
+        const int length = juce::jmin(numSamples, mask + 1 - position);
+
+        if (addToDest)
+            juce::FloatVectorOperations::addWithMultiply(dest, channelData + position, gain, length);
+        else if (gain == 1.0f)
+            juce::FloatVectorOperations::copy(dest, channelData + position, length);
+        else
+            juce::FloatVectorOperations::copyWithMultiply(dest, channelData + position, gain, length);
+
+        dest += length;
+        numSamples -= length;
+        position = 0;
+    }
+}
+
+void DelayLine::read(int channel, float* dest, int numSamples, float delaySamples) const
+{
+    jassert(numSamples <= getMaximumRunLength(delaySamples));
+
+    const auto taps = getTaps(delaySamples);
+    const float* channelData = buffer.getReadPointer(channel);
+    const int writePosition = writePositions[(size_t) channel];
+
+    for (int tap = 0; tap < taps.numTaps; ++tap)
+        copyRun(channelData, dest, numSamples, (writePosition - taps.newestDelay - tap) & mask,
+                taps.weights[tap], tap > 0);
+}
+
+void DelayLine::read(int channel, float* dest, int numSamples, const float* delaySamples) const
+{
+    const float* channelData = buffer.getReadPointer(channel);
+    const int writePosition = writePositions[(size_t) channel];
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const auto taps = getTaps(delaySamples[i]);
+        jassert(i < taps.newestDelay);
+
+        const int position = writePosition + i - taps.newestDelay;
+        float sample = 0.0f;
+
+        for (int tap = 0; tap < taps.numTaps; ++tap)
+            sample += channelData[(position - tap) & mask] * taps.weights[tap];
+
+        dest[i] = sample;
+    }
+}
+
+void DelayLine::write(int channel, const float* source, int numSamples)
+{
+    float* channelData = buffer.getWritePointer(channel);
+    auto& writePosition = writePositions[(size_t) channel];
+
+    while (numSamples > 0)
+    {
+        const int length = juce::jmin(numSamples, mask + 1 - writePosition);
+        juce::FloatVectorOperations::copy(channelData + writePosition, source, length);
+
+        source += length;
+        numSamples -= length;
+        writePosition = (writePosition + length) & mask;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <JuceHeader.h>
+
+// A multichannel circular delay line, the building block for delays, chorus
+// and the like. Each channel keeps its own write position.
+//
+// Reads at a fixed delay work on whole runs of samples: each interpolation
+// tap is a vector multiply-add over the contiguous stretches between wrap
+// points, with no per-sample index arithmetic. Reads with a per-sample delay
+// (modulation, or a delay time gliding to a new value) interpolate sample by
+// sample.
+//
+// A read can only cover samples that have been written, so a feedback loop
+// processes a block in runs no longer than getMaximumRunLength(): read a run,
+// write the run, repeat.
+class DelayLine
+{
+public:
+    enum class Interpolation
+    {
+        None,       // nearest sample
+        Linear,
+        Lagrange3   // third order; flatter high end, needs a delay of at least 2
+    };
+
+    DelayLine() = default;
+
+    // Allocates room for delays of up to maximumDelaySamples and clears the line
+    void prepare(int numChannels, int maximumDelaySamples);
+    void reset();
+
+    void setInterpolation(Interpolation newInterpolation) { interpolation = newInterpolation; }
+    Interpolation getInterpolation() const { return interpolation; }
+
+    int getNumChannels() const { return buffer.getNumChannels(); }
+
+    // Delays are clamped to this range
+    float getMinimumDelay() const { return interpolation == Interpolation::Lagrange3 ? 2.0f : 1.0f; }
+    float getMaximumDelay() const { return (float) maximumDelay; }
+
+    // How many samples can be read at this delay (or any longer one) before
+    // the line has to be written to
+    int getMaximumRunLength(float delaySamples) const;
+
+    // Reads numSamples delayed by delaySamples relative to the channel's write
+    // position: dest[i] = input[writePosition + i - delaySamples]
+    void read(int channel, float* dest, int numSamples, float delaySamples) const;
+
+    // As above with a separate delay for every sample
+    void read(int channel, float* dest, int numSamples, const float* delaySamples) const;
+
+    // Appends samples to the channel and moves its write position on
+    void write(int channel, const float* source, int numSamples);
+
+private:
+    struct Taps
+    {
+        int newestDelay = 1;
+        int numTaps = 1;
+        float weights[4] {};
+    };
+
+    Taps getTaps(float delaySamples) const noexcept;
+
+    // dest = (or +=) gain * the run of numSamples starting at position,
+    // split at the wrap point
+    void copyRun(const float* channelData, float* dest, int numSamples,
+                 int position, float gain, bool addToDest) const;
+
+    juce::AudioBuffer<float> buffer;
+    std::vector<int> writePositions;
+    int mask = 0;
+    int maximumDelay = 0;
+    Interpolation interpolation = Interpolation::Linear;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DelayLine)
+};
@@ -1,149 +1,261 @@
 #include "EQEffect.h"
 
-EQEffect::EQEffect()
+namespace
+{
+    // How many samples a stage's impulse response takes to fall by 100dB,
+    // which is where the EffectChain starts calling its input silent. That
+    // is set by the pole furthest from the origin.
+    double getRingingSamples(const BiquadCascade::Coefficients& coefficients)
+    {
+        const double a1 = coefficients.a1, a2 = coefficients.a2;
+        const double discriminant = a1 * a1 - 4.0 * a2;
+        double radius;
+        
+        if (discriminant < 0.0)
+            radius = std::sqrt(a2);
+        else
+            radius = (std::abs(a1) + std::sqrt(discriminant)) * 0.5;
+        
+        if (radius <= 0.0)
+            return 0.0;
+        
+        if (radius >= 1.0)
+            return std::numeric_limits<double>::infinity();
+        
+        return std::log(1.0e5) / -std::log(radius);
+    }
+}
+
+EQEffect::EQEffect(int numBands)
     : Effect("EQ", Type::EQ)
 {
-    // Initialize bands with default values
-    bands[0].frequency = 100.0f;   // Low
-    bands[1].frequency = 1000.0f;  // Mid
-    bands[2].frequency = 8000.0f;  // High
+    bands.resize((size_t) juce::jmax(1, numBands));
+    
+    // Shelves at the ends, and each peak in the middle of an equal share (in
+    // octaves) of the four octaves from 250Hz to 4kHz
+    const int numPeaks = juce::jmax(1, (int) bands.size() - 2);
+    
+    for (size_t i = 0; i < bands.size(); ++i)
+    {
+        const int peakIndex = bands.size() > 2 ? (int) i - 1 : (int) i;
+        bands[i].frequency = 1000.0f * std::pow(4.0f, (float) (2 * peakIndex + 1) / (float) numPeaks - 1.0f);
+    }
     
-    for (int i = 0; i < NUM_BANDS; ++i)
+    if (bands.size() > 1)
     {
-        bands[i].gain = 0.0f;
-        bands[i].q = 1.0f;
-        bands[i].enabled = true;
+        bands.front().shape = BandShape::LowShelf;
+        bands.front().frequency = 100.0f;
+        bands.back().shape = BandShape::HighShelf;
+        bands.back().frequency = 8000.0f;
     }
+    
+    // Every coefficient set is sized here, so publishing never allocates
+    const CoefficientSet passThrough(bands.size());
+    targetCoefficients = rampStart = rampEnd = currentCoefficients = passThrough;
+    pendingCoefficients.fill(passThrough);
+    
+    prepareToPlay(currentSampleRate, 512);
 }
 
 void EQEffect::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     currentSampleRate = sampleRate;
     
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = samplesPerBlock;
-    spec.numChannels = 2;
+    rampLength = juce::jmax(1, juce::roundToInt(sampleRate * rampSeconds));
+    filters.prepare(2, getNumBands(), samplesPerBlock);
     
-    lowBand.prepare(spec);
-    midBand.prepare(spec);
-    highBand.prepare(spec);
+    for (int i = 0; i < getNumBands(); ++i)
+        updateFilter(i);
     
-    updateFilter(0);
-    updateFilter(1);
-    updateFilter(2);
+    publishCoefficients();
+    
+    // Nothing is playing yet, so start on the new coefficients instead of
+    // fading to them
+    pendingCoefficients.acquireLatest();
+    currentCoefficients = rampEnd = pendingCoefficients.getReadSlot();
+    rampSamplesLeft = 0;
+    
+    for (int i = 0; i < getNumBands(); ++i)
+        filters.setCoefficients(i, currentCoefficients[(size_t) i]);
 }
 
 void EQEffect::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    if (!enabled) return;
+    if (pendingCoefficients.acquireLatest())
+    {
+        // Fade from wherever the filter is now, even mid-fade
+        rampStart = currentCoefficients;
+        rampEnd = pendingCoefficients.getReadSlot();
+        rampSamplesLeft = rampLength;
+    }
     
-    juce::dsp::AudioBlock<float> block(buffer);
-    juce::dsp::ProcessContextReplacing<float> context(block);
+    if (rampSamplesLeft == 0)
+    {
+        filters.process(buffer);
+        return;
+    }
     
-    if (bands[0].enabled)
-        lowBand.process(context);
-    if (bands[1].enabled)
-        midBand.process(context);
-    if (bands[2].enabled)
-        highBand.process(context);
+    for (int start = 0; start < buffer.getNumSamples(); start += rampSubBlockSize)
+    {
+        const int numSamples = juce::jmin(rampSubBlockSize, buffer.getNumSamples() - start);
+        advanceRamp(numSamples);
+        filters.process(buffer, start, numSamples);
+    }
 }
 
 void EQEffect::reset()
 {
-    lowBand.reset();
-    midBand.reset();
-    highBand.reset();
+    filters.reset();
+    advanceRamp(rampSamplesLeft);
+}
+
+void EQEffect::advanceRamp(int numSamples)
+{
+    if (rampSamplesLeft == 0)
+        return;
+    
+    rampSamplesLeft = juce::jmax(0, rampSamplesLeft - numSamples);
+    const float proportion = 1.0f - (float) rampSamplesLeft / (float) rampLength;
+    
+    for (size_t i = 0; i < currentCoefficients.size(); ++i)
+    {
+        if (rampStart[i] != rampEnd[i])
+        {
+            currentCoefficients[i] = BiquadCascade::Coefficients::interpolate(rampStart[i], rampEnd[i], proportion);
+            filters.setCoefficients((int) i, currentCoefficients[i]);
+        }
+    }
 }
 
 void EQEffect::setBandGain(int bandIndex, float gain)
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
     {
-        bands[bandIndex].gain = juce::jlimit(-24.0f, 24.0f, gain);
+        bands[(size_t) bandIndex].gain = juce::jlimit(-24.0f, 24.0f, gain);
         updateFilter(bandIndex);
+        publishCoefficients();
     }
 }
 
 void EQEffect::setBandFrequency(int bandIndex, float frequency)
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
     {
-        bands[bandIndex].frequency = juce::jlimit(20.0f, 20000.0f, frequency);
+        bands[(size_t) bandIndex].frequency = juce::jlimit(20.0f, 20000.0f, frequency);
         updateFilter(bandIndex);
+        publishCoefficients();
     }
 }
 
 void EQEffect::setBandQ(int bandIndex, float q)
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
     {
-        bands[bandIndex].q = juce::jlimit(0.1f, 10.0f, q);
+        bands[(size_t) bandIndex].q = juce::jlimit(0.1f, 10.0f, q);
         updateFilter(bandIndex);
+        publishCoefficients();
     }
 }
 
 void EQEffect::setBandEnabled(int bandIndex, bool enabled)
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
     {
-        bands[bandIndex].enabled = enabled;
+        bands[(size_t) bandIndex].enabled = enabled;
+        updateFilter(bandIndex);
+        publishCoefficients();
     }
 }
 
 float EQEffect::getBandGain(int bandIndex) const
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
-        return bands[bandIndex].gain;
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
+        return bands[(size_t) bandIndex].gain;
     return 0.0f;
 }
 
 float EQEffect::getBandFrequency(int bandIndex) const
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
-        return bands[bandIndex].frequency;
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
+        return bands[(size_t) bandIndex].frequency;
     return 1000.0f;
 }
 
 float EQEffect::getBandQ(int bandIndex) const
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
-        return bands[bandIndex].q;
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
+        return bands[(size_t) bandIndex].q;
     return 1.0f;
 }
 
+void EQEffect::setBandShape(int bandIndex, BandShape shape)
+{
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
+    {
+        bands[(size_t) bandIndex].shape = shape;
+        updateFilter(bandIndex);
+        publishCoefficients();
+    }
+}
+
 bool EQEffect::isBandEnabled(int bandIndex) const
 {
-    if (bandIndex >= 0 && bandIndex < NUM_BANDS)
-        return bands[bandIndex].enabled;
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
+        return bands[(size_t) bandIndex].enabled;
     return false;
 }
 
+EQEffect::BandShape EQEffect::getBandShape(int bandIndex) const
+{
+    if (juce::isPositiveAndBelow(bandIndex, getNumBands()))
+        return bands[(size_t) bandIndex].shape;
+    return BandShape::Peak;
+}
+
 void EQEffect::updateFilter(int bandIndex)
 {
-    if (bandIndex < 0 || bandIndex >= NUM_BANDS) return;
+    if (!juce::isPositiveAndBelow(bandIndex, getNumBands())) return;
     
-    const auto& band = bands[bandIndex];
+    const auto& band = bands[(size_t) bandIndex];
     
-    switch (bandIndex)
+    // A disabled band stays in the cascade as a pass-through stage
+    if (!band.enabled)
     {
-        case 0: // Low shelf
-        {
-            *lowBand.state = *juce::dsp::IIR::Coefficients<float>::makeLowShelf(
-                currentSampleRate, band.frequency, band.q, juce::Decibels::decibelsToGain(band.gain));
+        targetCoefficients[(size_t) bandIndex] = {};
+        return;
+    }
+    
+    using Maker = juce::dsp::IIR::ArrayCoefficients<float>;
+    const float gain = juce::Decibels::decibelsToGain(band.gain);
+    std::array<float, 6> coefficients;
+    
+    switch (band.shape)
+    {
+        case BandShape::LowShelf:
+            coefficients = Maker::makeLowShelf(currentSampleRate, band.frequency, band.q, gain);
             break;
-        }
-        case 1: // Peak
-        {
-            *midBand.state = *juce::dsp::IIR::Coefficients<float>::makePeakFilter(
-                currentSampleRate, band.frequency, band.q, juce::Decibels::decibelsToGain(band.gain));
+        case BandShape::Peak:
+            coefficients = Maker::makePeakFilter(currentSampleRate, band.frequency, band.q, gain);
             break;
-        }
-        case 2: // High shelf
-        {
-            *highBand.state = *juce::dsp::IIR::Coefficients<float>::makeHighShelf(
-                currentSampleRate, band.frequency, band.q, juce::Decibels::decibelsToGain(band.gain));
+        case BandShape::HighShelf:
+            coefficients = Maker::makeHighShelf(currentSampleRate, band.frequency, band.q, gain);
             break;
-        }
     }
+    
+    targetCoefficients[(size_t) bandIndex] = BiquadCascade::Coefficients::fromArray(coefficients);
+}
+
+void EQEffect::publishCoefficients()
+{
+    // The slots are all the same size, so this copies without allocating
+    pendingCoefficients.getWriteSlot() = targetCoefficients;
+    pendingCoefficients.publish();
+    
+    // The stages ring one after another, so their tails add up
+    double ringingSamples = 0.0;
+    
+    for (const auto& coefficients : targetCoefficients)
+        ringingSamples += getRingingSamples(coefficients);
+    
+    tailSeconds.store(ringingSamples / currentSampleRate, std::memory_order_relaxed);
 }
@@ -1,44 +1,80 @@
 #pragma once
 #include "Effect.h"
+#include "BiquadCascade.h"
+#include "../audio/TripleBuffer.h"
 
 class EQEffect : public Effect
 {
 public:
+    enum class BandShape
+    {
+        LowShelf,
+        Peak,
+        HighShelf
+    };
+
     struct EQBand
     {
+        BandShape shape = BandShape::Peak;
         float frequency = 1000.0f;
         float gain = 0.0f;
         float q = 1.0f;
         bool enabled = true;
     };
 
-    EQEffect();
+    // The first band is a low shelf and the last a high shelf, with peaking
+    // bands spread in between
+    explicit EQEffect(int numBands = 3);
     ~EQEffect() override = default;
 
     void prepareToPlay(double sampleRate, int samplesPerBlock) override;
     void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
     void reset() override;
 
+    // How long the most resonant band rings for, down to silence
+    double getTailLengthSeconds() const override { return tailSeconds.load(std::memory_order_relaxed); }
+
     // EQ parameters
     void setBandGain(int bandIndex, float gain);
     void setBandFrequency(int bandIndex, float frequency);
     void setBandQ(int bandIndex, float q);
     void setBandEnabled(int bandIndex, bool enabled);
+    void setBandShape(int bandIndex, BandShape shape);
+
+    int getNumBands() const { return (int) bands.size(); }
 
     float getBandGain(int bandIndex) const;
     float getBandFrequency(int bandIndex) const;
     float getBandQ(int bandIndex) const;
     bool isBandEnabled(int bandIndex) const;
+    BandShape getBandShape(int bandIndex) const;
 
 private:
-    static constexpr int NUM_BANDS = 3;
-    EQBand bands[NUM_BANDS];
+    using CoefficientSet = std::vector<BiquadCascade::Coefficients>;
+    
+    // Band settings and the coefficients they make live on the message
+    // thread; every change publishes the whole set to the audio thread
+    std::vector<EQBand> bands;
+    CoefficientSet targetCoefficients;
+    TripleBuffer<CoefficientSet> pendingCoefficients;
     
-    juce::dsp::IIR::Filter<float> lowBand;
-    juce::dsp::IIR::Filter<float> midBand;
-    juce::dsp::IIR::Filter<float> highBand;
+    // Audio thread: one stage per band, every channel in one pass. A new set
+    // of coefficients is faded in over a few milliseconds, a sub-block at a
+    // time, so moving a band doesn't click.
+    BiquadCascade filters;
+    CoefficientSet rampStart, rampEnd, currentCoefficients;
+    int rampLength = 1;
+    int rampSamplesLeft = 0;
+    
+    static constexpr double rampSeconds = 0.02;
+    static constexpr int rampSubBlockSize = 32;
     
     double currentSampleRate = 44100.0;
     
+    // Worked out from the published coefficients, read by the audio thread
+    std::atomic<double> tailSeconds { 0.0 };
+    
     void updateFilter(int bandIndex);
+    void publishCoefficients();
+    void advanceRamp(int numSamples);
 };
@@ -1,12 +1,45 @@
 #include "Effect.h"
+#include "../audio/MixKernels.h"
+
+namespace
+{
+    bool isSilent(const juce::AudioBuffer<float>& buffer)
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+        {
+            if (buffer.getMagnitude(channel, 0, buffer.getNumSamples()) > MixKernels::silenceThreshold)
+                return false;
+        }
+        return true;
+    }
+}
 
 Effect::Effect(const juce::String& effectName, Type effectType)
     : name(effectName), type(effectType)
 {
 }
 
+Effect::ActivityStats Effect::getActivityStats() const
+{
+    ActivityStats stats;
+    stats.blocksProcessed = blocksProcessed.load(std::memory_order_relaxed);
+    stats.blocksAsleep = blocksAsleep.load(std::memory_order_relaxed);
+    stats.blocksBypassed = blocksBypassed.load(std::memory_order_relaxed);
+    stats.wakeUps = wakeUps.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Effect::resetActivityStats()
+{
+    blocksProcessed = 0;
+    blocksAsleep = 0;
+    blocksBypassed = 0;
+    wakeUps = 0;
+}
+
 EffectChain::EffectChain()
 {
+    publishOrder();
 }
 
 EffectChain::~EffectChain()
@@ -16,69 +49,278 @@ EffectChain::~EffectChain()
 
 void EffectChain::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    const juce::ScopedLock sl(lock);
+    preparedSampleRate = sampleRate;
+    preparedBlockSize = samplesPerBlock;
+    dryBuffer.setSize(2, juce::jmax(1, samplesPerBlock));
+    bypassFadeSamples = juce::jmax(1, juce::roundToInt(sampleRate * bypassFadeSeconds));
+
     for (auto& effect : effects)
     {
         effect->prepareToPlay(sampleRate, samplesPerBlock);
     }
 }
 
-void EffectChain::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void EffectChain::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                               const juce::AudioBuffer<float>* sidechain)
 {
     if (!enabled) return;
 
-    for (auto& effect : effects)
+    const RealtimeSnapshot<Order>::ReadScope scope(order);
+    const int numSamples = buffer.getNumSamples();
+    const float fadeStep = (float) numSamples / (float) bypassFadeSamples;
+
+    // Only measured when an effect needs to know, and only again once an
+    // effect has processed the buffer
+    enum { unknown, silent, notSilent } inputState = unknown;
+
+    for (auto* effect : scope->effects)
     {
-        if (effect->isEnabled())
+        const float startFade = effect->bypassFade;
+        const float targetFade = effect->enabled.load(std::memory_order_relaxed) ? 1.0f : 0.0f;
+
+        // Fully bypassed: no virtual call, no work
+        if (startFade == 0.0f && targetFade == 0.0f)
+        {
+            effect->blocksBypassed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        const bool fading = startFade != targetFade;
+
+        // Whatever it held when it was bypassed is stale by now. Clearing
+        // it here rather than as the fade out finished keeps the cost off
+        // effects that stay bypassed.
+        if (effect->resetPending)
+        {
+            effect->reset();
+            effect->resetPending = false;
+        }
+
+        if (!fading)
+        {
+            if (inputState == unknown)
+                inputState = isSilent(buffer) ? silent : notSilent;
+
+            if (shouldSleep(*effect, inputState == silent, numSamples))
+                continue;
+        }
+
+        const bool canCrossfade = fading && numSamples <= dryBuffer.getNumSamples();
+
+        if (canCrossfade)
+            for (int channel = 0; channel < juce::jmin(buffer.getNumChannels(), dryBuffer.getNumChannels()); ++channel)
+                dryBuffer.copyFrom(channel, 0, buffer, channel, 0, numSamples);
+
         {
-            effect->processBlock(buffer, midiMessages);
+            const TimingHistogram::ScopedTimer timer(effect->getProcessTiming());
+
+            if (sidechain != nullptr)
+                effect->processBlockWithSidechain(buffer, midiMessages, *sidechain);
+            else
+                effect->processBlock(buffer, midiMessages);
+        }
+
+        effect->blocksProcessed.fetch_add(1, std::memory_order_relaxed);
+        inputState = unknown;
+
+        if (fading)
+        {
+            const float endFade = targetFade > startFade ? juce::jmin(targetFade, startFade + fadeStep)
+                                                         : juce::jmax(targetFade, startFade - fadeStep);
+
+            if (canCrossfade)
+                crossfade(buffer, startFade, endFade);
+
+            effect->bypassFade = endFade;
+            effect->resetPending = endFade == 0.0f;
         }
     }
 }
 
-void EffectChain::reset()
+bool EffectChain::shouldSleep(Effect& effect, bool inputIsSilent, int numSamples) const
+{
+    if (!inputIsSilent)
+    {
+        effect.silentSamples = 0;
+
+        if (effect.sleeping.exchange(false, std::memory_order_relaxed))
+            effect.wakeUps.fetch_add(1, std::memory_order_relaxed);
+
+        return false;
+    }
+
+    effect.silentSamples += numSamples;
+    const double tailSeconds = effect.getTailLengthSeconds();
+
+    // Like a Track: the samples before this block are what the tail had to
+    // ring out over
+    const bool asleep = std::isfinite(tailSeconds)
+                     && (double) (effect.silentSamples - numSamples) >= tailSeconds * preparedSampleRate;
+
+    effect.sleeping.store(asleep, std::memory_order_relaxed);
+
+    if (asleep)
+        effect.blocksAsleep.fetch_add(1, std::memory_order_relaxed);
+
+    return asleep;
+}
+
+void EffectChain::crossfade(juce::AudioBuffer<float>& processed, float startFade, float endFade) const
+{
+    const int numSamples = processed.getNumSamples();
+    const float increment = (endFade - startFade) / (float) numSamples;
+
+    // processed = dry + (processed - dry) * fade
+    for (int channel = 0; channel < juce::jmin(processed.getNumChannels(), dryBuffer.getNumChannels()); ++channel)
+    {
+        float* wet = processed.getWritePointer(channel);
+        const float* dry = dryBuffer.getReadPointer(channel);
+
+        for (int i = 0; i < numSamples; ++i)
+            wet[i] = dry[i] + (wet[i] - dry[i]) * (startFade + increment * (float) (i + 1));
+    }
+}
+
+double EffectChain::getTailLengthSeconds() const
+{
+    double tail = 0.0;
+
+    if (enabled)
+    {
+        const RealtimeSnapshot<Order>::ReadScope scope(order);
+
+        // Counting effects still fading out
+        for (auto* effect : scope->effects)
+        {
+            if (effect->isEnabled() || effect->bypassFade > 0.0f)
+                tail += effect->getTailLengthSeconds();
+        }
+    }
+    return tail;
+}
+
+int EffectChain::getLatencySamples() const
 {
+    const juce::ScopedLock sl(lock);
+    int latency = 0;
+
+    if (enabled)
+    {
+        for (auto& effect : effects)
+        {
+            if (effect->isEnabled())
+                latency += effect->getLatencySamples();
+        }
+    }
+    return latency;
+}
+
+Effect::ActivityStats EffectChain::getActivityStats() const
+{
+    const juce::ScopedLock sl(lock);
+    Effect::ActivityStats total;
+
     for (auto& effect : effects)
+    {
+        const auto stats = effect->getActivityStats();
+        total.blocksProcessed += stats.blocksProcessed;
+        total.blocksAsleep += stats.blocksAsleep;
+        total.blocksBypassed += stats.blocksBypassed;
+        total.wakeUps += stats.wakeUps;
+    }
+    return total;
+}
+
+void EffectChain::reset()
+{
+    const RealtimeSnapshot<Order>::ReadScope scope(order);
+
+    for (auto* effect : scope->effects)
     {
         effect->reset();
     }
 }
 
+void EffectChain::publishOrder(std::unique_ptr<Effect> removedEffect)
+{
+    auto next = std::make_unique<Order>();
+
+    for (auto& effect : effects)
+        next->effects.push_back(effect.get());
+
+    // The removed effect may still be mid-block; it goes when the order that
+    // included it does
+    order.publish(std::move(next), std::move(removedEffect));
+}
+
 void EffectChain::addEffect(std::unique_ptr<Effect> effect)
 {
-    effects.push_back(std::move(effect));
+    {
+        const juce::ScopedLock sl(lock);
+
+        // Ready to run before the audio thread can see it, and starting out
+        // bypassed or not without a fade
+        if (preparedSampleRate > 0.0)
+            effect->prepareToPlay(preparedSampleRate, preparedBlockSize);
+
+        effect->bypassFade = effect->isEnabled() ? 1.0f : 0.0f;
+
+        effects.push_back(std::move(effect));
+        publishOrder();
+    }
     sendChangeMessage();
 }
 
 void EffectChain::removeEffect(int index)
 {
-    if (index >= 0 && index < effects.size())
     {
+        const juce::ScopedLock sl(lock);
+
+        if (!juce::isPositiveAndBelow(index, (int) effects.size()))
+            return;
+
+        auto removed = std::move(effects[(size_t) index]);
         effects.erase(effects.begin() + index);
-        sendChangeMessage();
+        publishOrder(std::move(removed));
     }
+    sendChangeMessage();
 }
 
 void EffectChain::moveEffect(int fromIndex, int toIndex)
 {
-    if (fromIndex >= 0 && fromIndex < effects.size() &&
-        toIndex >= 0 && toIndex < effects.size())
     {
-        auto effect = std::move(effects[fromIndex]);
+        const juce::ScopedLock sl(lock);
+
+        if (!juce::isPositiveAndBelow(fromIndex, (int) effects.size())
+            || !juce::isPositiveAndBelow(toIndex, (int) effects.size()))
+            return;
+
+        auto effect = std::move(effects[(size_t) fromIndex]);
         effects.erase(effects.begin() + fromIndex);
         effects.insert(effects.begin() + toIndex, std::move(effect));
-        sendChangeMessage();
+        publishOrder();
     }
+    sendChangeMessage();
 }
 
 Effect* EffectChain::getEffect(int index) const
 {
-    if (index >= 0 && index < effects.size())
+    const juce::ScopedLock sl(lock);
+
+    if (juce::isPositiveAndBelow(index, (int) effects.size()))
     {
-        return effects[index].get();
+        return effects[(size_t) index].get();
     }
     return nullptr;
 }
 
+int EffectChain::getNumEffects() const
+{
+    const juce::ScopedLock sl(lock);
+    return (int) effects.size();
+}
+
 void EffectChain::setEnabled(bool shouldEnable)
 {
     enabled = shouldEnable;
@@ -1,5 +1,7 @@
 #pragma once
 #include <JuceHeader.h>
+#include "../audio/TimingHistogram.h"
+#include "../audio/RealtimeSnapshot.h"
 
 class Effect : public juce::ChangeBroadcaster
 {
@@ -20,22 +22,81 @@ public:
     virtual void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) = 0;
     virtual void reset() = 0;
 
+    // Called instead of processBlock() when the track has a sidechain input,
+    // for effects keyed by another signal. The rest just process the buffer.
+    virtual void processBlockWithSidechain(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                                           const juce::AudioBuffer<float>& sidechain)
+    {
+        juce::ignoreUnused(sidechain);
+        processBlock(buffer, midiMessages);
+    }
+
     virtual juce::String getName() const { return name; }
     virtual Type getType() const { return type; }
 
+    // Disabled effects are bypassed by the EffectChain, which crossfades
+    // between the processed and the dry signal rather than cutting over
     virtual bool isEnabled() const { return enabled; }
     virtual void setEnabled(bool shouldEnable) { enabled = shouldEnable; sendChangeMessage(); }
 
     virtual float getWetDryMix() const { return wetDryMix; }
     virtual void setWetDryMix(float mix) { wetDryMix = juce::jlimit(0.0f, 1.0f, mix); }
 
+    // How long the effect keeps producing output after its input goes silent.
+    // Tracks sleep once a silent input has outlasted the tail; return
+    // infinity for effects that never decay.
+    virtual double getTailLengthSeconds() const { return 0.0; }
+
+    // How many samples the output lags the input, e.g. for lookahead. The
+    // engine delays the other signal paths to match.
+    virtual int getLatencySamples() const { return 0; }
+
+    // Time spent in processBlock(), recorded by the EffectChain
+    TimingHistogram& getProcessTiming() { return processTiming; }
+
+    // What the EffectChain did with the effect, block by block. An effect
+    // sleeps, i.e. isn't processed at all, once its input has been silent
+    // for longer than its tail, and wakes as soon as the input isn't.
+    struct ActivityStats
+    {
+        juce::uint64 blocksProcessed = 0;
+        juce::uint64 blocksAsleep = 0;
+        juce::uint64 blocksBypassed = 0;
+        juce::uint64 wakeUps = 0;
+    };
+
+    ActivityStats getActivityStats() const;
+    void resetActivityStats();
+    bool isSleeping() const { return sleeping.load(std::memory_order_relaxed); }
+
 protected:
     juce::String name;
     Type type;
-    bool enabled = true;
+    std::atomic<bool> enabled { true };
     float wetDryMix = 1.0f; // 0 = dry, 1 = wet
+
+private:
+    friend class EffectChain;
+
+    TimingHistogram processTiming;
+
+    // The EffectChain's bookkeeping, touched only by the audio thread
+    float bypassFade = 1.0f;    // 0 = bypassed, 1 = processed
+    bool resetPending = false;  // cleared when next enabled, not when bypassed
+    juce::int64 silentSamples = 0;
+    std::atomic<bool> sleeping { false };
+
+    std::atomic<juce::uint64> blocksProcessed { 0 }, blocksAsleep { 0 }, blocksBypassed { 0 }, wakeUps { 0 };
 };
 
+// Effects processed in series.
+//
+// The chain's order is edited on the message thread and published to the
+// audio thread as an immutable snapshot, swapped in with one atomic pointer
+// exchange, so effects can be inserted, removed and reordered during
+// playback without the audio thread ever blocking. New effects are prepared
+// before they are published, and removed ones are deleted by the shared
+// DeferredReleasePool once the audio thread has stopped using them.
 class EffectChain : public juce::ChangeBroadcaster
 {
 public:
@@ -43,20 +104,59 @@ public:
     ~EffectChain() override;
 
     void prepareToPlay(double sampleRate, int samplesPerBlock);
-    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+
+    // Audio thread. The sidechain, if there is one, is handed to every effect.
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                      const juce::AudioBuffer<float>* sidechain = nullptr);
     void reset();
 
+    // Message thread
     void addEffect(std::unique_ptr<Effect> effect);
     void removeEffect(int index);
     void moveEffect(int fromIndex, int toIndex);
     
     Effect* getEffect(int index) const;
-    int getNumEffects() const { return effects.size(); }
+    int getNumEffects() const;
 
     void setEnabled(bool shouldEnable);
     bool isEnabled() const { return enabled; }
 
+    // The enabled effects run in series, so their tails add up. Called from
+    // the audio thread.
+    double getTailLengthSeconds() const;
+
+    // Message thread: the enabled effects' latencies, which add up too
+    int getLatencySamples() const;
+
+    // Message thread: the effects' activity, added up
+    Effect::ActivityStats getActivityStats() const;
+
+    // How long bypassing or re-enabling an effect takes to fade over
+    static constexpr double bypassFadeSeconds = 0.01;
+
 private:
+    // What the audio thread iterates; the effects are owned by the chain
+    struct Order
+    {
+        std::vector<Effect*> effects;
+    };
+
+    void publishOrder(std::unique_ptr<Effect> removedEffect = nullptr);
+
+    // Audio thread: whether the effect can sleep through this block
+    bool shouldSleep(Effect& effect, bool inputIsSilent, int numSamples) const;
+    void crossfade(juce::AudioBuffer<float>& processed, float startFade, float endFade) const;
+
+    // Message thread state, also touched by prepareToPlay()
+    juce::CriticalSection lock;
     std::vector<std::unique_ptr<Effect>> effects;
-    bool enabled = true;
+    double preparedSampleRate = 0.0;
+    int preparedBlockSize = 0;
+
+    // Audio thread: the input to an effect that is fading in or out
+    juce::AudioBuffer<float> dryBuffer;
+    int bypassFadeSamples = 1;
+
+    mutable RealtimeSnapshot<Order> order;
+    std::atomic<bool> enabled { true };
 };
@@ -0,0 +1,239 @@
+#include "FdnReverb.h"
+#include "../audio/MixKernels.h"
+
+namespace
+{
+    // Spread between 23 and 56ms and far from any common multiple, so the
+    // lines' echoes don't line up
+    constexpr std::array<double, FdnReverb::numLines> lineMilliseconds { 23.1, 27.7, 31.3, 36.7, 41.3, 45.1, 49.9, 55.7 };
+
+    // Short enough for the feedback to follow parameter ramps closely
+    constexpr int maximumRun = 128;
+    constexpr double rampSeconds = 0.05;
+
+    // Level matching with juce::Reverb
+    constexpr float dryScale = 2.0f;
+    constexpr float wetScale = 1.0f;
+    constexpr float inputGain = 0.5f;
+
+    // The Hadamard matrix is orthogonal once scaled by 1/sqrt(8)
+    const float hadamardScale = 1.0f / std::sqrt((float) FdnReverb::numLines);
+}
+
+bool FdnReverb::Parameters::operator==(const Parameters& other) const
+{
+    return roomSize == other.roomSize && damping == other.damping && wetLevel == other.wetLevel
+        && dryLevel == other.dryLevel && width == other.width;
+}
+
+FdnReverb::FdnReverb()
+{
+    prepare(currentSampleRate, 512);
+}
+
+double FdnReverb::getDecaySeconds(float roomSize)
+{
+    // From 0.2 to 8 seconds
+    return 0.2 * std::pow(40.0, (double) juce::jlimit(0.0f, 1.0f, roomSize));
+}
+
+void FdnReverb::prepare(double sampleRate, int maximumBlockSize)
+{
+    juce::ignoreUnused(maximumBlockSize);
+    currentSampleRate = sampleRate;
+
+    for (size_t line = 0; line < lineLengths.size(); ++line)
+        lineLengths[line] = juce::jmax(2, juce::roundToInt(lineMilliseconds[line] * sampleRate / 1000.0));
+
+    const int longest = *std::max_element(lineLengths.begin(), lineLengths.end());
+    const int shortest = *std::min_element(lineLengths.begin(), lineLengths.end());
+
+    mask = juce::nextPowerOfTwo(longest + 1) - 1;
+    maximumRunLength = juce::jmin(maximumRun, shortest);
+
+    lines.setSize(numLines, mask + 1);
+    runBuffer.setSize(numLines, maximumRunLength);
+    wetBuffer.setSize(2, maximumRunLength);
+
+    for (auto* smoother : { &smoothedRoomSize, &smoothedDamping, &smoothedDry, &smoothedWet1, &smoothedWet2 })
+        smoother->reset(sampleRate, rampSeconds);
+
+    smoothedRoomSize.setCurrentAndTargetValue(parameters.roomSize);
+    smoothedDamping.setCurrentAndTargetValue(parameters.damping);
+    smoothedDry.setCurrentAndTargetValue(parameters.dryLevel * dryScale);
+    smoothedWet1.setCurrentAndTargetValue(parameters.wetLevel * wetScale * (parameters.width * 0.5f + 0.5f));
+    smoothedWet2.setCurrentAndTargetValue(parameters.wetLevel * wetScale * (1.0f - parameters.width) * 0.5f);
+
+    updateFeedback(parameters.roomSize, parameters.damping);
+    reset();
+}
+
+void FdnReverb::reset()
+{
+    lines.clear();
+    dampingStates.fill(0.0f);
+    writePosition = 0;
+}
+
+void FdnReverb::setParameters(const Parameters& newParameters)
+{
+    if (newParameters == parameters)
+        return;
+
+    parameters = newParameters;
+    smoothedRoomSize.setTargetValue(parameters.roomSize);
+    smoothedDamping.setTargetValue(parameters.damping);
+    smoothedDry.setTargetValue(parameters.dryLevel * dryScale);
+    smoothedWet1.setTargetValue(parameters.wetLevel * wetScale * (parameters.width * 0.5f + 0.5f));
+    smoothedWet2.setTargetValue(parameters.wetLevel * wetScale * (1.0f - parameters.width) * 0.5f);
+}
+
+void FdnReverb::updateFeedback(float roomSize, float damping)
+{
+    const double decaySeconds = getDecaySeconds(roomSize);
+    dampingCoefficient = juce::jlimit(0.0f, 1.0f, damping) * 0.6f;
+
+    // Each line loses 60dB per decay time; the damping filter's own gain and
+    // the Hadamard scaling are folded into its input coefficient
+    for (size_t line = 0; line < lineLengths.size(); ++line)
+    {
+        const double gain = std::pow(10.0, -3.0 * lineLengths[line] / (decaySeconds * currentSampleRate));
+        inputCoefficients[line] = (float) gain * (1.0f - dampingCoefficient) * hadamardScale;
+    }
+}
+
+void FdnReverb::readLine(int line, float* dest, int numSamples) const
+{
+    const float* data = lines.getReadPointer(line);
+    int position = (writePosition - lineLengths[(size_t) line]) & mask;
+
+    while (numSamples > 0)
+    {
+        const int length = juce::jmin(numSamples, mask + 1 - position);
+        juce::FloatVectorOperations::copy(dest, data + position, length);
+        dest += length;
+        numSamples -= length;
+        position = 0;
+    }
+}
+
+void FdnReverb::writeLine(int line, const float* source, int numSamples)
+{
+    float* data = lines.getWritePointer(line);
+    int position = writePosition;
+
+    while (numSamples > 0)
+    {
+        const int length = juce::jmin(numSamples, mask + 1 - position);
+        juce::FloatVectorOperations::copy(data + position, source, length);
+        source += length;
+        numSamples -= length;
+        position = 0;
+    }
+}
+
+void FdnReverb::processStereo(float* left, float* right, int numSamples)
+{
+    process(left, right, numSamples);
+}
+
+void FdnReverb::processMono(float* samples, int numSamples)
+{
+    process(samples, nullptr, numSamples);
+}
+
+void FdnReverb::process(float* left, float* right, int numSamples)
+{
+    for (int start = 0; start < numSamples; start += maximumRunLength)
+    {
+        const int run = juce::jmin(maximumRunLength, numSamples - start);
+        float* inputs[] = { left + start, right != nullptr ? right + start : left + start };
+        float* wet[] = { wetBuffer.getWritePointer(0), wetBuffer.getWritePointer(1) };
+
+        if (smoothedRoomSize.isSmoothing() || smoothedDamping.isSmoothing())
+            updateFeedback(smoothedRoomSize.skip(run), smoothedDamping.skip(run));
+
+        for (int line = 0; line < numLines; ++line)
+            readLine(line, runBuffer.getWritePointer(line), run);
+
+        // The even lines make the left output, the odd ones the right
+        for (int side = 0; side < 2; ++side)
+        {
+            juce::FloatVectorOperations::copy(wet[side], runBuffer.getReadPointer(side), run);
+
+            for (int line = side + 2; line < numLines; line += 2)
+                juce::FloatVectorOperations::add(wet[side], runBuffer.getReadPointer(line), run);
+        }
+
+        // Decay and damping: the one recursive step
+        for (int line = 0; line < numLines; ++line)
+        {
+            float* data = runBuffer.getWritePointer(line);
+            const float a = inputCoefficients[(size_t) line];
+            const float b = dampingCoefficient;
+            float state = dampingStates[(size_t) line];
+
+            for (int i = 0; i < run; ++i)
+                data[i] = state = a * data[i] + b * state;
+
+            dampingStates[(size_t) line] = state;
+        }
+
+        // Mix every line into every other with a fast Walsh-Hadamard
+        // transform, one butterfly per pair of whole runs
+        for (int half = 1; half < numLines; half *= 2)
+        {
+            for (int first = 0; first < numLines; first += half * 2)
+            {
+                for (int line = first; line < first + half; ++line)
+                {
+                    float* a = runBuffer.getWritePointer(line);
+                    float* b = runBuffer.getWritePointer(line + half);
+
+                    // a, b = a + b, a - b
+                    juce::FloatVectorOperations::add(a, b, run);
+                    juce::FloatVectorOperations::multiply(b, -2.0f, run);
+                    juce::FloatVectorOperations::add(b, a, run);
+                }
+            }
+        }
+
+        for (int line = 0; line < numLines; ++line)
+        {
+            float* data = runBuffer.getWritePointer(line);
+            juce::FloatVectorOperations::addWithMultiply(data, inputs[line % 2], inputGain, run);
+            writeLine(line, data, run);
+        }
+
+        writePosition = (writePosition + run) & mask;
+
+        // Output gains ramp sample by sample while they're moving
+        const int numOutputs = right != nullptr ? 2 : 1;
+        const float dryStart = smoothedDry.getCurrentValue();
+        const float dryEnd = smoothedDry.skip(run);
+        const float wet1Start = smoothedWet1.getCurrentValue();
+        const float wet1Increment = (smoothedWet1.skip(run) - wet1Start) / (float) run;
+        const float wet2Start = smoothedWet2.getCurrentValue();
+        const float wet2Increment = (smoothedWet2.skip(run) - wet2Start) / (float) run;
+
+        for (int side = 0; side < numOutputs; ++side)
+        {
+            float* output = inputs[side];
+
+            if (dryStart == dryEnd)
+            {
+                juce::FloatVectorOperations::multiply(output, dryEnd, run);
+            }
+            else
+            {
+                const float dryIncrement = (dryEnd - dryStart) / (float) run;
+
+                for (int i = 0; i < run; ++i)
+                    output[i] *= dryStart + dryIncrement * (float) i;
+            }
+
+            MixKernels::addWithGainRamp(output, wet[side], run, wet1Start, wet1Increment);
+            MixKernels::addWithGainRamp(output, wet[1 - side], run, wet2Start, wet2Increment);
+        }
+    }
+}
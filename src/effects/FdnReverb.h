@@ -0,0 +1,78 @@
+#pragma once
+#include <JuceHeader.h>
+
+// An eight-line feedback delay network reverb.
+//
+// Every line is longer than the runs the reverb works in, so nothing read in
+// a run depends on anything written in it: each run reads all eight lines,
+// filters them, mixes them through a Hadamard matrix and writes them back,
+// with every step a vector operation over the run rather than a loop over
+// samples. Only the per-line damping filter is recursive.
+//
+// Derived coefficients are only recomputed when a parameter changes, and
+// changes glide in over a short ramp instead of jumping.
+class FdnReverb
+{
+public:
+    // Same controls, and ranges, as juce::Reverb
+    struct Parameters
+    {
+        float roomSize = 0.5f;
+        float damping = 0.5f;
+        float wetLevel = 0.33f;
+        float dryLevel = 0.4f;
+        float width = 1.0f;
+
+        bool operator==(const Parameters& other) const;
+        bool operator!=(const Parameters& other) const { return !operator==(other); }
+    };
+
+    static constexpr int numLines = 8;
+
+    FdnReverb();
+
+    void prepare(double sampleRate, int maximumBlockSize);
+    void reset();
+
+    // Cheap when nothing has changed, so it can be called every block
+    void setParameters(const Parameters& newParameters);
+    const Parameters& getParameters() const { return parameters; }
+
+    void processStereo(float* left, float* right, int numSamples);
+    void processMono(float* samples, int numSamples);
+
+    // Time for the tail to fall by 60dB at a given room size
+    static double getDecaySeconds(float roomSize);
+
+private:
+    void process(float* left, float* right, int numSamples);
+    void updateFeedback(float roomSize, float damping);
+    void readLine(int line, float* dest, int numSamples) const;
+    void writeLine(int line, const float* source, int numSamples);
+
+    Parameters parameters;
+    double currentSampleRate = 44100.0;
+
+    // The lines share one write position and one power-of-two length
+    juce::AudioBuffer<float> lines;
+    std::array<int, numLines> lineLengths {};
+    int writePosition = 0;
+    int mask = 0;
+    int maximumRunLength = 1;
+
+    // Per line: feedback gain folded into a one-pole damping lowpass
+    std::array<float, numLines> inputCoefficients {};
+    std::array<float, numLines> dampingStates {};
+    float dampingCoefficient = 0.0f;
+
+    // Parameter ramps. The feedback coefficients follow roomSize and damping
+    // a run at a time; the output gains ramp sample by sample.
+    juce::SmoothedValue<float> smoothedRoomSize, smoothedDamping;
+    juce::SmoothedValue<float> smoothedDry, smoothedWet1, smoothedWet2;
+
+    // One run of every line, plus the wet output
+    juce::AudioBuffer<float> runBuffer;
+    juce::AudioBuffer<float> wetBuffer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FdnReverb)
+};
@@ -0,0 +1,96 @@
+#include "ImpulseResponseCache.h"
+
+ImpulseResponseCache::ImpulseResponseCache()
+{
+    formatManager.registerBasicFormats();
+}
+
+ImpulseResponse::Ptr ImpulseResponseCache::getImpulseResponse(const juce::File& file, double sampleRate, int partitionSize)
+{
+    // An edited file gets a new key, so it is loaded afresh
+    const auto key = file.getFullPathName()
+                   + "|" + juce::String(file.getLastModificationTime().toMilliseconds())
+                   + "|" + juce::String(sampleRate)
+                   + "|" + juce::String(partitionSize);
+
+    const juce::ScopedLock sl(lock);
+    purgeUnused();
+
+    for (const auto& entry : entries)
+        if (entry.key == key)
+            return entry.response;
+
+    juce::AudioBuffer<float> samples;
+
+    if (!readFile(file, sampleRate, samples))
+        return nullptr;
+
+    ImpulseResponse::Ptr response = new ImpulseResponse(samples, partitionSize);
+    entries.push_back({ key, response });
+    return response;
+}
+
+int ImpulseResponseCache::getNumCached() const
+{
+    const juce::ScopedLock sl(lock);
+    return (int) entries.size();
+}
+
+void ImpulseResponseCache::purgeUnused()
+{
+    const juce::ScopedLock sl(lock);
+
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [](const Entry& entry) { return entry.response->getReferenceCount() == 1; }),
+                  entries.end());
+}
+
+bool ImpulseResponseCache::readFile(const juce::File& file, double sampleRate, juce::AudioBuffer<float>& samples)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+        return false;
+
+    const int numChannels = juce::jlimit(1, 2, (int) reader->numChannels);
+    const int fileLength = (int) juce::jmin(reader->lengthInSamples,
+                                            (juce::int64) (maximumLengthSeconds * reader->sampleRate));
+
+    juce::AudioBuffer<float> fileSamples(numChannels, fileLength);
+    reader->read(&fileSamples, 0, fileLength, 0, true, numChannels > 1);
+
+    const double speedRatio = reader->sampleRate / sampleRate;
+    const int length = juce::jmax(1, (int) std::ceil(fileLength / speedRatio));
+    samples.setSize(numChannels, length);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        if (speedRatio == 1.0)
+        {
+            samples.copyFrom(channel, 0, fileSamples, channel, 0, length);
+        }
+        else
+        {
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process(speedRatio, fileSamples.getReadPointer(channel), samples.getWritePointer(channel),
+                                 length, fileLength, 0);
+        }
+    }
+
+    // Scale to unit energy, so that swapping responses doesn't change the
+    // loudness much
+    double energy = 0.0;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const float* data = samples.getReadPointer(channel);
+
+        for (int i = 0; i < length; ++i)
+            energy += (double) data[i] * data[i];
+    }
+
+    if (energy > 0.0)
+        samples.applyGain((float) (1.0 / std::sqrt(energy / numChannels)));
+
+    return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <JuceHeader.h>
+#include "PartitionedConvolver.h"
+
+// Impulse responses loaded from disk, shared by every convolution reverb in
+// the process: twenty instances of the same hall hold one copy of its
+// spectra. Use it through juce::SharedResourcePointer<ImpulseResponseCache>.
+//
+// Responses are kept per file, sample rate and partition size, and dropped
+// once nothing but the cache refers to them.
+class ImpulseResponseCache
+{
+public:
+    ImpulseResponseCache();
+
+    // Longer files are cut short
+    static constexpr double maximumLengthSeconds = 10.0;
+
+    // Returns the file's response resampled to the given rate and partitioned,
+    // loading it if it isn't cached, or nullptr if it can't be read. Loading
+    // is slow, so call this from the message thread or a background thread.
+    ImpulseResponse::Ptr getImpulseResponse(const juce::File& file, double sampleRate, int partitionSize);
+
+    int getNumCached() const;
+    void purgeUnused();
+
+private:
+    struct Entry
+    {
+        juce::String key;
+        ImpulseResponse::Ptr response;
+    };
+
+    bool readFile(const juce::File& file, double sampleRate, juce::AudioBuffer<float>& samples);
+
+    juce::CriticalSection lock;
+    juce::AudioFormatManager formatManager;
+    std::vector<Entry> entries;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ImpulseResponseCache)
+};
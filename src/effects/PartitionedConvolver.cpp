@@ -0,0 +1,179 @@
+#include "PartitionedConvolver.h"
+
+ImpulseResponse::ImpulseResponse(const juce::AudioBuffer<float>& samples, int partitionSizeToUse)
+    : numChannels(juce::jmax(1, samples.getNumChannels())),
+      lengthInSamples(samples.getNumSamples()),
+      partitionSize(partitionSizeToUse),
+      numPartitions(juce::jmax(1, (lengthInSamples + partitionSizeToUse - 1) / partitionSizeToUse))
+{
+    jassert(juce::isPowerOfTwo(partitionSize));
+
+    const int fftSize = partitionSize * 2;
+    juce::dsp::FFT fft(juce::roundToInt(std::log2(fftSize)));
+    std::vector<float> work((size_t) fftSize * 2);
+
+    spectra.assign((size_t) (numChannels * numPartitions * getNumBins() * 2), 0.0f);
+
+    for (int ch = 0; ch < samples.getNumChannels(); ++ch)
+    {
+        for (int partition = 0; partition < numPartitions; ++partition)
+        {
+            const int start = partition * partitionSize;
+            const int length = juce::jmin(partitionSize, lengthInSamples - start);
+
+            std::fill(work.begin(), work.end(), 0.0f);
+            juce::FloatVectorOperations::copy(work.data(), samples.getReadPointer(ch, start), length);
+            fft.performRealOnlyForwardTransform(work.data(), true);
+
+            auto* real = spectra.data() + (size_t) ((ch * numPartitions + partition) * getNumBins() * 2);
+            auto* imaginary = real + getNumBins();
+
+            for (int bin = 0; bin < getNumBins(); ++bin)
+            {
+                real[bin] = work[(size_t) bin * 2];
+                imaginary[bin] = work[(size_t) bin * 2 + 1];
+            }
+        }
+    }
+}
+
+const float* ImpulseResponse::getReal(int channel, int partition) const
+{
+    jassert(juce::isPositiveAndBelow(channel, numChannels) && juce::isPositiveAndBelow(partition, numPartitions));
+    return spectra.data() + (size_t) ((channel * numPartitions + partition) * getNumBins() * 2);
+}
+
+//==============================================================================
+PartitionedConvolver::PartitionedConvolver(ImpulseResponse::Ptr response, int responseChannel)
+    : impulseResponse(std::move(response)),
+      channel(juce::jlimit(0, impulseResponse->getNumChannels() - 1, responseChannel)),
+      partitionSize(impulseResponse->getPartitionSize()),
+      numBins(impulseResponse->getNumBins()),
+      numPartitions(impulseResponse->getNumPartitions()),
+      fft(juce::roundToInt(std::log2(partitionSize * 2)))
+{
+    inputPartition.resize((size_t) partitionSize);
+    segments.resize((size_t) (numPartitions * numBins * 2));
+    olderContributions.resize((size_t) numBins * 2);
+    nextOlderContributions.resize((size_t) numBins * 2);
+    spectrum.resize((size_t) numBins * 2);
+    fftBuffer.resize((size_t) partitionSize * 4);
+    overlap.resize((size_t) partitionSize);
+    reset();
+}
+
+void PartitionedConvolver::reset()
+{
+    std::fill(inputPartition.begin(), inputPartition.end(), 0.0f);
+    std::fill(segments.begin(), segments.end(), 0.0f);
+    std::fill(olderContributions.begin(), olderContributions.end(), 0.0f);
+    std::fill(nextOlderContributions.begin(), nextOlderContributions.end(), 0.0f);
+    std::fill(overlap.begin(), overlap.end(), 0.0f);
+    inputPosition = 0;
+    currentSegment = 0;
+    nextPartitionToAdd = 2;
+}
+
+void PartitionedConvolver::multiplyAdd(float* accumulatorReal, float* accumulatorImaginary,
+                                       const float* aReal, const float* aImaginary,
+                                       const float* bReal, const float* bImaginary, int numBinsToMultiply)
+{
+    for (int bin = 0; bin < numBinsToMultiply; ++bin)
+    {
+        accumulatorReal[bin] += aReal[bin] * bReal[bin] - aImaginary[bin] * bImaginary[bin];
+        accumulatorImaginary[bin] += aReal[bin] * bImaginary[bin] + aImaginary[bin] * bReal[bin];
+    }
+}
+
+void PartitionedConvolver::process(const float* input, float* output, int numSamples)
+{
+    const auto& response = *impulseResponse;
+    const int fftSize = partitionSize * 2;
+
+    for (int done = 0; done < numSamples;)
+    {
+        const bool startingPartition = inputPosition == 0;
+        const int numThisTime = juce::jmin(numSamples - done, partitionSize - inputPosition);
+
+        juce::FloatVectorOperations::copy(inputPartition.data() + inputPosition, input + done, numThisTime);
+
+        // Spectrum of the input so far in this partition
+        std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+        juce::FloatVectorOperations::copy(fftBuffer.data(), inputPartition.data(), partitionSize);
+        fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+        float* segmentReal = getSegmentReal(currentSegment);
+        float* segmentImaginary = segmentReal + numBins;
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            segmentReal[bin] = fftBuffer[(size_t) bin * 2];
+            segmentImaginary[bin] = fftBuffer[(size_t) bin * 2 + 1];
+        }
+
+        // The older input doesn't change until the next partition starts.
+        // Everything but the partition just completed was summed while it
+        // filled.
+        if (startingPartition)
+        {
+            std::copy(nextOlderContributions.begin(), nextOlderContributions.end(), olderContributions.begin());
+            std::fill(nextOlderContributions.begin(), nextOlderContributions.end(), 0.0f);
+            nextPartitionToAdd = 2;
+
+            if (numPartitions > 1)
+            {
+                float* previous = getSegmentReal((currentSegment + 1) % numPartitions);
+                multiplyAdd(olderContributions.data(), olderContributions.data() + numBins, previous, previous + numBins,
+                            response.getReal(channel, 1), response.getImaginary(channel, 1), numBins);
+            }
+        }
+
+        std::copy(olderContributions.begin(), olderContributions.end(), spectrum.begin());
+        multiplyAdd(spectrum.data(), spectrum.data() + numBins, segmentReal, segmentImaginary,
+                    response.getReal(channel, 0), response.getImaginary(channel, 0), numBins);
+
+        // Back to the time domain; the negative frequencies mirror the positive ones
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            fftBuffer[(size_t) bin * 2] = spectrum[(size_t) bin];
+            fftBuffer[(size_t) bin * 2 + 1] = spectrum[(size_t) (numBins + bin)];
+        }
+
+        for (int bin = numBins; bin < fftSize; ++bin)
+        {
+            fftBuffer[(size_t) bin * 2] = spectrum[(size_t) (fftSize - bin)];
+            fftBuffer[(size_t) bin * 2 + 1] = -spectrum[(size_t) (numBins + fftSize - bin)];
+        }
+
+        fft.performRealOnlyInverseTransform(fftBuffer.data());
+
+        juce::FloatVectorOperations::add(output + done, fftBuffer.data() + inputPosition,
+                                         overlap.data() + inputPosition, numThisTime);
+
+        inputPosition += numThisTime;
+        done += numThisTime;
+
+        // As much of the next partition's older sum as this partition has
+        // filled, so it is complete by the time the partition is. Seen from
+        // the next partition, every segment is one older than now.
+        const int addUpTo = juce::jmin(numPartitions,
+                                       2 + ((numPartitions - 2) * inputPosition + partitionSize - 1) / partitionSize);
+
+        for (; nextPartitionToAdd < addUpTo; ++nextPartitionToAdd)
+        {
+            float* older = getSegmentReal((currentSegment + nextPartitionToAdd - 1) % numPartitions);
+            multiplyAdd(nextOlderContributions.data(), nextOlderContributions.data() + numBins, older, older + numBins,
+                        response.getReal(channel, nextPartitionToAdd), response.getImaginary(channel, nextPartitionToAdd),
+                        numBins);
+        }
+
+        if (inputPosition == partitionSize)
+        {
+            // The second half of this partition's result overlaps the next one
+            juce::FloatVectorOperations::copy(overlap.data(), fftBuffer.data() + partitionSize, partitionSize);
+            std::fill(inputPartition.begin(), inputPartition.end(), 0.0f);
+            inputPosition = 0;
+            currentSegment = (currentSegment + numPartitions - 1) % numPartitions;
+        }
+    }
+}
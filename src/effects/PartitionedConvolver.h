@@ -0,0 +1,102 @@
+#pragma once
+#include <JuceHeader.h>
+
+// An impulse response cut into equal partitions and transformed to the
+// frequency domain, ready for PartitionedConvolver. Read-only once built, so
+// any number of convolvers (on any number of tracks) can share one.
+class ImpulseResponse : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<ImpulseResponse>;
+
+    // partitionSize must be a power of two
+    ImpulseResponse(const juce::AudioBuffer<float>& samples, int partitionSize);
+
+    int getNumChannels() const { return numChannels; }
+    int getLengthInSamples() const { return lengthInSamples; }
+    int getPartitionSize() const { return partitionSize; }
+    int getNumPartitions() const { return numPartitions; }
+
+    // Bins 0 to partitionSize of a partition's spectrum, split into real and
+    // imaginary arrays so that multiplying spectra vectorises
+    int getNumBins() const { return partitionSize + 1; }
+    const float* getReal(int channel, int partition) const;
+    const float* getImaginary(int channel, int partition) const { return getReal(channel, partition) + getNumBins(); }
+
+private:
+    int numChannels = 0;
+    int lengthInSamples = 0;
+    int partitionSize = 0;
+    int numPartitions = 0;
+
+    // Indexed [channel][partition][real bins, imaginary bins]
+    std::vector<float> spectra;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ImpulseResponse)
+};
+
+// Convolves one channel with one channel of an ImpulseResponse, with no added
+// latency, using uniformly partitioned overlap-add in the frequency domain.
+//
+// The contributions of all the older input to a partition's output are summed
+// once per partition. Every call transforms the partly filled current
+// partition and multiplies it with the first partition of the response, and
+// calls of any size are fine.
+//
+// All but the newest of the older partitions are already known a whole
+// partition ahead, so their sum for the next partition is built up while the
+// current one fills, in step with how much of it has arrived. The call that
+// starts a partition only adds the partition just completed. With blocks
+// smaller than a partition, the per-block cost stays level instead of
+// spiking, one multiply-add per partition of the response, every
+// partitionSize samples.
+class PartitionedConvolver
+{
+public:
+    // Allocates everything; construct off the audio thread
+    PartitionedConvolver(ImpulseResponse::Ptr response, int responseChannel);
+
+    void reset();
+
+    // Input and output may be the same buffer
+    void process(const float* input, float* output, int numSamples);
+
+    const ImpulseResponse& getImpulseResponse() const { return *impulseResponse; }
+
+private:
+    float* getSegmentReal(int segment) { return segments.data() + (size_t) segment * (size_t) numBins * 2; }
+
+    static void multiplyAdd(float* accumulatorReal, float* accumulatorImaginary,
+                            const float* aReal, const float* aImaginary,
+                            const float* bReal, const float* bImaginary, int numBins);
+
+    ImpulseResponse::Ptr impulseResponse;
+    const int channel;
+    const int partitionSize;
+    const int numBins;
+    const int numPartitions;
+    juce::dsp::FFT fft;
+
+    // The current partition of input, zero padded to the FFT size
+    std::vector<float> inputPartition;
+    int inputPosition = 0;
+
+    // Spectra of the most recent input partitions, newest at currentSegment
+    std::vector<float> segments;
+    int currentSegment = 0;
+
+    // The older partitions' share of the current output, and the total
+    std::vector<float> olderContributions;
+    std::vector<float> spectrum;
+
+    // The share of the next partition's output that is known already, and
+    // the next partition of the response to add to it
+    std::vector<float> nextOlderContributions;
+    int nextPartitionToAdd = 2;
+
+    // Interleaved FFT workspace, and the overlap carried into the next partition
+    std::vector<float> fftBuffer;
+    std::vector<float> overlap;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PartitionedConvolver)
+};
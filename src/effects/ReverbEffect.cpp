@@ -8,24 +8,172 @@ ReverbEffect::ReverbEffect()
     parameters.wetLevel = wetLevel;
     parameters.dryLevel = dryLevel;
     parameters.width = width;
+    
+    fdn.setParameters(getFdnParameters());
 }
 
 void ReverbEffect::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     reverb.setParameters(parameters);
+    appliedParameters = parameters;
+    
+    fdn.setParameters(getFdnParameters());
+    fdn.prepare(sampleRate, samplesPerBlock);
+    
+    currentSampleRate = sampleRate;
+    currentBlockSize = samplesPerBlock;
+    convolutionBuffer.setSize(2, juce::jmax(1, samplesPerBlock));
+    
+    if (impulseResponseFile != juce::File())
+        updateConvolution();
 }
 
 void ReverbEffect::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    if (!enabled) return;
+    if (mode == Mode::Convolution)
+    {
+        processConvolution(buffer);
+        return;
+    }
     
-    reverb.setParameters(parameters);
-    reverb.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), buffer.getNumSamples());
+    if (mode == Mode::Freeverb)
+    {
+        processFreeverb(buffer);
+        return;
+    }
+    
+    // Only starts a ramp if a parameter has moved since the last block
+    fdn.setParameters(getFdnParameters());
+    
+    if (buffer.getNumChannels() > 1)
+        fdn.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), buffer.getNumSamples());
+    else
+        fdn.processMono(buffer.getWritePointer(0), buffer.getNumSamples());
+}
+
+FdnReverb::Parameters ReverbEffect::getFdnParameters() const
+{
+    FdnReverb::Parameters fdnParameters;
+    fdnParameters.roomSize = roomSize;
+    fdnParameters.damping = damping;
+    fdnParameters.wetLevel = wetLevel;
+    fdnParameters.dryLevel = dryLevel;
+    fdnParameters.width = width;
+    return fdnParameters;
+}
+
+void ReverbEffect::processFreeverb(juce::AudioBuffer<float>& buffer)
+{
+    // setParameters recomputes every comb and allpass, so skip it unless
+    // something changed
+    if (parameters.roomSize != appliedParameters.roomSize || parameters.damping != appliedParameters.damping
+        || parameters.wetLevel != appliedParameters.wetLevel || parameters.dryLevel != appliedParameters.dryLevel
+        || parameters.width != appliedParameters.width)
+    {
+        reverb.setParameters(parameters);
+        appliedParameters = parameters;
+    }
+    
+    if (buffer.getNumChannels() > 1)
+        reverb.processStereo(buffer.getWritePointer(0), buffer.getWritePointer(1), buffer.getNumSamples());
+    else
+        reverb.processMono(buffer.getWritePointer(0), buffer.getNumSamples());
+}
+
+void ReverbEffect::processConvolution(juce::AudioBuffer<float>& buffer)
+{
+    const RealtimeSnapshot<Convolution>::ReadScope scope(convolution);
+    auto* state = scope.get();
+    
+    if (state == nullptr || state->channels.empty())
+    {
+        buffer.applyGain(dryLevel);
+        return;
+    }
+    
+    const int numChannels = juce::jmin(buffer.getNumChannels(), (int) state->channels.size(), convolutionBuffer.getNumChannels());
+    
+    // Same wet/dry and width controls as the algorithmic reverb
+    const float wet1 = wetLevel * (width * 0.5f + 0.5f);
+    const float wet2 = wetLevel * (1.0f - width) * 0.5f;
+    
+    for (int start = 0; start < buffer.getNumSamples(); start += convolutionBuffer.getNumSamples())
+    {
+        const int numSamples = juce::jmin(convolutionBuffer.getNumSamples(), buffer.getNumSamples() - start);
+        
+        for (int channel = 0; channel < numChannels; ++channel)
+            state->channels[(size_t) channel]->process(buffer.getReadPointer(channel, start),
+                                                       convolutionBuffer.getWritePointer(channel), numSamples);
+        
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float* output = buffer.getWritePointer(channel, start);
+            juce::FloatVectorOperations::multiply(output, dryLevel, numSamples);
+            
+            if (numChannels == 2)
+            {
+                juce::FloatVectorOperations::addWithMultiply(output, convolutionBuffer.getReadPointer(channel), wet1, numSamples);
+                juce::FloatVectorOperations::addWithMultiply(output, convolutionBuffer.getReadPointer(1 - channel), wet2, numSamples);
+            }
+            else
+            {
+                juce::FloatVectorOperations::addWithMultiply(output, convolutionBuffer.getReadPointer(channel), wetLevel, numSamples);
+            }
+        }
+    }
 }
 
 void ReverbEffect::reset()
 {
+    fdn.reset();
     reverb.reset();
+    
+    const RealtimeSnapshot<Convolution>::ReadScope scope(convolution);
+    
+    if (auto* state = scope.get())
+        for (auto& convolver : state->channels)
+            convolver->reset();
+}
+
+bool ReverbEffect::loadImpulseResponse(const juce::File& file)
+{
+    impulseResponseFile = file;
+    return updateConvolution();
+}
+
+bool ReverbEffect::updateConvolution()
+{
+    // Partitions the size of the audio blocks make every block cost about the same
+    const int partitionSize = juce::jlimit(32, 2048, juce::nextPowerOfTwo(currentBlockSize));
+    auto response = impulseResponseCache->getImpulseResponse(impulseResponseFile, currentSampleRate, partitionSize);
+    
+    auto next = std::make_unique<Convolution>();
+    
+    if (response != nullptr)
+    {
+        for (int channel = 0; channel < 2; ++channel)
+            next->channels.push_back(std::make_unique<PartitionedConvolver>(response, channel));
+    }
+    
+    impulseResponseSeconds = response != nullptr ? response->getLengthInSamples() / currentSampleRate : 0.0;
+    
+    convolution.publish(std::move(next));
+    return response != nullptr;
+}
+
+double ReverbEffect::getTailLengthSeconds() const
+{
+    if (mode == Mode::Convolution)
+        return impulseResponseSeconds.load();
+    
+    if (mode == Mode::Algorithmic)
+        return FdnReverb::getDecaySeconds(roomSize);
+    
+    // juce::Reverb's longest comb (1617 samples at 44.1kHz) recirculates with a
+    // gain of roomSize * 0.28 + 0.7; the tail is the time to fall by 60dB
+    const double combFeedback = roomSize * 0.28 + 0.7;
+    const double combPeriodSeconds = 1617.0 / 44100.0;
+    return combPeriodSeconds * std::log(0.001) / std::log(combFeedback);
 }
 
 void ReverbEffect::setRoomSize(float size)
@@ -1,15 +1,26 @@
 #pragma once
 #include "Effect.h"
+#include "FdnReverb.h"
+#include "ImpulseResponseCache.h"
+#include "../audio/RealtimeSnapshot.h"
 
 class ReverbEffect : public Effect
 {
 public:
+    enum class Mode
+    {
+        Algorithmic,    // feedback delay network
+        Convolution,    // an impulse response loaded from a file
+        Freeverb        // juce::Reverb, as earlier versions sounded
+    };
+
     ReverbEffect();
     ~ReverbEffect() override = default;
 
     void prepareToPlay(double sampleRate, int samplesPerBlock) override;
     void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
     void reset() override;
+    double getTailLengthSeconds() const override;
 
     // Reverb parameters
     void setRoomSize(float size);
@@ -24,13 +35,45 @@ public:
     float getDryLevel() const { return dryLevel; }
     float getWidth() const { return width; }
 
+    // Convolution mode. Responses come from a cache shared by every
+    // instance; without one loaded the effect passes the dry signal only.
+    // Returns false if the file couldn't be read.
+    void setMode(Mode newMode) { mode = newMode; }
+    Mode getMode() const { return mode; }
+    bool loadImpulseResponse(const juce::File& file);
+    const juce::File& getImpulseResponseFile() const { return impulseResponseFile; }
+
 private:
+    FdnReverb fdn;
     juce::Reverb reverb;
     juce::Reverb::Parameters parameters;
+    juce::Reverb::Parameters appliedParameters;
     
     float roomSize = 0.5f;
     float damping = 0.5f;
     float wetLevel = 0.33f;
     float dryLevel = 0.4f;
     float width = 1.0f;
+    
+    Mode mode = Mode::Algorithmic;
+    
+    // A convolver per channel, rebuilt on the message thread whenever the
+    // response or the sample rate changes and swapped in as a whole
+    struct Convolution
+    {
+        std::vector<std::unique_ptr<PartitionedConvolver>> channels;
+    };
+    
+    juce::File impulseResponseFile;
+    std::atomic<double> impulseResponseSeconds { 0.0 };
+    juce::SharedResourcePointer<ImpulseResponseCache> impulseResponseCache;
+    RealtimeSnapshot<Convolution> convolution;
+    juce::AudioBuffer<float> convolutionBuffer;
+    double currentSampleRate = 44100.0;
+    int currentBlockSize = 512;
+    
+    FdnReverb::Parameters getFdnParameters() const;
+    void processFreeverb(juce::AudioBuffer<float>& buffer);
+    bool updateConvolution();
+    void processConvolution(juce::AudioBuffer<float>& buffer);
 };
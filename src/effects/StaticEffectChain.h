@@ -0,0 +1,262 @@
+#pragma once
+#include "CompressorEffect.h"
+#include "DelayEffect.h"
+#include "EQEffect.h"
+#include "ReverbEffect.h"
+#include <array>
+#include <tuple>
+#include <type_traits>
+
+// A fixed series of built-in effects, fused at compile time.
+//
+// EffectChain reaches every effect through a virtual processBlock() that
+// walks the whole buffer, so a three-effect chain makes three passes over
+// it. Here the stages are part of the type: the block is cut into sub-blocks
+// small enough to stay in cache, and each sub-block goes through every stage
+// before the next one is started. The stages are called directly, not
+// through the vtable, so the compiler can inline them. A chain without a
+// stage simply doesn't have it in its type, so nothing is checked per block
+// for stages that aren't there.
+//
+// The chain is itself an Effect, so it goes into a track's EffectChain like
+// any other effect and is bypassed, with a crossfade, as a whole. Disabling
+// one of its stages bypasses just that stage, with the same crossfade; that
+// is a flag read per sub-block, as it can change while playing. A track's
+// sidechain is handed on to every stage, so a fused compressor can be keyed.
+template <typename... Stages>
+class StaticEffectChain : public Effect
+{
+public:
+    static_assert(sizeof...(Stages) > 0, "A chain needs at least one stage");
+    static_assert((std::is_base_of_v<Effect, Stages> && ...), "Every stage must be an Effect");
+
+    // A stereo sub-block is 2 KB, which stays in L1 from stage to stage;
+    // much shorter and the stages' per-call setup starts to cost more than
+    // the passes it saves
+    static constexpr int subBlockSize = 256;
+
+    StaticEffectChain()
+        : Effect({}, Type::None)
+    {
+        juce::StringArray stageNames;
+        forEachStage([&](auto& stage) { stageNames.add(stage.getName()); });
+        name = stageNames.joinIntoString(" > ");
+
+        // Disabled stages start out bypassed rather than fading out
+        size_t index = 0;
+        forEachStage([&](auto& stage) { stageFades[index++] = stage.isEnabled() ? 1.0f : 0.0f; });
+    }
+
+    ~StaticEffectChain() override = default;
+
+    void prepareToPlay(double sampleRate, int samplesPerBlock) override
+    {
+        // No stage ever sees more than a sub-block at a time
+        const int stageBlockSize = juce::jlimit(1, subBlockSize, samplesPerBlock);
+        forEachStage([&](auto& stage) { stage.prepareToPlay(sampleRate, stageBlockSize); });
+
+        fadeStepPerSample = 1.0f / (float) juce::jmax(1, juce::roundToInt(sampleRate * EffectChain::bypassFadeSeconds));
+    }
+
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override
+    {
+        const int numSamples = buffer.getNumSamples();
+
+        for (int start = 0; start < numSamples; start += subBlockSize)
+        {
+            // Refers to the buffer's own memory, nothing is copied or allocated
+            juce::AudioBuffer<float> subBlock(buffer.getArrayOfWritePointers(), buffer.getNumChannels(),
+                                              start, juce::jmin(subBlockSize, numSamples - start));
+
+            processStages(subBlock, midiMessages, nullptr);
+        }
+    }
+
+    void processBlockWithSidechain(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages,
+                                   const juce::AudioBuffer<float>& sidechain) override
+    {
+        const int numSamples = buffer.getNumSamples();
+
+        for (int start = 0; start < numSamples; start += subBlockSize)
+        {
+            const int subBlockLength = juce::jmin(subBlockSize, numSamples - start);
+            juce::AudioBuffer<float> subBlock(buffer.getArrayOfWritePointers(), buffer.getNumChannels(),
+                                              start, subBlockLength);
+
+            // Only ever read from, like the sidechain itself
+            if (start + subBlockLength <= sidechain.getNumSamples())
+            {
+                const juce::AudioBuffer<float> sidechainSubBlock(const_cast<float* const*>(sidechain.getArrayOfReadPointers()),
+                                                                 sidechain.getNumChannels(), start, subBlockLength);
+                processStages(subBlock, midiMessages, &sidechainSubBlock);
+            }
+            else
+            {
+                processStages(subBlock, midiMessages, nullptr);
+            }
+        }
+    }
+
+    void reset() override
+    {
+        forEachStage([](auto& stage) { stage.reset(); });
+    }
+
+    // The enabled stages run in series, so their tails and latencies add
+    // up. Stages still fading out count towards the tail.
+    double getTailLengthSeconds() const override
+    {
+        double tail = 0.0;
+        size_t index = 0;
+
+        forEachStage([&](const auto& stage)
+        {
+            if (stage.isEnabled() || stageFades[index] > 0.0f)
+                tail += stage.getTailLengthSeconds();
+
+            ++index;
+        });
+
+        return tail;
+    }
+
+    int getLatencySamples() const override
+    {
+        int latency = 0;
+
+        forEachStage([&](const auto& stage)
+        {
+            if (stage.isEnabled())
+                latency += stage.getLatencySamples();
+        });
+
+        return latency;
+    }
+
+    // The stages, for setting their parameters
+    template <size_t index>
+    auto& getStage() { return std::get<index>(stages); }
+
+    template <typename StageType>
+    StageType& getStage() { return std::get<StageType>(stages); }
+
+    static constexpr size_t getNumStages() { return sizeof...(Stages); }
+
+private:
+    std::tuple<Stages...> stages;
+
+    // Audio thread, per stage, as the EffectChain keeps them per effect:
+    // 0 = bypassed, 1 = processed, and whether its state is stale
+    std::array<float, sizeof...(Stages)> stageFades {};
+    std::array<bool, sizeof...(Stages)> stageResetPending {};
+
+    // Audio thread: the input to a stage that is fading in or out
+    juce::AudioBuffer<float> dryBlock { 2, subBlockSize };
+    float fadeStepPerSample = 1.0f;
+
+    // Unrolled at compile time, one direct call per stage
+    template <size_t index = 0>
+    void processStages(juce::AudioBuffer<float>& subBlock, juce::MidiBuffer& midiMessages,
+                       const juce::AudioBuffer<float>* sidechain)
+    {
+        if constexpr (index < sizeof...(Stages))
+        {
+            using StageType = std::tuple_element_t<index, std::tuple<Stages...>>;
+            auto& stage = std::get<index>(stages);
+
+            const float startFade = stageFades[index];
+            const float targetFade = stage.StageType::isEnabled() ? 1.0f : 0.0f;
+
+            if (startFade != 0.0f || targetFade != 0.0f)
+            {
+                // Cleared when it comes back, not when it was bypassed
+                if (stageResetPending[index])
+                {
+                    stage.StageType::reset();
+                    stageResetPending[index] = false;
+                }
+
+                if (startFade == targetFade)
+                {
+                    processStage<StageType>(stage, subBlock, midiMessages, sidechain);
+                }
+                else
+                {
+                    const int numSamples = subBlock.getNumSamples();
+
+                    for (int channel = 0; channel < juce::jmin(subBlock.getNumChannels(), dryBlock.getNumChannels()); ++channel)
+                        dryBlock.copyFrom(channel, 0, subBlock, channel, 0, numSamples);
+
+                    processStage<StageType>(stage, subBlock, midiMessages, sidechain);
+
+                    const float fadeStep = fadeStepPerSample * (float) numSamples;
+                    const float endFade = targetFade > startFade ? juce::jmin(targetFade, startFade + fadeStep)
+                                                                 : juce::jmax(targetFade, startFade - fadeStep);
+                    crossfade(subBlock, startFade, endFade);
+
+                    stageFades[index] = endFade;
+                    stageResetPending[index] = endFade == 0.0f;
+                }
+            }
+
+            processStages<index + 1>(subBlock, midiMessages, sidechain);
+        }
+    }
+
+    template <typename StageType>
+    static void processStage(StageType& stage, juce::AudioBuffer<float>& subBlock, juce::MidiBuffer& midiMessages,
+                             const juce::AudioBuffer<float>* sidechain)
+    {
+        // Only stages that are keyed take the sidechain; the rest keep their
+        // direct processBlock() call
+        constexpr bool isKeyed = !std::is_same_v<decltype(&StageType::processBlockWithSidechain),
+                                                 decltype(&Effect::processBlockWithSidechain)>;
+
+        if constexpr (isKeyed)
+        {
+            if (sidechain != nullptr)
+            {
+                stage.StageType::processBlockWithSidechain(subBlock, midiMessages, *sidechain);
+                return;
+            }
+        }
+
+        stage.StageType::processBlock(subBlock, midiMessages);
+    }
+
+    // processed = dry + (processed - dry) * fade, as in the EffectChain
+    void crossfade(juce::AudioBuffer<float>& processed, float startFade, float endFade) const
+    {
+        const int numSamples = processed.getNumSamples();
+        const float increment = (endFade - startFade) / (float) numSamples;
+
+        for (int channel = 0; channel < juce::jmin(processed.getNumChannels(), dryBlock.getNumChannels()); ++channel)
+        {
+            float* wet = processed.getWritePointer(channel);
+            const float* dry = dryBlock.getReadPointer(channel);
+
+            for (int i = 0; i < numSamples; ++i)
+                wet[i] = dry[i] + (wet[i] - dry[i]) * (startFade + increment * (float) (i + 1));
+        }
+    }
+
+    template <typename Function>
+    void forEachStage(Function&& function)
+    {
+        std::apply([&](auto&... stage) { (function(stage), ...); }, stages);
+    }
+
+    template <typename Function>
+    void forEachStage(Function&& function) const
+    {
+        std::apply([&](const auto&... stage) { (function(stage), ...); }, stages);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StaticEffectChain)
+};
+
+// Factory presets
+using DelayEqReverbChain = StaticEffectChain<DelayEffect, EQEffect, ReverbEffect>;
+using EqReverbChain = StaticEffectChain<EQEffect, ReverbEffect>;
+using EqDelayChain = StaticEffectChain<EQEffect, DelayEffect>;
+using EqCompressorChain = StaticEffectChain<EQEffect, CompressorEffect>;
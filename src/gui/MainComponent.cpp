@@ -16,6 +16,9 @@ MainComponent::MainComponent()
 
     statusLabel.setText("Cross-Platform JUCE DAW - Ready", juce::dontSendNotification);
     statusLabel.setJustificationType(juce::Justification::centred);
+
+    // For the overlay's toggle key
+    setWantsKeyboardFocus(true);
 }
 
 MainComponent::~MainComponent()
@@ -44,6 +47,44 @@ void MainComponent::resized()
     trackList.setBounds(bounds);
     
     statusLabel.setBounds(getLocalBounds().removeFromBottom(20));
+    
+    if (performanceOverlay != nullptr)
+        performanceOverlay->setBounds(getLocalBounds().removeFromRight(330).removeFromBottom(110).translated(-5, -25));
+}
+
+bool MainComponent::keyPressed(const juce::KeyPress& key)
+{
+    if (key == PerformanceOverlay::getToggleKey() && performanceOverlay != nullptr)
+    {
+        setPerformanceOverlayVisible(!isPerformanceOverlayVisible());
+        return true;
+    }
+    
+    return false;
+}
+
+void MainComponent::setAudioEngine(AudioEngine* engine)
+{
+    performanceOverlay.reset();
+    timeline.setAudioEngine(engine);
+    
+    if (engine != nullptr)
+    {
+        performanceOverlay = std::make_unique<PerformanceOverlay>(*engine);
+        addChildComponent(*performanceOverlay);
+        resized();
+    }
+}
+
+void MainComponent::setPerformanceOverlayVisible(bool shouldBeVisible)
+{
+    if (performanceOverlay != nullptr)
+        performanceOverlay->setVisible(shouldBeVisible);
+}
+
+bool MainComponent::isPerformanceOverlayVisible() const
+{
+    return performanceOverlay != nullptr && performanceOverlay->isVisible();
 }
 
 void MainComponent::update()
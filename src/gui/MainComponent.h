@@ -4,6 +4,7 @@
 #include "TransportControls.h"
 #include "TimelineComponent.h"
 #include "TrackListComponent.h"
+#include "PerformanceOverlay.h"
 
 class MainComponent : public juce::Component,
                       private juce::ChangeListener
@@ -14,8 +15,15 @@ public:
 
     void paint(juce::Graphics& g) override;
     void resized() override;
+    bool keyPressed(const juce::KeyPress& key) override;
 
     void update();
+    
+    // Enables the DSP load overlay, which needs an engine to read from. It
+    // starts out hidden; PerformanceOverlay::getToggleKey() shows it.
+    void setAudioEngine(AudioEngine* engine);
+    void setPerformanceOverlayVisible(bool shouldBeVisible);
+    bool isPerformanceOverlayVisible() const;
 
 private:
     void changeListenerCallback(juce::ChangeBroadcaster* source) override;
@@ -27,6 +35,7 @@ private:
     TrackListComponent trackList;
     
     juce::Label statusLabel;
+    std::unique_ptr<PerformanceOverlay> performanceOverlay;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainComponent)
 };
@@ -0,0 +1,95 @@
+#include "PerformanceOverlay.h"
+
+PerformanceOverlay::PerformanceOverlay(AudioEngine& engineToMonitor)
+    : engine(engineToMonitor)
+{
+    setInterceptsMouseClicks(false, false);
+}
+
+PerformanceOverlay::~PerformanceOverlay()
+{
+    stopTimer();
+}
+
+void PerformanceOverlay::visibilityChanged()
+{
+    if (isVisible())
+    {
+        timerCallback();
+        startTimerHz(4);
+    }
+    else
+    {
+        stopTimer();
+    }
+}
+
+juce::KeyPress PerformanceOverlay::getToggleKey()
+{
+    return juce::KeyPress('p', juce::ModifierKeys::commandModifier | juce::ModifierKeys::shiftModifier, 0);
+}
+
+void PerformanceOverlay::paint(juce::Graphics& g)
+{
+    g.setColour(juce::Colours::black.withAlpha(0.7f));
+    g.fillRoundedRectangle(getLocalBounds().toFloat(), 4.0f);
+    
+    // Green while there is headroom, red once the worst blocks get close
+    // to the deadline
+    g.setColour(load.p99Percent > 80.0 ? juce::Colours::red
+                : load.p99Percent > 50.0 ? juce::Colours::orange
+                : juce::Colours::lightgreen);
+    g.setFont(juce::Font(13.0f));
+    
+    auto bounds = getLocalBounds().reduced(6, 4);
+    g.drawText("DSP " + juce::String(load.currentPercent, 1) + "%"
+                   + "  p50 " + juce::String(load.p50Percent, 1) + "%"
+                   + "  p99 " + juce::String(load.p99Percent, 1) + "%"
+                   + "  max " + juce::String(load.maxPercent, 1) + "%",
+               bounds.removeFromTop(18), juce::Justification::centredLeft, true);
+    
+    g.setColour(juce::Colours::lightgrey);
+    g.setFont(juce::Font(12.0f));
+    
+    for (const auto& line : trackLines)
+        g.drawText(line, bounds.removeFromTop(16), juce::Justification::centredLeft, true);
+}
+
+void PerformanceOverlay::timerCallback()
+{
+    load = engine.getDspLoad();
+    
+    // The heaviest tracks by p99 render time
+    struct TrackTiming
+    {
+        Track* track;
+        TimingHistogram::Summary timing;
+    };
+    
+    std::vector<TrackTiming> timings;
+    
+    for (int i = 0; i < engine.getNumTracks(); ++i)
+    {
+        auto* track = engine.getTrack(i);
+        timings.push_back({ track, track->getRenderTiming().getSummary() });
+    }
+    
+    std::sort(timings.begin(), timings.end(), [](const TrackTiming& a, const TrackTiming& b)
+    {
+        return a.timing.p99Seconds > b.timing.p99Seconds;
+    });
+    
+    trackLines.clearQuick();
+    
+    for (size_t i = 0; i < timings.size() && i < (size_t) maxTracksShown; ++i)
+    {
+        const auto& entry = timings[i];
+        
+        trackLines.add(entry.track->getName()
+                       + (entry.track->isSleeping() ? "  (sleeping)" : "")
+                       + "  p99 " + juce::String(entry.timing.p99Seconds * 1.0e6, 0) + "us"
+                       + "  max " + juce::String(entry.timing.maxSeconds * 1.0e6, 0) + "us");
+    }
+    
+    repaint();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <JuceHeader.h>
+#include "../audio/AudioEngine.h"
+
+// A small read-out of the engine's DSP load and its most expensive tracks,
+// drawn over the main window. While it is shown it polls the engine's timing
+// statistics a few times a second; nothing here touches the audio thread.
+class PerformanceOverlay : public juce::Component,
+                           private juce::Timer
+{
+public:
+    explicit PerformanceOverlay(AudioEngine& engineToMonitor);
+    ~PerformanceOverlay() override;
+
+    void paint(juce::Graphics& g) override;
+    void visibilityChanged() override;
+
+    // Whether the statistics are being polled, i.e. the overlay is showing
+    bool isRefreshing() const { return isTimerRunning(); }
+
+    // Shows or hides the overlay in the main window
+    static juce::KeyPress getToggleKey();
+
+private:
+    void timerCallback() override;
+
+    AudioEngine& engine;
+
+    AudioEngine::DspLoad load;
+    juce::StringArray trackLines;
+
+    static constexpr int maxTracksShown = 4;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PerformanceOverlay)
+};
@@ -6,6 +6,8 @@ TimelineComponent::TimelineComponent(Transport* transportToUse)
     jassert(transport != nullptr);
     
     transport->addChangeListener(this);
+    peakCache->addChangeListener(this);
+    peakCache->addWaveformView();
     startTimerHz(30);
     
     setOpaque(true);
@@ -14,6 +16,8 @@ TimelineComponent::TimelineComponent(Transport* transportToUse)
 TimelineComponent::~TimelineComponent()
 {
     transport->removeChangeListener(this);
+    peakCache->removeChangeListener(this);
+    peakCache->removeWaveformView();
     stopTimer();
 }
 
@@ -48,6 +52,8 @@ void TimelineComponent::paint(juce::Graphics& g)
         }
     }
     
+    drawClips(g, bounds.withTrimmedTop(25));
+    
     // Draw playhead
     double currentPosition = transport->getCurrentPosition();
     int playheadX = getPositionForTime(currentPosition);
@@ -79,7 +85,8 @@ void TimelineComponent::resized()
 
 void TimelineComponent::changeListenerCallback(juce::ChangeBroadcaster* source)
 {
-    if (source == transport)
+    // The peak cache says when a file's peaks are ready to draw
+    if (source == transport || source == &peakCache.get())
     {
         repaint();
     }
@@ -138,3 +145,87 @@ void TimelineComponent::setPixelsPerSecond(double pixels)
     resized();
     repaint();
 }
+
+void TimelineComponent::setAudioEngine(AudioEngine* engineToShow)
+{
+    engine = engineToShow;
+    repaint();
+}
+
+void TimelineComponent::drawClips(juce::Graphics& g, juce::Rectangle<int> area)
+{
+    if (engine == nullptr || engine->getSampleRate() <= 0.0)
+        return;
+    
+    juce::Array<Track*> tracksWithClips;
+    
+    for (int i = 0; i < engine->getNumTracks(); ++i)
+    {
+        if (auto* track = engine->getTrack(i); track != nullptr && track->getClipPlayer().getNumClips() > 0)
+            tracksWithClips.add(track);
+    }
+    
+    if (tracksWithClips.isEmpty())
+        return;
+    
+    const int laneHeight = area.getHeight() / tracksWithClips.size();
+    const double sampleRate = engine->getSampleRate();
+    
+    for (auto* track : tracksWithClips)
+    {
+        auto lane = area.removeFromTop(laneHeight);
+        auto& clipPlayer = track->getClipPlayer();
+        
+        for (int i = 0; i < clipPlayer.getNumClips(); ++i)
+        {
+            const auto clip = clipPlayer.getClip(i);
+            const int clipStartX = getPositionForTime((double) clip.timelineStart / sampleRate);
+            const int clipEndX = getPositionForTime((double) (clip.timelineStart + clip.length) / sampleRate);
+            
+            if (clipEndX < 0 || clipStartX >= getWidth())
+                continue;
+            
+            juce::Rectangle<int> clipBounds(clipStartX, lane.getY() + 1, juce::jmax(1, clipEndX - clipStartX), lane.getHeight() - 2);
+            g.setColour(juce::Colours::steelblue.withAlpha(0.3f));
+            g.fillRect(clipBounds);
+            
+            // Until its peaks are ready the clip is drawn empty; the cache
+            // asks for a repaint once they are
+            if (auto peaks = peakCache->getPeaks(clip.file))
+                drawWaveform(g, *peaks, clip, clipBounds, sampleRate);
+        }
+    }
+}
+
+void TimelineComponent::drawWaveform(juce::Graphics& g, const PeakFile& peaks, const AudioClip& clip,
+                                     juce::Rectangle<int> lane, double sampleRate)
+{
+    const float centreY = (float) lane.getCentreY();
+    const float halfHeight = (float) lane.getHeight() * 0.5f;
+    const double samplesPerPixel = sampleRate / pixelsPerSecond;
+    
+    // One peak per pixel column, whatever the zoom
+    for (int x = juce::jmax(0, lane.getX()); x < juce::jmin(getWidth(), lane.getRight()); ++x)
+    {
+        const auto timelineSample = (juce::int64) (getTimeAtPosition(x) * sampleRate);
+        const auto sourceStart = clip.sourceStart + juce::jmax((juce::int64) 0, timelineSample - clip.timelineStart);
+        const auto sourceEnd = sourceStart + juce::jmax((juce::int64) 1, (juce::int64) samplesPerPixel);
+        
+        // Channels drawn on top of each other
+        PeakFile::Peak peak;
+        
+        for (int channel = 0; channel < peaks.getNumChannels(); ++channel)
+        {
+            const auto channelPeak = peaks.getPeak(channel, sourceStart, sourceEnd);
+            peak.min = juce::jmin(peak.min, channelPeak.min);
+            peak.max = juce::jmax(peak.max, channelPeak.max);
+            peak.rms = juce::jmax(peak.rms, channelPeak.rms);
+        }
+        
+        const float gain = clip.gain;
+        g.setColour(juce::Colours::lightblue);
+        g.drawVerticalLine(x, centreY - peak.max * gain * halfHeight, centreY - peak.min * gain * halfHeight + 1.0f);
+        g.setColour(juce::Colours::skyblue);
+        g.drawVerticalLine(x, centreY - peak.rms * gain * halfHeight, centreY + peak.rms * gain * halfHeight + 1.0f);
+    }
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <JuceHeader.h>
 #include "../transport/Transport.h"
+#include "../audio/AudioEngine.h"
+#include "../playback/PeakCache.h"
 
 class TimelineComponent : public juce::Component,
                          private juce::ChangeListener,
@@ -16,6 +18,10 @@ public:
     void setZoomLevel(double zoom);
     void setPixelsPerSecond(double pixels);
     
+    // The tracks whose clips are drawn, one lane per track with clips.
+    // Waveforms come from peak files, so any zoom costs the same to paint.
+    void setAudioEngine(AudioEngine* engineToShow);
+    
     void mouseDown(const juce::MouseEvent& event) override;
     void mouseDrag(const juce::MouseEvent& event) override;
     void mouseUp(const juce::MouseEvent& event) override;
@@ -26,8 +32,14 @@ private:
     
     double getTimeAtPosition(int x) const;
     int getPositionForTime(double time) const;
+    
+    void drawClips(juce::Graphics& g, juce::Rectangle<int> area);
+    void drawWaveform(juce::Graphics& g, const PeakFile& peaks, const AudioClip& clip,
+                      juce::Rectangle<int> lane, double sampleRate);
 
     Transport* transport;
+    AudioEngine* engine = nullptr;
+    juce::SharedResourcePointer<PeakCache> peakCache;
     
     double visibleStartTime = 0.0;
     double visibleDuration = 10.0;
@@ -0,0 +1,305 @@
+#include "ClipPlayer.h"
+
+ClipPlayer::ClipPlayer() = default;
+
+ClipPlayer::~ClipPlayer()
+{
+    diskReader->removeClient(this);
+}
+
+void ClipPlayer::prepareToPlay(double sampleRate, int numChannels)
+{
+    // The readers keep out while the ring is reallocated
+    diskReader->removeClient(this);
+
+    const int numChunks = juce::jmax(2, (int) std::ceil(readAheadSeconds * sampleRate / chunkSize));
+    capacity = numChunks * chunkSize;
+    numChannels = juce::jmax(1, numChannels);
+
+    ring.setSize(numChannels, capacity);
+    chunk.setSize(numChannels, chunkSize);
+    clipSamples.setSize(numChannels, chunkSize);
+
+    // Start again from wherever the next block is
+    filledStart = 0;
+    filledEnd = 0;
+    restartPosition = -1;
+    clipsChanged = true;
+
+    if (getNumClips() > 0)
+        diskReader->addClient(this);
+}
+
+void ClipPlayer::releaseResources()
+{
+    diskReader->removeClient(this);
+
+    // With no capacity the readers have nothing to fill, even once a clip is
+    // added again
+    capacity = 0;
+    ring.setSize(0, 0);
+    chunk.setSize(0, 0);
+    clipSamples.setSize(0, 0);
+
+    filledStart = 0;
+    filledEnd = 0;
+    restartPosition = -1;
+}
+
+bool ClipPlayer::addClip(const AudioClip& clip)
+{
+    auto loaded = std::make_shared<LoadedClip>();
+    loaded->sample = samplePool->getSample(clip.file);
+    juce::int64 fileLength = 0;
+
+    if (loaded->sample != nullptr)
+    {
+        fileLength = loaded->sample->getAudio().getNumSamples();
+    }
+    else
+    {
+        // Too big for the pool, so it's streamed
+        loaded->reader = diskReader->createReaderFor(clip.file);
+
+        if (loaded->reader == nullptr)
+            return false;
+
+        fileLength = loaded->reader->lengthInSamples;
+    }
+
+    loaded->clip = clip;
+    loaded->clip.sourceStart = juce::jlimit((juce::int64) 0, fileLength, clip.sourceStart);
+
+    const auto available = fileLength - loaded->clip.sourceStart;
+    loaded->clip.length = clip.length < 0 ? available : juce::jmin(clip.length, available);
+
+    {
+        const juce::ScopedLock sl(clipLock);
+        clips.push_back(std::move(loaded));
+        numClips = (int) clips.size();
+    }
+
+    clipsChanged = true;
+    diskReader->addClient(this);
+    return true;
+}
+
+void ClipPlayer::removeClip(int index)
+{
+    {
+        const juce::ScopedLock sl(clipLock);
+
+        if (!juce::isPositiveAndBelow(index, (int) clips.size()))
+            return;
+
+        // A reader thread may still hold the clip; it goes when that lets go
+        clips.erase(clips.begin() + index);
+        numClips = (int) clips.size();
+    }
+
+    clipsChanged = true;
+}
+
+void ClipPlayer::clearClips()
+{
+    {
+        const juce::ScopedLock sl(clipLock);
+        clips.clear();
+        numClips = 0;
+    }
+
+    clipsChanged = true;
+}
+
+int ClipPlayer::getNumClips() const
+{
+    return numClips.load();
+}
+
+AudioClip ClipPlayer::getClip(int index) const
+{
+    const juce::ScopedLock sl(clipLock);
+
+    if (!juce::isPositiveAndBelow(index, (int) clips.size()))
+        return {};
+
+    return clips[(size_t) index]->clip;
+}
+
+void ClipPlayer::beginBlock(const PlayheadState& newPlayhead)
+{
+    playhead = newPlayhead;
+    playingThisBlock = false;
+
+    if (numClips.load(std::memory_order_relaxed) == 0 || capacity == 0)
+        return;
+
+    playingThisBlock = playhead.playing;
+
+    // What's buffered was mixed from the old clips
+    if (clipsChanged.exchange(false))
+    {
+        requestRestart(playhead.position);
+        return;
+    }
+
+    if (restartPosition.load() >= 0)
+        return;
+
+    const auto start = filledStart.load();
+    const auto end = filledEnd.load();
+
+    if (playhead.position < start || playhead.position > end)
+        requestRestart(playhead.position);
+    else if (playhead.position > start)
+        filledStart = playhead.position;    // skipped, and free for the readers again
+}
+
+bool ClipPlayer::addNextBlock(juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    if (!playingThisBlock)
+        return false;
+
+    const auto position = playhead.position;
+
+    // An offline render can afford to wait for the disk, and mustn't glitch
+    if (playhead.offline)
+        waitForDisk(position, numSamples);
+
+    if (restartPosition.load() >= 0)
+    {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const int available = (int) juce::jlimit((juce::int64) 0, (juce::int64) numSamples, filledEnd.load() - position);
+
+    if (available > 0)
+    {
+        // The ring wraps at its end
+        const int ringIndex = (int) (position % capacity);
+        const int firstPart = juce::jmin(available, capacity - ringIndex);
+
+        for (int channel = 0; channel < juce::jmin(buffer.getNumChannels(), ring.getNumChannels()); ++channel)
+        {
+            buffer.addFrom(channel, 0, ring, channel, ringIndex, firstPart);
+
+            if (available > firstPart)
+                buffer.addFrom(channel, firstPart, ring, channel, 0, available - firstPart);
+        }
+    }
+
+    if (available < numSamples)
+        underruns.fetch_add(1, std::memory_order_relaxed);
+
+    filledStart = position + available;
+    return available > 0;
+}
+
+void ClipPlayer::requestRestart(juce::int64 position)
+{
+    restartPosition = position;
+}
+
+bool ClipPlayer::waitForDisk(juce::int64 position, int numSamples) const
+{
+    const auto deadline = juce::Time::getMillisecondCounter() + 2000;
+
+    while (restartPosition.load() >= 0 || filledEnd.load() < position + numSamples)
+    {
+        if (juce::Time::getMillisecondCounter() > deadline)
+            return false;
+
+        juce::Thread::sleep(1);
+    }
+
+    return true;
+}
+
+juce::int64 ClipPlayer::getSamplesBuffered() const
+{
+    if (numClips.load() == 0)
+        return -1;
+
+    // Nothing to play at all until the restart has been done
+    if (restartPosition.load() >= 0)
+        return 0;
+
+    const auto buffered = filledEnd.load() - filledStart.load();
+    return capacity - buffered >= chunkSize ? buffered : -1;
+}
+
+void ClipPlayer::readNextChunk()
+{
+    // The audio thread keeps out of the ring until the restart is
+    // acknowledged. If it asks again meanwhile, the newer request wins.
+    for (auto restart = restartPosition.load(); restart >= 0;)
+    {
+        filledStart = restart;
+        filledEnd = restart;
+
+        if (restartPosition.compare_exchange_strong(restart, -1))
+            break;
+    }
+
+    const auto start = filledEnd.load();
+    const int numSamples = (int) juce::jmin((juce::int64) chunkSize, capacity - (start - filledStart.load()));
+
+    if (numSamples <= 0)
+        return;
+
+    {
+        const juce::ScopedLock sl(clipLock);
+        clipsToRead.assign(clips.begin(), clips.end());
+    }
+
+    // Mix every clip overlapping the chunk
+    for (int channel = 0; channel < chunk.getNumChannels(); ++channel)
+        chunk.clear(channel, 0, numSamples);
+
+    for (const auto& loaded : clipsToRead)
+    {
+        const auto& clip = loaded->clip;
+        const auto from = juce::jmax(start, clip.timelineStart);
+        const auto to = juce::jmin(start + numSamples, clip.timelineStart + clip.length);
+
+        if (from >= to)
+            continue;
+
+        const int length = (int) (to - from);
+        const auto sourcePosition = clip.sourceStart + (from - clip.timelineStart);
+
+        if (loaded->sample != nullptr)
+        {
+            // A mono sample plays on both sides
+            const auto& audio = loaded->sample->getAudio();
+
+            for (int channel = 0; channel < chunk.getNumChannels(); ++channel)
+                chunk.addFrom(channel, (int) (from - start), audio, juce::jmin(channel, audio.getNumChannels() - 1),
+                              (int) sourcePosition, length, clip.gain);
+        }
+        else
+        {
+            loaded->reader->read(&clipSamples, 0, length, sourcePosition, true, true);
+
+            for (int channel = 0; channel < chunk.getNumChannels(); ++channel)
+                chunk.addFrom(channel, (int) (from - start), clipSamples, channel, 0, length, clip.gain);
+        }
+    }
+
+    clipsToRead.clear();
+
+    // Into the ring, wrapping at its end
+    const int ringIndex = (int) (start % capacity);
+    const int firstPart = juce::jmin(numSamples, capacity - ringIndex);
+
+    for (int channel = 0; channel < ring.getNumChannels(); ++channel)
+    {
+        ring.copyFrom(channel, ringIndex, chunk, channel, 0, firstPart);
+
+        if (numSamples > firstPart)
+            ring.copyFrom(channel, 0, chunk, channel, firstPart, numSamples - firstPart);
+    }
+
+    filledEnd = start + numSamples;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <JuceHeader.h>
+#include "DiskReaderService.h"
+#include "SamplePool.h"
+
+// A region of an audio file placed on a track's timeline. Positions and
+// lengths are in samples; files are played at the session's sample rate,
+// whatever rate they were recorded at.
+struct AudioClip
+{
+    juce::File file;
+    juce::int64 timelineStart = 0;  // where on the timeline the clip starts
+    juce::int64 sourceStart = 0;    // where in the file it starts
+    juce::int64 length = -1;        // -1 plays to the end of the file
+    float gain = 1.0f;
+};
+
+// Where the engine's timeline is during a block
+struct PlayheadState
+{
+    juce::int64 position = 0;
+    bool playing = false;
+    bool offline = false;   // rendering faster than real time, so playback may wait for the disk
+};
+
+// Plays a track's clips, streamed from disk.
+//
+// The audio thread never touches a file. It plays from a read-ahead buffer
+// holding the track's timeline from the playhead onwards, already mixed from
+// its clips, which the DiskReaderService's threads keep topped up. The
+// buffer is a ring indexed by timeline position: the audio thread consumes
+// from its start and the readers append at its end, lock-free. When the
+// playhead jumps, the audio thread asks for the buffer to be restarted from
+// the new position and plays silence until it has been; the readers refill
+// it whether or not the transport is running, so after a locate playback
+// can start straight away.
+//
+// Clips read from the process-wide SamplePool when their file fits in it, so
+// every clip of the same file shares one copy in memory, and stream from the
+// file otherwise.
+class ClipPlayer : private DiskReaderService::Client
+{
+public:
+    ClipPlayer();
+    ~ClipPlayer() override;
+
+    // How far ahead of the playhead the buffer reaches, and how much each
+    // read adds to it
+    static constexpr double readAheadSeconds = 1.0;
+    static constexpr int chunkSize = 8192;
+
+    // Message thread, while the audio thread isn't playing
+    void prepareToPlay(double sampleRate, int numChannels);
+
+    // Message thread, while the audio thread isn't playing: frees the ring.
+    // Nothing plays until the next prepareToPlay().
+    void releaseResources();
+
+    // Message thread. Editing the clips during playback restarts the
+    // buffer, so the track drops out for a moment. Returns false if the
+    // clip's file can't be read.
+    bool addClip(const AudioClip& clip);
+    void removeClip(int index);
+    void clearClips();
+    int getNumClips() const;
+    AudioClip getClip(int index) const;
+
+    // Audio thread, at the start of every block, playing or not
+    void beginBlock(const PlayheadState& playhead);
+
+    // Audio thread: adds the clips' audio for the block to the buffer.
+    // Returns false if the transport is stopped, there are no clips or the
+    // buffer had nothing ready.
+    bool addNextBlock(juce::AudioBuffer<float>& buffer, int numSamples);
+    bool isPlayingThisBlock() const { return playingThisBlock; }
+
+    // Blocks, or parts of blocks, that played silence because the disk
+    // couldn't keep up or the buffer was still being restarted
+    juce::uint64 getNumUnderruns() const { return underruns.load(); }
+
+private:
+    struct LoadedClip
+    {
+        AudioClip clip;
+
+        // One or the other
+        SamplePool::Sample::Ptr sample;
+        std::unique_ptr<juce::AudioFormatReader> reader;
+    };
+
+    // DiskReaderService::Client
+    juce::int64 getSamplesBuffered() const override;
+    void readNextChunk() override;
+
+    // Audio thread
+    void requestRestart(juce::int64 position);
+    bool waitForDisk(juce::int64 position, int numSamples) const;
+
+    juce::SharedResourcePointer<DiskReaderService> diskReader;
+    juce::SharedResourcePointer<SamplePool> samplePool;
+
+    // Message thread and reader threads
+    juce::CriticalSection clipLock;
+    std::vector<std::shared_ptr<LoadedClip>> clips;
+    std::atomic<int> numClips { 0 };
+    std::atomic<bool> clipsChanged { false };
+
+    // The ring. The audio thread owns filledStart and the readers filledEnd,
+    // except while a restart is pending, when the audio thread keeps out and
+    // the readers set both.
+    juce::AudioBuffer<float> ring;
+    int capacity = 0;
+    std::atomic<juce::int64> filledStart { 0 }, filledEnd { 0 };
+    std::atomic<juce::int64> restartPosition { -1 };
+
+    // Reader threads: the chunk being mixed, a clip's samples, and the clips
+    // to read them from
+    juce::AudioBuffer<float> chunk, clipSamples;
+    std::vector<std::shared_ptr<LoadedClip>> clipsToRead;
+
+    // Audio thread
+    PlayheadState playhead;
+    bool playingThisBlock = false;
+    std::atomic<juce::uint64> underruns { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ClipPlayer)
+};
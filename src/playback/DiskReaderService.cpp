@@ -0,0 +1,161 @@
+#include "DiskReaderService.h"
+
+namespace
+{
+    // How long a reader thread with nothing to read waits before looking again
+    constexpr int pollIntervalMs = 2;
+}
+
+DiskReaderService::Worker::Worker(DiskReaderService& service)
+    : juce::Thread("Disk Reader"),
+      owner(service)
+{
+}
+
+DiskReaderService::Worker::~Worker()
+{
+    stopThread(2000);
+}
+
+void DiskReaderService::Worker::run()
+{
+    while (!threadShouldExit())
+    {
+        if (!owner.readNextChunk())
+            wait(pollIntervalMs);
+    }
+}
+
+DiskReaderService::DiskReaderService()
+{
+    formatManager.registerBasicFormats();
+}
+
+DiskReaderService::~DiskReaderService()
+{
+    stopWorkers();
+
+    // ClipPlayers remove themselves when they are destroyed
+    jassert(clients.isEmpty());
+}
+
+std::unique_ptr<juce::AudioFormatReader> DiskReaderService::createReaderFor(const juce::File& file)
+{
+    juce::WavAudioFormat wavFormat;
+    juce::AiffAudioFormat aiffFormat;
+    juce::AudioFormat* const mappableFormats[] = { &wavFormat, &aiffFormat };
+
+    for (auto* format : mappableFormats)
+    {
+        if (!format->canHandleFile(file))
+            continue;
+
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+
+        if (mapped != nullptr && mapped->mapEntireFile())
+            return mapped;
+    }
+
+    const juce::ScopedLock sl(formatLock);
+    return std::unique_ptr<juce::AudioFormatReader>(formatManager.createReaderFor(file));
+}
+
+void DiskReaderService::addClient(Client* client)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        clients.addIfNotAlreadyThere(client);
+    }
+
+    if (workers.isEmpty())
+        startWorkers();
+}
+
+void DiskReaderService::removeClient(Client* client)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        clients.removeFirstMatchingValue(client);
+    }
+
+    // A reader thread may be halfway through a chunk for it
+    for (;;)
+    {
+        {
+            const juce::ScopedLock sl(lock);
+
+            if (!clientsBeingRead.contains(client))
+                return;
+        }
+
+        juce::Thread::sleep(1);
+    }
+}
+
+void DiskReaderService::setNumThreads(int newNumThreads)
+{
+    // Not under the lock: a stopping worker may be waiting for it
+    numThreads = juce::jlimit(1, 16, newNumThreads);
+
+    if (!workers.isEmpty())
+    {
+        stopWorkers();
+        startWorkers();
+    }
+}
+
+int DiskReaderService::getNumClients() const
+{
+    const juce::ScopedLock sl(lock);
+    return clients.size();
+}
+
+bool DiskReaderService::readNextChunk()
+{
+    Client* client = nullptr;
+
+    {
+        const juce::ScopedLock sl(lock);
+        juce::int64 leastBuffered = std::numeric_limits<juce::int64>::max();
+
+        // Whoever is closest to running dry goes first
+        for (auto* candidate : clients)
+        {
+            if (clientsBeingRead.contains(candidate))
+                continue;
+
+            const auto buffered = candidate->getSamplesBuffered();
+
+            if (buffered >= 0 && buffered < leastBuffered)
+            {
+                client = candidate;
+                leastBuffered = buffered;
+            }
+        }
+
+        if (client == nullptr)
+            return false;
+
+        clientsBeingRead.add(client);
+    }
+
+    client->readNextChunk();
+
+    const juce::ScopedLock sl(lock);
+    clientsBeingRead.removeFirstMatchingValue(client);
+    return true;
+}
+
+void DiskReaderService::startWorkers()
+{
+    for (int i = 0; i < numThreads; ++i)
+        workers.add(new Worker(*this))->startThread(juce::Thread::Priority::high);
+}
+
+void DiskReaderService::stopWorkers()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    workers.clear();
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Reads audio from disk ahead of playback for every track in the process,
+// from one small pool of reader threads. Use it through
+// juce::SharedResourcePointer<DiskReaderService>.
+//
+// Clients are the tracks' ClipPlayers. Each keeps a read-ahead buffer that
+// the audio thread plays from, and the reader threads top them up a chunk
+// at a time, always serving the client with the least audio buffered first,
+// so a hundred streams degrade evenly instead of some starving.
+class DiskReaderService
+{
+public:
+    struct Client
+    {
+        virtual ~Client() = default;
+
+        // How many samples the client could play without any more reading,
+        // or a negative number if it has no room for another chunk. Called
+        // on the reader threads; must not block.
+        virtual juce::int64 getSamplesBuffered() const = 0;
+
+        // Reads the next chunk into the client's buffer. Called on a reader
+        // thread, never on two at once for the same client.
+        virtual void readNextChunk() = 0;
+    };
+
+    DiskReaderService();
+    ~DiskReaderService();
+
+    // Any thread. WAV and AIFF files are memory-mapped, so reading them is a
+    // copy out of the page cache; other formats get an ordinary reader.
+    // Returns nullptr if the file can't be read.
+    std::unique_ptr<juce::AudioFormatReader> createReaderFor(const juce::File& file);
+
+    // Message thread. Removing blocks until no reader thread is using the
+    // client any more.
+    void addClient(Client* client);
+    void removeClient(Client* client);
+
+    // The reader threads start with the first client. Changing their number
+    // restarts them; playback carries on meanwhile.
+    void setNumThreads(int numThreads);
+    int getNumThreads() const { return numThreads; }
+    int getNumClients() const;
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        explicit Worker(DiskReaderService& service);
+        ~Worker() override;
+
+        void run() override;
+
+    private:
+        DiskReaderService& owner;
+    };
+
+    // Reader thread: reads one chunk for the neediest client. Returns false
+    // if none had room.
+    bool readNextChunk();
+    void startWorkers();
+    void stopWorkers();
+
+    // Held while the lists change and while a client is picked
+    juce::CriticalSection lock;
+    juce::Array<Client*> clients;
+    juce::Array<Client*> clientsBeingRead;
+
+    juce::OwnedArray<Worker> workers;
+    int numThreads = 2;
+
+    juce::CriticalSection formatLock;
+    juce::AudioFormatManager formatManager;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DiskReaderService)
+};
@@ -0,0 +1,127 @@
+#include "PeakCache.h"
+
+PeakCache::BuildJob::BuildJob(PeakCache& cache, const juce::File& file, std::unique_ptr<PeakFile::Builder> builderToUse)
+    : juce::ThreadPoolJob("Build Peaks"),
+      owner(cache),
+      audioFile(file),
+      builder(std::move(builderToUse))
+{
+}
+
+juce::ThreadPoolJob::JobStatus PeakCache::BuildJob::runJob()
+{
+    // A recording brings its peaks along; anything else is read for them
+    const bool succeeded = builder != nullptr ? builder->write(audioFile) : readPeaks();
+    owner.jobFinished(audioFile, succeeded);
+    return jobHasFinished;
+}
+
+bool PeakCache::BuildJob::readPeaks()
+{
+    auto reader = owner.diskReader->createReaderFor(audioFile);
+
+    if (reader == nullptr)
+        return false;
+
+    builder = std::make_unique<PeakFile::Builder>((int) reader->numChannels);
+    juce::AudioBuffer<float> chunk(juce::jmax(1, (int) reader->numChannels), readChunkSize);
+
+    for (juce::int64 position = 0; position < reader->lengthInSamples; position += readChunkSize)
+    {
+        if (shouldExit())
+            return false;
+
+        const int numSamples = (int) juce::jmin((juce::int64) readChunkSize, reader->lengthInSamples - position);
+        reader->read(&chunk, 0, numSamples, position, true, true);
+        builder->addSamples(chunk, 0, numSamples);
+    }
+
+    return builder->write(audioFile);
+}
+
+PeakCache::PeakCache() = default;
+
+PeakCache::~PeakCache()
+{
+    buildPool.removeAllJobs(true, 4000);
+}
+
+PeakFile::Ptr PeakCache::getPeaks(const juce::File& audioFile)
+{
+    const auto path = audioFile.getFullPathName();
+    const auto now = juce::Time::getMillisecondCounter();
+
+    const juce::ScopedLock sl(lock);
+
+    if (pending.contains(path))
+        return nullptr;
+
+    const auto found = entries.find(path);
+
+    if (found != entries.end() && now - found->second.lastChecked < recheckIntervalMs)
+        return found->second.peaks;
+
+    const auto modified = audioFile.getLastModificationTime().toMilliseconds();
+
+    if (found != entries.end() && found->second.modificationTime == modified)
+    {
+        found->second.lastChecked = now;
+        return found->second.peaks;
+    }
+
+    // New, or changed since its peaks were worked out
+    auto& entry = entries[path];
+    entry = { PeakFile::open(audioFile), modified, now };
+
+    if (entry.peaks == nullptr && audioFile.existsAsFile())
+        startJob(audioFile, nullptr);
+
+    return entry.peaks;
+}
+
+void PeakCache::addPeaks(const juce::File& audioFile, std::unique_ptr<PeakFile::Builder> builder)
+{
+    jassert(builder != nullptr);
+
+    const juce::ScopedLock sl(lock);
+    entries.erase(audioFile.getFullPathName());
+    startJob(audioFile, std::move(builder));
+}
+
+void PeakCache::addWaveformView()
+{
+    ++numWaveformViews;
+}
+
+void PeakCache::removeWaveformView()
+{
+    jassert(numWaveformViews.load() > 0);
+    --numWaveformViews;
+}
+
+int PeakCache::getNumPending() const
+{
+    const juce::ScopedLock sl(lock);
+    return pending.size();
+}
+
+void PeakCache::startJob(const juce::File& audioFile, std::unique_ptr<PeakFile::Builder> builder)
+{
+    pending.add(audioFile.getFullPathName());
+    buildPool.addJob(new BuildJob(*this, audioFile, std::move(builder)), true);
+}
+
+void PeakCache::jobFinished(const juce::File& audioFile, bool succeeded)
+{
+    {
+        const juce::ScopedLock sl(lock);
+        pending.removeString(audioFile.getFullPathName());
+
+        // Mapped when next asked for. A failure is remembered, so it isn't
+        // tried again until the file changes.
+        if (succeeded)
+            entries.erase(audioFile.getFullPathName());
+    }
+
+    sendChangeMessage();
+}
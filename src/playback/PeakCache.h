@@ -0,0 +1,82 @@
+#pragma once
+#include <JuceHeader.h>
+#include "PeakFile.h"
+#include "DiskReaderService.h"
+
+// Waveform peaks for every audio file on screen, shared across the process.
+// Use it through juce::SharedResourcePointer<PeakCache>.
+//
+// Asking for a file's peaks maps its peak file if it has an up-to-date one,
+// and otherwise builds it on a background thread and sends a change message
+// once it is ready. While anything shows waveforms, recordings build theirs
+// on the disk writer's threads as they go, and hand them over when they
+// stop; otherwise they leave no peak file behind.
+class PeakCache : public juce::ChangeBroadcaster
+{
+public:
+    PeakCache();
+    ~PeakCache() override;
+
+    // Message thread. Returns nullptr while the peaks are being built, or if
+    // the file can't be read. The file is checked for changes at most every
+    // recheckIntervalMs, so this is cheap enough to call on every paint.
+    PeakFile::Ptr getPeaks(const juce::File& audioFile);
+
+    // Message thread: whatever draws waveforms says so for as long as it
+    // does, and recordings only work out their peaks meanwhile
+    void addWaveformView();
+    void removeWaveformView();
+    bool hasWaveformViews() const { return numWaveformViews.load() > 0; }
+
+    // Any thread: writes peaks worked out elsewhere, in the background. The
+    // audio file must be complete.
+    void addPeaks(const juce::File& audioFile, std::unique_ptr<PeakFile::Builder> builder);
+
+    int getNumPending() const;
+
+private:
+    class BuildJob : public juce::ThreadPoolJob
+    {
+    public:
+        BuildJob(PeakCache& cache, const juce::File& audioFile, std::unique_ptr<PeakFile::Builder> builder);
+
+        JobStatus runJob() override;
+
+    private:
+        bool readPeaks();
+
+        PeakCache& owner;
+        const juce::File audioFile;
+        std::unique_ptr<PeakFile::Builder> builder;
+    };
+
+    // Frames read from the audio at a time while building
+    static constexpr int readChunkSize = 65536;
+
+    // How often a file with known peaks, or none, is looked at for changes
+    static constexpr juce::uint32 recheckIntervalMs = 1000;
+
+    // What a file had last time it was looked at. No peaks and not pending
+    // means they couldn't be built, and aren't tried again until it changes.
+    struct Entry
+    {
+        PeakFile::Ptr peaks;
+        juce::int64 modificationTime = 0;
+        juce::uint32 lastChecked = 0;
+    };
+
+    void startJob(const juce::File& audioFile, std::unique_ptr<PeakFile::Builder> builder);
+    void jobFinished(const juce::File& audioFile, bool succeeded);
+
+    juce::SharedResourcePointer<DiskReaderService> diskReader;
+
+    // Held while the lists change
+    juce::CriticalSection lock;
+    std::map<juce::String, Entry> entries;
+    juce::StringArray pending;
+    std::atomic<int> numWaveformViews { 0 };
+
+    juce::ThreadPool buildPool { 1 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PeakCache)
+};
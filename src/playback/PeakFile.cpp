@@ -0,0 +1,243 @@
+#include "PeakFile.h"
+
+namespace
+{
+    constexpr float peakScale = 32767.0f;
+
+    juce::int16 toStored(float value)
+    {
+        return (juce::int16) juce::roundToInt(juce::jlimit(-1.0f, 1.0f, value) * peakScale);
+    }
+}
+
+juce::File PeakFile::getPeakFileFor(const juce::File& audioFile)
+{
+    return audioFile.getSiblingFile(audioFile.getFileName() + ".peaks");
+}
+
+PeakFile::Ptr PeakFile::open(const juce::File& audioFile)
+{
+    const auto peakFile = getPeakFileFor(audioFile);
+
+    if (!peakFile.existsAsFile() || !audioFile.existsAsFile())
+        return nullptr;
+
+    auto mapped = std::make_unique<juce::MemoryMappedFile>(peakFile, juce::MemoryMappedFile::readOnly);
+
+    if (mapped->getData() == nullptr || mapped->getSize() < sizeof(Header))
+        return nullptr;
+
+    Header header;
+    std::memcpy(&header, mapped->getData(), sizeof(Header));
+
+    if (std::memcmp(header.magic, magicString, sizeof(magicString)) != 0
+        || header.version != currentVersion
+        || header.decimation != (juce::uint32) baseDecimation
+        || header.numChannels == 0 || header.numChannels > 64
+        || header.numLevels == 0 || header.numLevels > 40
+        || header.lengthInSamples < 0
+        || mapped->getSize() != getFileSize(header))
+        return nullptr;
+
+    // The audio has been edited or re-recorded since
+    if (header.sourceModificationTime != audioFile.getLastModificationTime().toMilliseconds())
+        return nullptr;
+
+    return new PeakFile(std::move(mapped), header);
+}
+
+PeakFile::PeakFile(std::unique_ptr<juce::MemoryMappedFile> mappedFileToUse, const Header& fileHeader)
+    : mappedFile(std::move(mappedFileToUse)),
+      header(fileHeader)
+{
+    auto* data = reinterpret_cast<const juce::int16*>(static_cast<const char*>(mappedFile->getData()) + sizeof(Header));
+
+    for (int level = 0; level < getNumLevels(); ++level)
+    {
+        levels.push_back(data);
+        data += getNumFrames(header.lengthInSamples, level) * getNumChannels() * valuesPerPeak;
+    }
+}
+
+PeakFile::Peak PeakFile::getPeak(int channel, juce::int64 startSample, juce::int64 endSample) const
+{
+    Peak peak;
+
+    if (!juce::isPositiveAndBelow(channel, getNumChannels()) || header.lengthInSamples == 0)
+        return peak;
+
+    startSample = juce::jlimit((juce::int64) 0, header.lengthInSamples - 1, startSample);
+    endSample = juce::jlimit(startSample + 1, header.lengthInSamples, endSample);
+
+    // The coarsest level whose peaks are no longer than the range, so that
+    // it spans two or three of them whatever the zoom
+    int level = 0;
+
+    while (level + 1 < getNumLevels() && ((juce::int64) baseDecimation << (level + 1)) <= endSample - startSample)
+        ++level;
+
+    const auto decimation = (juce::int64) baseDecimation << level;
+    const auto firstFrame = startSample / decimation;
+    const auto lastFrame = (endSample - 1) / decimation;
+
+    int minValue = std::numeric_limits<juce::int16>::max();
+    int maxValue = std::numeric_limits<juce::int16>::min();
+    double sumOfSquares = 0.0;
+
+    for (auto frame = firstFrame; frame <= lastFrame; ++frame)
+    {
+        const auto* values = levels[(size_t) level] + (frame * getNumChannels() + channel) * valuesPerPeak;
+        minValue = juce::jmin(minValue, (int) values[0]);
+        maxValue = juce::jmax(maxValue, (int) values[1]);
+        sumOfSquares += (double) values[2] * values[2];
+    }
+
+    peak.min = (float) minValue / peakScale;
+    peak.max = (float) maxValue / peakScale;
+    peak.rms = (float) std::sqrt(sumOfSquares / (double) (lastFrame - firstFrame + 1)) / peakScale;
+    return peak;
+}
+
+juce::int64 PeakFile::getNumFrames(juce::int64 lengthInSamples, int level)
+{
+    const auto decimation = (juce::int64) baseDecimation << level;
+    return (lengthInSamples + decimation - 1) / decimation;
+}
+
+size_t PeakFile::getFileSize(const Header& fileHeader)
+{
+    size_t size = sizeof(Header);
+
+    for (int level = 0; level < (int) fileHeader.numLevels; ++level)
+        size += (size_t) getNumFrames(fileHeader.lengthInSamples, level) * fileHeader.numChannels * valuesPerPeak * sizeof(juce::int16);
+
+    return size;
+}
+
+PeakFile::Builder::Builder(int numChannelsToUse)
+    : numChannels(juce::jmax(1, numChannelsToUse)),
+      current((size_t) numChannels),
+      sumOfSquares((size_t) numChannels, 0.0)
+{
+}
+
+void PeakFile::Builder::addSamples(const juce::AudioBuffer<float>& buffer, int startSample, int numSamplesToAdd)
+{
+    if (buffer.getNumChannels() == 0)
+        return;
+
+    for (int done = 0; done < numSamplesToAdd;)
+    {
+        // Up to the end of the current frame
+        const int count = juce::jmin(numSamplesToAdd - done, baseDecimation - frameLength);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const float* samples = buffer.getReadPointer(juce::jmin(channel, buffer.getNumChannels() - 1), startSample + done);
+            const float minValue = juce::FloatVectorOperations::findMinimum(samples, count);
+            const float maxValue = juce::FloatVectorOperations::findMaximum(samples, count);
+            auto& peak = current[(size_t) channel];
+
+            peak.min = frameLength == 0 ? minValue : juce::jmin(peak.min, minValue);
+            peak.max = frameLength == 0 ? maxValue : juce::jmax(peak.max, maxValue);
+
+            double sum = 0.0;
+
+            for (int i = 0; i < count; ++i)
+                sum += (double) samples[i] * samples[i];
+
+            sumOfSquares[(size_t) channel] += sum;
+        }
+
+        frameLength += count;
+        numSamples += count;
+        done += count;
+
+        if (frameLength == baseDecimation)
+            finishFrame();
+    }
+}
+
+void PeakFile::Builder::finishFrame()
+{
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const auto& peak = current[(size_t) channel];
+        frames.push_back(toStored(peak.min));
+        frames.push_back(toStored(peak.max));
+        frames.push_back(toStored((float) std::sqrt(sumOfSquares[(size_t) channel] / frameLength)));
+        sumOfSquares[(size_t) channel] = 0.0;
+    }
+
+    frameLength = 0;
+}
+
+bool PeakFile::Builder::write(const juce::File& audioFile)
+{
+    if (!audioFile.existsAsFile())
+        return false;
+
+    // The last frame may be short
+    if (frameLength > 0)
+        finishFrame();
+
+    Header header;
+    std::memcpy(header.magic, magicString, sizeof(magicString));
+    header.version = currentVersion;
+    header.numChannels = (juce::uint32) numChannels;
+    header.lengthInSamples = numSamples;
+    header.sourceModificationTime = audioFile.getLastModificationTime().toMilliseconds();
+    header.decimation = (juce::uint32) baseDecimation;
+    header.numLevels = 1;
+
+    while (getNumFrames(numSamples, (int) header.numLevels - 1) > 1)
+        ++header.numLevels;
+
+    // Written beside the target and moved over it, so nobody maps half a file
+    juce::TemporaryFile temporaryFile(getPeakFileFor(audioFile));
+
+    {
+        juce::FileOutputStream output(temporaryFile.getFile());
+
+        if (!output.openedOk() || !output.write(&header, sizeof(Header)))
+            return false;
+
+        // Each level halves the one before: min of mins, max of maxes and
+        // the RMS of the pair
+        std::vector<juce::int16> level(frames), nextLevel;
+        const size_t peakSize = (size_t) numChannels * valuesPerPeak;
+
+        for (int levelIndex = 0; levelIndex < (int) header.numLevels; ++levelIndex)
+        {
+            if (!output.write(level.data(), level.size() * sizeof(juce::int16)))
+                return false;
+
+            const size_t numFrames = level.size() / peakSize;
+            nextLevel.assign((numFrames + 1) / 2 * peakSize, 0);
+
+            for (size_t frame = 0; frame < numFrames; frame += 2)
+            {
+                const auto* first = level.data() + frame * peakSize;
+                const auto* second = frame + 1 < numFrames ? first + peakSize : first;
+                auto* combined = nextLevel.data() + frame / 2 * peakSize;
+
+                for (size_t value = 0; value < peakSize; value += valuesPerPeak)
+                {
+                    const double firstRms = first[value + 2], secondRms = second[value + 2];
+                    combined[value] = juce::jmin(first[value], second[value]);
+                    combined[value + 1] = juce::jmax(first[value + 1], second[value + 1]);
+                    combined[value + 2] = (juce::int16) juce::roundToInt(std::sqrt((firstRms * firstRms + secondRms * secondRms) * 0.5));
+                }
+            }
+
+            std::swap(level, nextLevel);
+        }
+
+        output.flush();
+
+        if (output.getStatus().failed())
+            return false;
+    }
+
+    return temporaryFile.overwriteTargetFileWithTemporary();
+}
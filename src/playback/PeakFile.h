@@ -0,0 +1,104 @@
+#pragma once
+#include <JuceHeader.h>
+
+// The min, max and RMS of an audio file at power-of-two decimations, stored
+// next to it as "<file>.peaks" so that drawing its waveform at any zoom reads
+// a few peaks per pixel instead of every sample.
+//
+// The file is a small header followed by one level per decimation, from
+// baseDecimation samples per peak upwards, each holding a 16-bit min, max and
+// RMS per channel per peak. It is memory-mapped, so only the peaks that get
+// drawn are read. Peaks are stamped with the audio file's modification time
+// and ignored once it changes.
+class PeakFile : public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<PeakFile>;
+
+    // Samples per peak at the finest level
+    static constexpr int baseDecimation = 64;
+
+    struct Peak
+    {
+        float min = 0.0f;
+        float max = 0.0f;
+        float rms = 0.0f;
+    };
+
+    static juce::File getPeakFileFor(const juce::File& audioFile);
+
+    // Maps the audio file's peaks. Returns nullptr if there are none, or
+    // they're damaged or out of date.
+    static Ptr open(const juce::File& audioFile);
+
+    int getNumChannels() const { return (int) header.numChannels; }
+    juce::int64 getLengthInSamples() const { return header.lengthInSamples; }
+    juce::int64 getSourceModificationTime() const { return header.sourceModificationTime; }
+    int getNumLevels() const { return (int) header.numLevels; }
+
+    // The peak of a range of the audio's samples, from the coarsest level
+    // that still has a peak or two across it
+    Peak getPeak(int channel, juce::int64 startSample, juce::int64 endSample) const;
+
+    // Works out peaks from audio as it goes, then writes the file. Any
+    // thread, but one at a time.
+    class Builder
+    {
+    public:
+        explicit Builder(int numChannels);
+
+        void addSamples(const juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+        juce::int64 getNumSamples() const { return numSamples; }
+
+        // Writes the audio file's peaks, stamped with its modification time,
+        // so the audio must be complete by now
+        bool write(const juce::File& audioFile);
+
+    private:
+        void finishFrame();
+
+        const int numChannels;
+        juce::int64 numSamples = 0;
+
+        // The frame being summed, per channel
+        int frameLength = 0;
+        std::vector<Peak> current;
+        std::vector<double> sumOfSquares;
+
+        // The finest level so far, stored as it will be written
+        std::vector<juce::int16> frames;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Builder)
+    };
+
+private:
+    struct Header
+    {
+        char magic[8];
+        juce::uint32 version;
+        juce::uint32 numChannels;
+        juce::int64 lengthInSamples;
+        juce::int64 sourceModificationTime;
+        juce::uint32 decimation;
+        juce::uint32 numLevels;
+    };
+
+    static_assert(sizeof(Header) == 40, "The header is written as it is laid out in memory");
+
+    static constexpr char magicString[8] = { 'D', 'A', 'W', 'P', 'E', 'A', 'K', 'S' };
+    static constexpr juce::uint32 currentVersion = 1;
+    static constexpr int valuesPerPeak = 3;
+
+    static juce::int64 getNumFrames(juce::int64 lengthInSamples, int level);
+    static size_t getFileSize(const Header& header);
+
+    PeakFile(std::unique_ptr<juce::MemoryMappedFile> mappedFile, const Header& header);
+
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    const Header header;
+
+    // Where each level starts in the mapped file
+    std::vector<const juce::int16*> levels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PeakFile)
+};
@@ -0,0 +1,195 @@
+#include "SamplePool.h"
+
+SamplePool::Sample::Sample(juce::AudioBuffer<float>&& audioToUse, double rate)
+    : audio(std::move(audioToUse)),
+      sampleRate(rate)
+{
+}
+
+size_t SamplePool::Sample::getSizeInBytes() const
+{
+    return (size_t) audio.getNumChannels() * (size_t) audio.getNumSamples() * sizeof(float);
+}
+
+SamplePool::SamplePool() = default;
+
+SamplePool::Sample::Ptr SamplePool::getSample(const juce::File& file)
+{
+    const auto key = makeKey(file);
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        if (auto* entry = findEntry(key))
+        {
+            ++stats.hits;
+            return entry->sample;
+        }
+    }
+
+    auto reader = diskReader->createReaderFor(file);
+
+    if (reader == nullptr || reader->lengthInSamples <= 0)
+        return nullptr;
+
+    const int numChannels = juce::jmax(1, (int) reader->numChannels);
+    const auto numBytes = (juce::uint64) reader->lengthInSamples * (juce::uint64) numChannels * sizeof(float);
+
+    // An AudioBuffer can't hold more than an int's worth of samples either
+    if (numBytes > getMaxSampleBytes() || reader->lengthInSamples > std::numeric_limits<int>::max()
+        || !reserve((size_t) numBytes))
+    {
+        const juce::ScopedLock sl(lock);
+        ++stats.streamed;
+        return nullptr;
+    }
+
+    // Read without the lock, so that other files' clips needn't wait for it
+    const int length = (int) reader->lengthInSamples;
+    juce::AudioBuffer<float> audio(numChannels, length);
+    reader->read(&audio, 0, length, 0, true, true);
+    Sample::Ptr sample = new Sample(std::move(audio), reader->sampleRate);
+
+    const juce::ScopedLock sl(lock);
+    bytesReserved -= (size_t) numBytes;
+    ++stats.misses;
+
+    // Another thread may have read it meanwhile
+    if (auto* entry = findEntry(key))
+        return entry->sample;
+
+    return addEntry(key, sample);
+}
+
+void SamplePool::addSample(const juce::File& file, juce::AudioBuffer<float>&& audio, double sampleRate)
+{
+    const auto key = makeKey(file);
+    Sample::Ptr sample = new Sample(std::move(audio), sampleRate);
+
+    const juce::ScopedLock sl(lock);
+
+    if (findEntry(key) != nullptr)
+        return;
+
+    if (sample->getSizeInBytes() > memoryBudget / 4 || !makeRoomFor(sample->getSizeInBytes()))
+        return;
+
+    addEntry(key, sample);
+}
+
+void SamplePool::setMemoryBudget(size_t bytes)
+{
+    const juce::ScopedLock sl(lock);
+    memoryBudget = bytes;
+    makeRoomFor(0);
+}
+
+size_t SamplePool::getMemoryBudget() const
+{
+    const juce::ScopedLock sl(lock);
+    return memoryBudget;
+}
+
+bool SamplePool::reserve(size_t bytes)
+{
+    const juce::ScopedLock sl(lock);
+
+    if (!makeRoomFor(bytes))
+        return false;
+
+    bytesReserved += bytes;
+    return true;
+}
+
+void SamplePool::release(size_t bytes)
+{
+    const juce::ScopedLock sl(lock);
+    jassert(bytes <= bytesReserved);
+    bytesReserved -= juce::jmin(bytes, bytesReserved);
+}
+
+SamplePool::Stats SamplePool::getStats() const
+{
+    const juce::ScopedLock sl(lock);
+
+    auto current = stats;
+    current.bytesHeld = bytesHeld;
+    current.bytesReserved = bytesReserved;
+    current.numSamples = (int) entries.size();
+    return current;
+}
+
+void SamplePool::resetStats()
+{
+    const juce::ScopedLock sl(lock);
+    stats = {};
+}
+
+void SamplePool::purgeUnused()
+{
+    const juce::ScopedLock sl(lock);
+
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (it->sample->getReferenceCount() == 1)
+        {
+            bytesHeld -= it->sample->getSizeInBytes();
+            it = entries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+juce::String SamplePool::makeKey(const juce::File& file)
+{
+    // An edited file gets a new key, so it is read afresh
+    return file.getFullPathName() + "|" + juce::String(file.getLastModificationTime().toMilliseconds());
+}
+
+SamplePool::Entry* SamplePool::findEntry(const juce::String& key)
+{
+    for (auto& entry : entries)
+    {
+        if (entry.key == key)
+        {
+            entry.lastUsed = ++useCounter;
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+bool SamplePool::makeRoomFor(size_t numBytes)
+{
+    while (bytesHeld + bytesReserved + numBytes > memoryBudget)
+    {
+        // Only the pool refers to a sample nobody is using
+        auto victim = entries.end();
+
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->sample->getReferenceCount() == 1 && (victim == entries.end() || it->lastUsed < victim->lastUsed))
+                victim = it;
+        }
+
+        if (victim == entries.end())
+            return false;
+
+        bytesHeld -= victim->sample->getSizeInBytes();
+        entries.erase(victim);
+        ++stats.evictions;
+    }
+
+    return true;
+}
+
+SamplePool::Sample::Ptr SamplePool::addEntry(const juce::String& key, Sample::Ptr sample)
+{
+    entries.push_back({ key, sample, ++useCounter });
+    bytesHeld += sample->getSizeInBytes();
+    return sample;
+}
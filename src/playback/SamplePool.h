@@ -0,0 +1,106 @@
+#pragma once
+#include <JuceHeader.h>
+#include "DiskReaderService.h"
+
+// Decoded audio files, shared by every clip in the process: a loop used by
+// forty clips is read and held in memory once. Use it through
+// juce::SharedResourcePointer<SamplePool>.
+//
+// Samples are kept per file and modification time, so an edited file is
+// read afresh. The pool holds them within a memory budget, dropping the least
+// recently used sample nothing else refers to when it needs the room. Files
+// too big for the budget aren't pooled; their clips stream from disk instead.
+class SamplePool
+{
+public:
+    class Sample : public juce::ReferenceCountedObject
+    {
+    public:
+        using Ptr = juce::ReferenceCountedObjectPtr<Sample>;
+
+        Sample(juce::AudioBuffer<float>&& audio, double sampleRate);
+
+        const juce::AudioBuffer<float>& getAudio() const { return audio; }
+        double getSampleRate() const { return sampleRate; }
+        size_t getSizeInBytes() const;
+
+    private:
+        const juce::AudioBuffer<float> audio;
+        const double sampleRate;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Sample)
+    };
+
+    SamplePool();
+
+    static constexpr size_t defaultMemoryBudget = (size_t) 512 * 1024 * 1024;
+
+    // Returns the file's audio, reading it if it isn't pooled, or nullptr if
+    // it can't be read or doesn't fit the budget, in which case it should be
+    // streamed. Reading is slow, so call this from the message thread or a
+    // background thread.
+    Sample::Ptr getSample(const juce::File& file);
+
+    // Pools audio that is already in memory, such as a recording just
+    // written to the file, so that it needn't be read back. The file must be
+    // complete, as its modification time is part of the key.
+    void addSample(const juce::File& file, juce::AudioBuffer<float>&& audio, double sampleRate);
+
+    // Samples in use are never dropped, but count towards the budget. A
+    // single sample may take up to a quarter of it.
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const;
+    size_t getMaxSampleBytes() const { return getMemoryBudget() / 4; }
+
+    // Sets memory aside within the budget for audio on its way into the
+    // pool, such as a file being read or a recording's copy of itself.
+    // Returns false if it can't be made to fit.
+    bool reserve(size_t bytes);
+    void release(size_t bytes);
+
+    struct Stats
+    {
+        juce::uint64 hits = 0;
+        juce::uint64 misses = 0;        // read from disk
+        juce::uint64 evictions = 0;
+        juce::uint64 streamed = 0;      // too big to pool
+        size_t bytesHeld = 0;
+        size_t bytesReserved = 0;
+        int numSamples = 0;
+    };
+
+    Stats getStats() const;
+    void resetStats();
+    void purgeUnused();
+
+private:
+    struct Entry
+    {
+        juce::String key;
+        Sample::Ptr sample;
+        juce::uint64 lastUsed = 0;
+    };
+
+    static juce::String makeKey(const juce::File& file);
+
+    // Under the lock: the key's entry, marked as just used, or nullptr
+    Entry* findEntry(const juce::String& key);
+
+    // Under the lock: drops unused samples, least recently used first, until
+    // the extra bytes fit. Returns false if they can't.
+    bool makeRoomFor(size_t numBytes);
+    Sample::Ptr addEntry(const juce::String& key, Sample::Ptr sample);
+
+    juce::SharedResourcePointer<DiskReaderService> diskReader;
+
+    // Not held while files are read
+    juce::CriticalSection lock;
+    std::vector<Entry> entries;
+    size_t memoryBudget = defaultMemoryBudget;
+    size_t bytesHeld = 0;
+    size_t bytesReserved = 0;
+    juce::uint64 useCounter = 0;
+    Stats stats;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplePool)
+};
@@ -0,0 +1,360 @@
+#include "DiskWriterService.h"
+
+namespace
+{
+    // How long an I/O thread with nothing to write waits before looking again
+    constexpr int pollIntervalMs = 5;
+}
+
+DiskWriterService::Stream::Stream(std::unique_ptr<juce::AudioFormatWriter> writerToUse, int bufferSize, bool shouldDither,
+                                  bool keepForPool, bool buildPeaks)
+    : writer(std::move(writerToUse)),
+      fifo(bufferSize),
+      convertToInt(!writer->isFloatingPoint()),
+      dither(shouldDither)
+{
+    const int numChannels = juce::jmax(1, (int) writer->getNumChannels());
+    ring.setSize(numChannels, bufferSize);
+
+    // Anything longer wouldn't be pooled anyway
+    if (keepForPool)
+        maxSamplesToKeep = (int) juce::jmin(samplePool->getMaxSampleBytes() / ((size_t) numChannels * sizeof(float)),
+                                            (size_t) std::numeric_limits<int>::max());
+
+    if (buildPeaks)
+        peaks = std::make_unique<PeakFile::Builder>(numChannels);
+
+    if (convertToInt)
+    {
+        converted.allocate((size_t) (numChannels * chunkSize), true);
+
+        // AudioFormatWriter::write() takes a null-terminated list of channels
+        for (int channel = 0; channel < numChannels; ++channel)
+            convertedChannels.push_back(converted + channel * chunkSize);
+
+        convertedChannels.push_back(nullptr);
+
+        if (dither)
+        {
+            noise.allocate((size_t) chunkSize, true);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                ditherGenerators.emplace_back((juce::uint32) (channel + 1) * 0x9e3779b9u);
+        }
+    }
+}
+
+void DiskWriterService::Stream::write(const juce::AudioBuffer<float>& buffer, int numSamples)
+{
+    if (fifo.getFreeSpace() < numSamples)
+    {
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        droppedSamples.fetch_add((juce::uint64) numSamples, std::memory_order_relaxed);
+        return;
+    }
+
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+    for (int channel = 0; channel < ring.getNumChannels(); ++channel)
+    {
+        if (channel < buffer.getNumChannels())
+        {
+            ring.copyFrom(channel, start1, buffer, channel, 0, size1);
+
+            if (size2 > 0)
+                ring.copyFrom(channel, start2, buffer, channel, size1, size2);
+        }
+        else
+        {
+            ring.clear(channel, start1, size1);
+
+            if (size2 > 0)
+                ring.clear(channel, start2, size2);
+        }
+    }
+
+    fifo.finishedWrite(size1 + size2);
+}
+
+bool DiskWriterService::Stream::drain(bool flushing)
+{
+    const int numReady = fifo.getNumReady();
+
+    if (numReady == 0 || (numReady < chunkSize && !flushing))
+        return false;
+
+    // Whole chunks start at a multiple of the chunk size and never wrap
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(juce::jmin(numReady, chunkSize), start1, size1, start2, size2);
+
+    for (const auto& [start, size] : { std::pair(start1, size1), std::pair(start2, size2) })
+    {
+        if (size == 0)
+            continue;
+
+        if (writeToFile(start, size))
+        {
+            samplesWritten.fetch_add((juce::uint64) size, std::memory_order_relaxed);
+            keepCopy(start, size);
+
+            if (peaks != nullptr)
+                peaks->addSamples(ring, start, size);
+        }
+        else
+            droppedSamples.fetch_add((juce::uint64) size, std::memory_order_relaxed);
+    }
+
+    fifo.finishedRead(size1 + size2);
+    return true;
+}
+
+bool DiskWriterService::Stream::writeToFile(int start, int numSamples)
+{
+    jassert(numSamples <= chunkSize);
+
+    // A float file takes the samples as they are
+    if (!convertToInt)
+        return writer->writeFromAudioSampleBuffer(ring, start, numSamples);
+
+    const int bitDepth = juce::jmin(24, (int) writer->getBitsPerSample());
+
+    for (int channel = 0; channel < ring.getNumChannels(); ++channel)
+    {
+        if (dither)
+            ditherGenerators[(size_t) channel].generate(noise, numSamples);
+
+        SampleConversion::floatToInt(converted + channel * chunkSize, ring.getReadPointer(channel, start),
+                                     dither ? noise.get() : nullptr, numSamples, bitDepth);
+    }
+
+    return writer->write(convertedChannels.data(), numSamples);
+}
+
+void DiskWriterService::Stream::keepCopy(int start, int numSamples)
+{
+    if (numKept < 0)
+        return;
+
+    // Too long to keep: give up on the copy rather than hold half of it
+    if (numKept + numSamples > maxSamplesToKeep)
+    {
+        releaseKeptAudio();
+        numKept = -1;
+        return;
+    }
+
+    for (int done = 0; done < numSamples;)
+    {
+        const int offset = numKept % keptBlockSize;
+
+        if (offset == 0)
+        {
+            const auto blockBytes = (size_t) ring.getNumChannels() * keptBlockSize * sizeof(float);
+
+            if (!samplePool->reserve(blockBytes))
+            {
+                releaseKeptAudio();
+                numKept = -1;
+                return;
+            }
+
+            bytesReserved += blockBytes;
+            kept.add(new juce::AudioBuffer<float>(ring.getNumChannels(), keptBlockSize));
+        }
+
+        const int count = juce::jmin(numSamples - done, keptBlockSize - offset);
+        auto& block = *kept.getLast();
+
+        for (int channel = 0; channel < ring.getNumChannels(); ++channel)
+        {
+            // What an integer file holds is the converted samples, not the
+            // float ones they came from
+            if (convertToInt)
+                juce::FloatVectorOperations::convertFixedToFloat(block.getWritePointer(channel, offset),
+                                                                 converted + channel * chunkSize + done,
+                                                                 1.0f / (float) 0x80000000u, count);
+            else
+                block.copyFrom(channel, offset, ring, channel, start + done, count);
+        }
+
+        numKept += count;
+        done += count;
+    }
+}
+
+void DiskWriterService::Stream::releaseKeptAudio()
+{
+    kept.clear();
+    samplePool->release(bytesReserved);
+    bytesReserved = 0;
+}
+
+juce::AudioBuffer<float> DiskWriterService::Stream::takeKeptAudio()
+{
+    juce::AudioBuffer<float> audio;
+
+    if (numKept > 0)
+    {
+        audio.setSize(ring.getNumChannels(), numKept);
+
+        // Each block goes as soon as it's copied, so the two copies never
+        // both exist in full
+        for (int position = 0; !kept.isEmpty(); position += keptBlockSize)
+        {
+            const int count = juce::jmin(keptBlockSize, numKept - position);
+
+            for (int channel = 0; channel < audio.getNumChannels(); ++channel)
+                audio.copyFrom(channel, position, *kept.getFirst(), channel, 0, count);
+
+            kept.remove(0);
+        }
+    }
+
+    releaseKeptAudio();
+    numKept = 0;
+    return audio;
+}
+
+DiskWriterService::Stream::~Stream()
+{
+    releaseKeptAudio();
+}
+
+DiskWriterService::Worker::Worker(DiskWriterService& service)
+    : juce::Thread("Disk Writer"),
+      owner(service)
+{
+}
+
+DiskWriterService::Worker::~Worker()
+{
+    stopThread(2000);
+}
+
+void DiskWriterService::Worker::run()
+{
+    while (!threadShouldExit())
+    {
+        if (!owner.writeNextChunk())
+            wait(pollIntervalMs);
+    }
+}
+
+DiskWriterService::DiskWriterService() = default;
+
+DiskWriterService::~DiskWriterService()
+{
+    stopWorkers();
+
+    // Recorders close their streams when they stop; whatever is left is
+    // still written out rather than lost
+    jassert(streams.empty());
+
+    for (auto& stream : std::vector<std::shared_ptr<Stream>>(streams))
+        closeStream(stream);
+}
+
+std::shared_ptr<DiskWriterService::Stream> DiskWriterService::openStream(std::unique_ptr<juce::AudioFormatWriter> writer, bool dither,
+                                                                        bool keepForPool, bool buildPeaks)
+{
+    jassert(writer != nullptr);
+
+    // Enough whole chunks for bufferSeconds, and at least two so that one can
+    // fill while the other is written
+    const int numChunks = juce::jmax(2, (int) std::ceil(bufferSeconds * writer->getSampleRate() / chunkSize));
+    std::shared_ptr<Stream> stream(new Stream(std::move(writer), numChunks * chunkSize, dither, keepForPool, buildPeaks));
+
+    {
+        const juce::ScopedLock sl(lock);
+        streams.push_back(stream);
+    }
+
+    if (workers.isEmpty())
+        startWorkers();
+
+    return stream;
+}
+
+void DiskWriterService::closeStream(const std::shared_ptr<Stream>& stream)
+{
+    if (stream == nullptr)
+        return;
+
+    {
+        const juce::ScopedLock sl(lock);
+        streams.erase(std::remove(streams.begin(), streams.end(), stream), streams.end());
+    }
+
+    // An I/O thread may be halfway through writing a chunk of it
+    while (stream->busy.exchange(true))
+        juce::Thread::sleep(1);
+
+    while (stream->drain(true))
+    {
+    }
+
+    // Deleting the writer finishes the file
+    stream->writer.reset();
+}
+
+void DiskWriterService::setNumThreads(int newNumThreads)
+{
+    // Not under the lock: a stopping worker may be waiting for it
+    numThreads = juce::jlimit(1, 16, newNumThreads);
+
+    if (!workers.isEmpty())
+    {
+        stopWorkers();
+        startWorkers();
+    }
+}
+
+int DiskWriterService::getNumStreams() const
+{
+    const juce::ScopedLock sl(lock);
+    return (int) streams.size();
+}
+
+bool DiskWriterService::writeNextChunk()
+{
+    std::shared_ptr<Stream> stream;
+
+    {
+        const juce::ScopedLock sl(lock);
+
+        // Round robin, so one busy stream can't starve the others
+        for (size_t i = 0; i < streams.size() && stream == nullptr; ++i)
+        {
+            const size_t index = (nextStream + i) % streams.size();
+            auto& candidate = streams[index];
+
+            if (candidate->fifo.getNumReady() >= chunkSize && !candidate->busy.exchange(true))
+            {
+                stream = candidate;
+                nextStream = index + 1;
+            }
+        }
+    }
+
+    if (stream == nullptr)
+        return false;
+
+    stream->drain(false);
+    stream->busy = false;
+    return true;
+}
+
+void DiskWriterService::startWorkers()
+{
+    for (int i = 0; i < numThreads; ++i)
+        workers.add(new Worker(*this))->startThread(juce::Thread::Priority::high);
+}
+
+void DiskWriterService::stopWorkers()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    workers.clear();
+}
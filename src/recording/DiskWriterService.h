@@ -0,0 +1,152 @@
+#pragma once
+#include <JuceHeader.h>
+#include "SampleConversion.h"
+#include "../playback/PeakFile.h"
+#include "../playback/SamplePool.h"
+
+// Writes every recording in the process to disk from one small pool of I/O
+// threads. Use it through juce::SharedResourcePointer<DiskWriterService>.
+//
+// Each recording is a Stream: the audio thread pushes its blocks into a
+// preallocated lock-free FIFO and never waits, and the I/O threads drain the
+// FIFOs in large chunks, so a file grows a few hundred kilobytes at a time
+// rather than a block at a time. The FIFO holds a whole number of chunks, so
+// each chunk is written straight out of it in one piece. A stream whose FIFO
+// is full drops the block and counts it instead of blocking the audio thread.
+//
+// The FIFO holds floats. Converting and dithering to a 16- or 24-bit file's
+// integers happens on the I/O threads, a chunk at a time.
+//
+// A stream can also keep a copy of what it wrote, as the file will read
+// back, so that a recording can be played without reading it again, and
+// work out its waveform peaks as it goes, so they're ready when it stops.
+// The copy's memory comes out of the SamplePool's budget as it grows, and
+// the copy is dropped once the pool can't spare any more.
+class DiskWriterService
+{
+public:
+    DiskWriterService();
+    ~DiskWriterService();
+
+    // Frames per write; every write but a recording's last is this long
+    static constexpr int chunkSize = 16384;
+
+    // How much audio a stream can hold while the disk is busy
+    static constexpr double bufferSeconds = 1.0;
+
+    class Stream
+    {
+    public:
+        ~Stream();
+
+        // Audio thread. Blocks that don't fit are dropped and counted;
+        // missing channels are written as silence.
+        void write(const juce::AudioBuffer<float>& buffer, int numSamples);
+
+        // Safe to call from any thread
+        int getNumChannels() const { return ring.getNumChannels(); }
+        juce::uint64 getNumOverflows() const { return overflows.load(); }
+        juce::uint64 getNumDroppedSamples() const { return droppedSamples.load(); }
+        juce::uint64 getNumSamplesWritten() const { return samplesWritten.load(); }
+
+        // Message thread, once the stream is closed: the copy of what was
+        // written, or an empty buffer if there was more than it could keep.
+        // Its memory is no longer reserved from the pool once it's taken.
+        juce::AudioBuffer<float> takeKeptAudio();
+
+        // Message thread, once the stream is closed: the peaks of what was
+        // written, if it was asked for them
+        std::unique_ptr<PeakFile::Builder> takePeaks() { return std::move(peaks); }
+
+    private:
+        friend class DiskWriterService;
+
+        Stream(std::unique_ptr<juce::AudioFormatWriter> writer, int bufferSize, bool dither, bool keepForPool,
+               bool buildPeaks);
+
+        // I/O thread: writes up to one chunk, or nothing if less than a whole
+        // chunk is ready and flushing is false. Returns true if it wrote.
+        bool drain(bool flushing);
+        bool writeToFile(int start, int numSamples);
+        void keepCopy(int start, int numSamples);
+        void releaseKeptAudio();
+
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+        juce::AbstractFifo fifo;
+        juce::AudioBuffer<float> ring;
+
+        // I/O thread: what an integer file's samples are converted into, a
+        // chunk per channel, and the dither added on the way
+        const bool convertToInt;
+        const bool dither;
+        juce::HeapBlock<int> converted;
+        std::vector<const int*> convertedChannels;
+        juce::HeapBlock<float> noise;
+        std::vector<SampleConversion::Dither> ditherGenerators;
+
+        // I/O thread: the copy of what was written, in blocks, so that
+        // growing it never moves what is already kept. numKept is -1 once
+        // the copy has been given up.
+        static constexpr int keptBlockSize = 8 * chunkSize;
+        juce::SharedResourcePointer<SamplePool> samplePool;
+        int maxSamplesToKeep = 0;
+        juce::OwnedArray<juce::AudioBuffer<float>> kept;
+        int numKept = 0;
+        size_t bytesReserved = 0;
+
+        // I/O thread
+        std::unique_ptr<PeakFile::Builder> peaks;
+
+        // Held by whichever thread is writing the stream to disk
+        std::atomic<bool> busy { false };
+
+        std::atomic<juce::uint64> overflows { 0 }, droppedSamples { 0 }, samplesWritten { 0 };
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Stream)
+    };
+
+    // Message thread. The stream owns the writer from now on, and writes as
+    // many channels as it has. Dither only applies to integer formats. A
+    // recording small enough to be pooled can also be kept in memory.
+    std::shared_ptr<Stream> openStream(std::unique_ptr<juce::AudioFormatWriter> writer, bool dither = true,
+                                       bool keepForPool = false, bool buildPeaks = false);
+
+    // Message thread: writes whatever the stream still holds and closes its
+    // file. Nothing may write to the stream once this has been called.
+    void closeStream(const std::shared_ptr<Stream>& stream);
+
+    // The I/O threads are started when the first stream is opened. Changing
+    // their number restarts them; recordings carry on meanwhile.
+    void setNumThreads(int numThreads);
+    int getNumThreads() const { return numThreads; }
+    int getNumStreams() const;
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        explicit Worker(DiskWriterService& service);
+        ~Worker() override;
+
+        void run() override;
+
+    private:
+        DiskWriterService& owner;
+    };
+
+    // I/O thread: writes one chunk of some stream that has one ready.
+    // Returns false if none had.
+    bool writeNextChunk();
+    void startWorkers();
+    void stopWorkers();
+
+    // Held while the list of streams changes
+    juce::CriticalSection lock;
+    std::vector<std::shared_ptr<Stream>> streams;
+    size_t nextStream = 0;
+
+    juce::OwnedArray<Worker> workers;
+    int numThreads = 2;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DiskWriterService)
+};
@@ -1,9 +1,8 @@
 #include "Recorder.h"
 
 Recorder::Recorder()
-    : writerThread("Audio Writer Thread")
 {
-    writerThread.startThread();
+    capture.publish(std::make_unique<Capture>());
 }
 
 Recorder::~Recorder()
@@ -11,37 +10,95 @@ Recorder::~Recorder()
     stopRecording();
 }
 
-void Recorder::startRecording(const juce::File& file)
+int Recorder::Format::getBitsPerSample() const
+{
+    switch (sampleFormat)
+    {
+        case SampleFormat::Int16:   return 16;
+        case SampleFormat::Int24:   return 24;
+        case SampleFormat::Float32: return 32;
+    }
+
+    return 32;
+}
+
+void Recorder::startRecording(const juce::File& file, const Format& format)
 {
     if (recording)
         stopRecording();
 
     outputFile = file;
+    currentFormat = format;
+    currentFormat.numChannels = juce::jlimit(1, 64, format.numChannels);
     
+    // A 32-bit WAV is written as float
     juce::WavAudioFormat wavFormat;
     std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(
-        new juce::FileOutputStream(outputFile), sampleRate, 2, 16, {}, 0));
+        new juce::FileOutputStream(outputFile), sampleRate, (unsigned int) currentFormat.numChannels,
+        currentFormat.getBitsPerSample(), {}, 0));
     
     if (writer)
     {
-        threadedWriter.reset(new juce::AudioFormatWriter::ThreadedWriter(writer.release(), writerThread, 32768));
+        stream = diskWriter->openStream(std::move(writer), currentFormat.dither, true, peakCache->hasWaveformViews());
+
+        auto next = std::make_unique<Capture>();
+        next->stream = stream;
+        capture.publish(std::move(next));
         recording = true;
     }
 }
 
 void Recorder::stopRecording()
 {
-    if (recording)
+    if (!recording)
+        return;
+
+    recording = false;
+    capture.publish(std::make_unique<Capture>());
+
+    // Once the audio thread has let go of the old capture nothing more can be
+    // written to the stream, and it can be closed
+    const auto deadline = juce::Time::getMillisecondCounter() + 1000;
+
+    for (;;)
     {
-        threadedWriter.reset();
-        recording = false;
+        releasePool->collectNow();
+
+        if (capture.getNumRetired() == 0 || juce::Time::getMillisecondCounter() > deadline)
+            break;
+
+        juce::Thread::sleep(1);
     }
+
+    diskWriter->closeStream(stream);
+
+    auto recorded = stream->takeKeptAudio();
+
+    if (recorded.getNumSamples() > 0)
+        samplePool->addSample(outputFile, std::move(recorded), sampleRate);
+
+    if (auto peaks = stream->takePeaks())
+        peakCache->addPeaks(outputFile, std::move(peaks));
 }
 
 void Recorder::addAudioBlock(const juce::AudioBuffer<float>& buffer, int numSamples)
 {
-    if (recording && threadedWriter)
+    const RealtimeSnapshot<Capture>::ReadScope scope(capture);
+
+    if (auto* current = scope.get(); current != nullptr && current->stream != nullptr)
+        current->stream->write(buffer, numSamples);
+}
+
+Recorder::Stats Recorder::getStats() const
+{
+    Stats stats;
+
+    if (stream != nullptr)
     {
-        threadedWriter->write(buffer.getArrayOfReadPointers(), numSamples);
+        stats.overflows = stream->getNumOverflows();
+        stats.droppedSamples = stream->getNumDroppedSamples();
+        stats.samplesWritten = stream->getNumSamplesWritten();
     }
+
+    return stats;
 }
@@ -1,24 +1,79 @@
 #pragma once
 #include <JuceHeader.h>
+#include "DiskWriterService.h"
+#include "../audio/RealtimeSnapshot.h"
+#include "../playback/SamplePool.h"
+#include "../playback/PeakCache.h"
 
+// Records a track's output to a file. The audio is handed to the process-wide
+// DiskWriterService, so an idle recorder costs no thread and no buffer. A
+// recording small enough for the SamplePool is handed to it when it stops,
+// ready to play without being read back from disk. While the PeakCache has
+// waveforms to show, its peaks are worked out as it records.
 class Recorder
 {
 public:
     Recorder();
     ~Recorder();
 
-    void startRecording(const juce::File& file);
+    // What a recording is written as. 32-bit float keeps all the headroom
+    // of the mix; integer formats are dithered unless told otherwise.
+    struct Format
+    {
+        enum class SampleFormat
+        {
+            Int16,
+            Int24,
+            Float32
+        };
+
+        SampleFormat sampleFormat = SampleFormat::Float32;
+        int numChannels = 2;
+        bool dither = true;
+
+        int getBitsPerSample() const;
+    };
+
+    // Message thread. Stopping returns once the file is complete.
+    void startRecording(const juce::File& file) { startRecording(file, Format()); }
+    void startRecording(const juce::File& file, const Format& format);
     void stopRecording();
-    bool isRecording() const { return recording; }
+    bool isRecording() const { return recording.load(); }
+    void setSampleRate(double rate) { sampleRate = rate; }
 
+    // Audio thread
     void addAudioBlock(const juce::AudioBuffer<float>& buffer, int numSamples);
-    void setSampleRate(double rate) { sampleRate = rate; }
+
+    // Message thread: how the current or most recent recording went. Blocks
+    // the disk couldn't keep up with are dropped and counted here.
+    struct Stats
+    {
+        juce::uint64 overflows = 0;
+        juce::uint64 droppedSamples = 0;
+        juce::uint64 samplesWritten = 0;
+    };
+
+    Stats getStats() const;
+    const Format& getFormat() const { return currentFormat; }
 
 private:
-    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> threadedWriter;
-    juce::TimeSliceThread writerThread;
+    // What the audio thread writes to, swapped as a whole on start and stop
+    struct Capture
+    {
+        std::shared_ptr<DiskWriterService::Stream> stream;
+    };
+
+    juce::SharedResourcePointer<DiskWriterService> diskWriter;
+    juce::SharedResourcePointer<DeferredReleasePool> releasePool;
+    juce::SharedResourcePointer<SamplePool> samplePool;
+    juce::SharedResourcePointer<PeakCache> peakCache;
+    RealtimeSnapshot<Capture> capture;
+
+    // Kept after stopping, for its stats
+    std::shared_ptr<DiskWriterService::Stream> stream;
     juce::File outputFile;
-    bool recording = false;
+    Format currentFormat;
+    std::atomic<bool> recording { false };
     double sampleRate = 44100.0;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Recorder)
@@ -0,0 +1,145 @@
+#include "SampleConversion.h"
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+#elif JUCE_ARM && (defined(__aarch64__) || defined(_M_ARM64))
+ // Rounding to nearest in one instruction needs AArch64
+ #include <arm_neon.h>
+ #define SAMPLE_CONVERSION_NEON 1
+#endif
+
+namespace
+{
+    struct Range
+    {
+        explicit Range(int bitDepth)
+            : scale((float) (1 << (bitDepth - 1))),
+              maximum(scale - 1.0f),
+              shift(32 - bitDepth)
+        {
+        }
+
+        const float scale;      // full scale, in LSBs
+        const float maximum;    // the largest positive code
+        const int shift;        // to left-justify in 32 bits
+    };
+
+    // Rounds to nearest even, like the vector conversions
+    void floatToIntScalar(int* dest, const float* src, const float* noise, int numSamples, const Range& range)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float value = src[i] * range.scale;
+
+            if (noise != nullptr)
+                value += noise[i];
+
+            value = juce::jlimit(-range.scale, range.maximum, value);
+            dest[i] = (int) ((juce::uint32) (int) std::nearbyint(value) << range.shift);
+        }
+    }
+
+   #if JUCE_INTEL
+    void floatToIntSSE(int* dest, const float* src, const float* noise, int numSamples, const Range& range)
+    {
+        const __m128 scale = _mm_set1_ps(range.scale);
+        const __m128 minimum = _mm_set1_ps(-range.scale);
+        const __m128 maximum = _mm_set1_ps(range.maximum);
+        const __m128i shift = _mm_cvtsi32_si128(range.shift);
+
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            __m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+
+            if (noise != nullptr)
+                value = _mm_add_ps(value, _mm_loadu_ps(noise + i));
+
+            value = _mm_min_ps(_mm_max_ps(value, minimum), maximum);
+            _mm_storeu_si128((__m128i*) (dest + i), _mm_sll_epi32(_mm_cvtps_epi32(value), shift));
+        }
+
+        floatToIntScalar(dest + i, src + i, noise != nullptr ? noise + i : nullptr, numSamples - i, range);
+    }
+   #endif
+
+   #if SAMPLE_CONVERSION_NEON
+    void floatToIntNEON(int* dest, const float* src, const float* noise, int numSamples, const Range& range)
+    {
+        const float32x4_t minimum = vdupq_n_f32(-range.scale);
+        const float32x4_t maximum = vdupq_n_f32(range.maximum);
+        const int32x4_t shift = vdupq_n_s32(range.shift);
+
+        int i = 0;
+
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            float32x4_t value = vmulq_n_f32(vld1q_f32(src + i), range.scale);
+
+            if (noise != nullptr)
+                value = vaddq_f32(value, vld1q_f32(noise + i));
+
+            value = vminq_f32(vmaxq_f32(value, minimum), maximum);
+            vst1q_s32(dest + i, vshlq_s32(vcvtnq_s32_f32(value), shift));
+        }
+
+        floatToIntScalar(dest + i, src + i, noise != nullptr ? noise + i : nullptr, numSamples - i, range);
+    }
+   #endif
+
+    struct Kernel
+    {
+        void (*floatToInt)(int*, const float*, const float*, int, const Range&);
+        const char* name;
+    };
+
+    Kernel selectKernel()
+    {
+       #if JUCE_INTEL
+        if (juce::SystemStats::hasSSE2())
+            return { floatToIntSSE, "SSE2" };
+       #elif SAMPLE_CONVERSION_NEON
+        return { floatToIntNEON, "NEON" };
+       #endif
+
+        return { floatToIntScalar, "Scalar" };
+    }
+
+    const Kernel& getKernel()
+    {
+        static const Kernel kernel = selectKernel();
+        return kernel;
+    }
+}
+
+namespace SampleConversion
+{
+    void floatToInt(int* dest, const float* src, const float* noise, int numSamples, int bitDepth)
+    {
+        jassert(bitDepth >= 8 && bitDepth <= 24);
+        getKernel().floatToInt(dest, src, noise, numSamples, Range(bitDepth));
+    }
+
+    const char* getImplementationName()
+    {
+        return getKernel().name;
+    }
+
+    void Dither::generate(float* noise, int numSamples)
+    {
+        // Xorshift is plenty for noise. The difference of two uniform values,
+        // here the two halves of one random word, is triangular.
+        auto x = state;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            noise[i] = (float) ((int) (x & 0xffff) - (int) (x >> 16)) * (1.0f / 65536.0f);
+        }
+
+        state = x;
+    }
+}
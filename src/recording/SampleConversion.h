@@ -0,0 +1,31 @@
+#pragma once
+#include <JuceHeader.h>
+
+// Turns the float samples a recording is captured in into the integers a
+// 16- or 24-bit file stores. Runs on the disk writer threads, never on the
+// audio thread. Like MixKernels, the vector implementation (SSE2 or NEON) is
+// picked once, at first use.
+namespace SampleConversion
+{
+    // Scales to the given bit depth, adds the noise (in LSBs, or none if it
+    // is nullptr), rounds and clips. The results are left-justified in 32
+    // bits, as AudioFormatWriter::write() expects for integer formats.
+    void floatToInt(int* dest, const float* src, const float* noise, int numSamples, int bitDepth);
+
+    // Name of the implementation in use, for diagnostics and benchmarks
+    const char* getImplementationName();
+
+    // Triangular (TPDF) dither of up to one LSB either way, which decorrelates
+    // the rounding error from the signal. Each channel should have its own.
+    class Dither
+    {
+    public:
+        // Different seeds give uncorrelated noise
+        explicit Dither(juce::uint32 seed = 1) : state(seed != 0 ? seed : 1) {}
+
+        void generate(float* noise, int numSamples);
+
+    private:
+        juce::uint32 state;
+    };
+}
@@ -1,6 +1,13 @@
 #include <JuceHeader.h>
 #include "../audio/AudioEngine.h"
+#include "../audio/OfflineRenderer.h"
 #include "../tracks/Track.h"
+#include "../effects/CompressorEffect.h"
+#include "../effects/DelayEffect.h"
+#include "../effects/EQEffect.h"
+#include "../effects/ReverbEffect.h"
+#include "../effects/StaticEffectChain.h"
+#include "../gui/PerformanceOverlay.h"
 
 class AudioEngineTest : public juce::UnitTest
 {
@@ -64,6 +71,1287 @@ public:
         expect(testBuffer.getNumChannels() == 2, "Buffer should have 2 channels");
         expect(testBuffer.getNumSamples() == 512, "Buffer should have 512 samples");
         
+        beginTest("Mixing Into Reusable Track Slots");
+        
+        while (engine.getNumTracks() > 0)
+            engine.removeTrack(0);
+        
+        engine.prepareToPlay(64, 44100.0);
+        
+        auto* mixTrack = engine.addTrack("Mix Track", Track::AudioTrack);
+        mixTrack->setVolume(0.5f);
+        mixTrack->setPan(1.0f);
+        
+        juce::AudioBuffer<float> mixBuffer(2, 64);
+        
+        for (int block = 0; block < 3; ++block)
+        {
+            for (int channel = 0; channel < 2; ++channel)
+                juce::FloatVectorOperations::fill(mixBuffer.getWritePointer(channel), 1.0f, 64);
+            
+            engine.processTracks(mixBuffer, midiBuffer);
+        }
+        
+        expectWithinAbsoluteError(mixBuffer.getSample(0, 10), 0.0f, 1.0e-6f, "Hard right pan should silence the left channel");
+        expectWithinAbsoluteError(mixBuffer.getSample(1, 10), 0.5f, 1.0e-6f, "Right channel should carry the track volume");
+        
+        // Muting fades out over a couple of milliseconds before the track is skipped
+        mixTrack->setMute(true);
+        
+        for (int block = 0; block < 3; ++block)
+            engine.processTracks(mixBuffer, midiBuffer);
+        
+        expectEquals(mixBuffer.getMagnitude(0, 64), 0.0f, "Muted track should not reach the master sum");
+        
+        beginTest("Parallel Rendering Matches Serial");
+        
+        for (int i = 0; i < 11; ++i)
+        {
+            auto* track = engine.addTrack("Parallel Track " + juce::String(i), Track::AudioTrack);
+            track->setVolume(0.1f * (float) i);
+            track->setPan(i % 2 == 0 ? -0.5f : 0.5f);
+        }
+        
+        auto renderOneBlock = [&engine, &midiBuffer](juce::AudioBuffer<float>& target)
+        {
+            for (int channel = 0; channel < 2; ++channel)
+                for (int sample = 0; sample < target.getNumSamples(); ++sample)
+                    target.setSample(channel, sample, std::sin(0.01f * (float) (sample + channel)));
+            
+            engine.processTracks(target, midiBuffer);
+        };
+        
+        juce::AudioBuffer<float> serialResult(2, 64), parallelResult(2, 64);
+        renderOneBlock(serialResult);
+        
+        engine.setParallelRendering(true, 3);
+        engine.setParallelRenderThreshold(2);
+        expect(engine.isParallelRenderingEnabled(), "Parallel rendering should be enabled");
+        expectEquals(engine.getNumRenderWorkers(), 3, "Worker count should be configurable");
+        
+        for (int block = 0; block < 50; ++block)
+            renderOneBlock(parallelResult);
+        
+        for (int channel = 0; channel < 2; ++channel)
+            for (int sample = 0; sample < 64; ++sample)
+                expectWithinAbsoluteError(parallelResult.getSample(channel, sample),
+                                          serialResult.getSample(channel, sample), 1.0e-5f);
+        
+        engine.setParallelRendering(false);
+        expect(!engine.isParallelRenderingEnabled(), "Parallel rendering should switch back off");
+        
+        beginTest("Bus Routing");
+        
+        while (engine.getNumTracks() > 0)
+            engine.removeTrack(0);
+        
+        auto* guitar = engine.addTrack("Guitar", Track::AudioTrack);
+        auto* keys = engine.addTrack("Keys", Track::AudioTrack);
+        auto* group = engine.addBus("Group");
+        auto* reverbBus = engine.addBus("Reverb Return");
+        group->setVolume(0.5f);
+        
+        expect(engine.setTrackOutput(guitar, group), "Track should route into a bus");
+        expect(engine.setTrackOutput(keys, group), "Track should route into a bus");
+        expect(engine.addSend(guitar, reverbBus, 0.5f), "Send into a bus should be accepted");
+        expect(!engine.setTrackOutput(guitar, keys), "Only buses can take audio inputs");
+        expect(!engine.setTrackOutput(group, group), "A bus cannot feed itself");
+        expect(engine.setTrackOutput(reverbBus, group), "Bus should route into another bus");
+        expect(!engine.addSend(group, reverbBus, 1.0f), "Feedback loops should be refused");
+        expectEquals(engine.getPublishedSchedule()->getNumLevels(), 3, "Tracks, return bus and group bus should form three levels");
+        
+        juce::AudioBuffer<float> busBuffer(2, 64);
+        
+        for (int channel = 0; channel < 2; ++channel)
+            juce::FloatVectorOperations::fill(busBuffer.getWritePointer(channel), 1.0f, 64);
+        
+        engine.processTracks(busBuffer, midiBuffer);
+        
+        // (guitar + keys + 0.5 * guitar via the return bus) through the 0.5 group fader
+        expectWithinAbsoluteError(busBuffer.getSample(0, 32), 1.25f, 1.0e-5f, "Bus sums should reach the master once");
+        
+        beginTest("Sample-Accurate Parameter Changes");
+        
+        {
+            AudioEngine automationEngine(AudioEngine::DeviceMode::Offline);
+            automationEngine.prepareToPlay(256, 48000.0);
+            auto* automatedTrack = automationEngine.addTrack("Automated Track", Track::AudioTrack);
+            
+            juce::AudioBuffer<float> automationBuffer(2, 256);
+            juce::AudioBuffer<float> changedBlock(2, 256);
+            
+            for (int block = 0; block < 3; ++block)
+            {
+                for (int channel = 0; channel < 2; ++channel)
+                    juce::FloatVectorOperations::fill(automationBuffer.getWritePointer(channel), 1.0f, 256);
+                
+                if (block == 1)
+                {
+                    // Queued from the "UI", stamped inside the next block
+                    const auto blockStart = automationEngine.getSampleClock();
+                    expectEquals(blockStart, (juce::int64) 256, "Sample clock should advance per block");
+                    
+                    automatedTrack->setVolume(0.25f, blockStart + 32);
+                    automationEngine.setMasterVolume(0.5f, blockStart + 160);
+                }
+                
+                automationEngine.renderNextBlock(automationBuffer, midiBuffer);
+                
+                if (block == 1)
+                    changedBlock.makeCopyOf(automationBuffer);
+            }
+            
+            // Changes start on their sample and ramp in over 2ms (96 samples)
+            expectWithinAbsoluteError(changedBlock.getSample(0, 32), 1.0f, 1.0e-6f, "Volume change should not apply early");
+            expect(changedBlock.getSample(0, 80) < 1.0f && changedBlock.getSample(0, 80) > 0.25f, "Volume change should ramp");
+            expectWithinAbsoluteError(changedBlock.getSample(0, 150), 0.25f, 1.0e-6f, "Volume ramp should end on the new value");
+            expectWithinAbsoluteError(changedBlock.getSample(1, 160), 0.25f, 1.0e-6f, "Master change should not apply early");
+            expectWithinAbsoluteError(automationBuffer.getSample(1, 0), 0.125f, 1.0e-6f, "Master ramp should end on the new value");
+            
+            const auto queueStats = automationEngine.getCommandQueueStats();
+            expectEquals((int) queueStats.commandsApplied, 2, "Both changes should have been applied");
+            expectEquals((int) queueStats.enqueueFailures, 0, "Nothing should have been dropped");
+        }
+        
+        beginTest("Skipping Soloed-Out And Idle Tracks");
+        
+        {
+            AudioEngine soloEngine(AudioEngine::DeviceMode::Offline);
+            soloEngine.prepareToPlay(64, 44100.0);
+            auto* soloedTrack = soloEngine.addTrack("Soloed", Track::AudioTrack);
+            auto* otherTrack = soloEngine.addTrack("Other", Track::AudioTrack);
+            soloedTrack->setSolo(true);
+            
+            juce::AudioBuffer<float> soloBuffer(2, 64);
+            
+            for (int channel = 0; channel < 2; ++channel)
+                juce::FloatVectorOperations::fill(soloBuffer.getWritePointer(channel), 1.0f, 64);
+            
+            soloEngine.processTracks(soloBuffer, midiBuffer);
+            expectWithinAbsoluteError(soloBuffer.getSample(0, 10), 1.0f, 1.0e-6f, "Only the soloed track should be heard");
+            expect(otherTrack->getProcessingState() == Track::ProcessingState::Skipped, "Soloed-out track should not be processed");
+            expect(soloedTrack->getProcessingState() == Track::ProcessingState::Active, "Soloed track should be processed");
+            
+            // No effects means no tail, so a silent input puts it to sleep at once
+            soloBuffer.clear();
+            soloEngine.processTracks(soloBuffer, midiBuffer);
+            expect(soloedTrack->isSleeping(), "Track with a silent input and no tail should sleep");
+        }
+        
+        beginTest("Recording With The Fader Down");
+        
+        {
+            AudioEngine recordEngine(AudioEngine::DeviceMode::Offline);
+            recordEngine.prepareToPlay(64, 48000.0);
+            auto* recordTrack = recordEngine.addTrack("Recording", Track::AudioTrack);
+            recordTrack->setVolume(0.0f);
+            
+            auto recordFile = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("fader_down_test.wav");
+            recordFile.deleteFile();
+            recordTrack->startRecording(recordFile);
+            
+            juce::AudioBuffer<float> recordBuffer(2, 64);
+            
+            for (int blockIndex = 0; blockIndex < 20; ++blockIndex)
+            {
+                for (int channel = 0; channel < 2; ++channel)
+                    juce::FloatVectorOperations::fill(recordBuffer.getWritePointer(channel), 0.5f, 64);
+                
+                recordEngine.processTracks(recordBuffer, midiBuffer);
+            }
+            
+            expectWithinAbsoluteError(recordBuffer.getMagnitude(0, 64), 0.0f, 1.0e-6f, "The track shouldn't be heard");
+            recordTrack->stopRecording();
+            
+            juce::WavAudioFormat wav;
+            std::unique_ptr<juce::AudioFormatReader> reader(wav.createReaderFor(new juce::FileInputStream(recordFile), true));
+            expect(reader != nullptr && reader->lengthInSamples == 20 * 64, "Every block should be recorded");
+            
+            if (reader != nullptr)
+            {
+                juce::AudioBuffer<float> readBack(2, 64);
+                reader->read(&readBack, 0, 64, 19 * 64, true, true);
+                expectWithinAbsoluteError(readBack.getSample(0, 63), 0.5f, 1.0e-6f, "The input should be captured ahead of the fader");
+            }
+            
+            reader.reset();
+            recordFile.deleteFile();
+        }
+        
+        beginTest("Timing Statistics");
+        
+        {
+            TimingHistogram histogram;
+            
+            for (int i = 0; i < 99; ++i)
+                histogram.record(1000);
+            
+            histogram.record(100000);
+            
+            const auto summary = histogram.getSummary();
+            expectEquals((int) summary.count, 100, "Every sample should be counted");
+            expect(summary.p50Seconds <= summary.p99Seconds && summary.p99Seconds < summary.maxSeconds,
+                   "Percentiles should be ordered");
+            expectWithinAbsoluteError(summary.maxSeconds / summary.p50Seconds, 100.0, 10.0,
+                                      "Buckets should resolve values to within a few percent");
+            
+            histogram.reset();
+            expectEquals((int) histogram.getSummary().count, 0, "Reset should clear the histogram");
+            
+            const auto renderedBlocks = engine.getTrack(0)->getRenderTiming().getSummary().count;
+            expect(renderedBlocks > 0, "Rendering a track should record its timing");
+        }
+        
+        beginTest("Delay Lines");
+        
+        {
+            DelayLine line;
+            line.prepare(1, 64);
+            
+            // Half-sample delay: an impulse comes out split over two samples
+            float impulse[16] = { 1.0f };
+            float delayed[16] = {};
+            
+            for (int start = 0; start < 16; start += 4)
+            {
+                line.read(0, delayed + start, 4, 10.5f);
+                line.write(0, impulse + start, 4);
+            }
+            
+            expectWithinAbsoluteError(delayed[10], 0.5f, 1.0e-6f, "Linear interpolation should split the impulse");
+            expectWithinAbsoluteError(delayed[11], 0.5f, 1.0e-6f, "Linear interpolation should split the impulse");
+            
+            // Each channel keeps its own position in the line
+            DelayEffect delay;
+            delay.prepareToPlay(48000.0, 64);
+            delay.setDelayTime(10.0f);
+            delay.setFeedback(0.0f);
+            delay.setMix(1.0f);
+            delay.setWetLevel(1.0f);
+            delay.setDryLevel(0.0f);
+            delay.reset();
+            
+            juce::AudioBuffer<float> block(2, 64);
+            juce::MidiBuffer midi;
+            int leftPeak = -1, rightPeak = -1;
+            
+            for (int blockIndex = 0; blockIndex < 12; ++blockIndex)
+            {
+                block.clear();
+                
+                if (blockIndex == 0)
+                {
+                    block.setSample(0, 0, 1.0f);
+                    block.setSample(1, 40, 1.0f);
+                }
+                
+                delay.processBlock(block, midi);
+                
+                for (int i = 0; i < 64; ++i)
+                {
+                    if (block.getSample(0, i) > 0.5f) leftPeak = blockIndex * 64 + i;
+                    if (block.getSample(1, i) > 0.5f) rightPeak = blockIndex * 64 + i;
+                }
+            }
+            
+            expectEquals(leftPeak, 480, "Left channel should be delayed by 10ms");
+            expectEquals(rightPeak, 520, "Right channel should be delayed by 10ms from its own input");
+        }
+        
+        beginTest("Compressor");
+        
+        {
+            CompressorEffect compressor;
+            compressor.setThreshold(-18.0f);
+            compressor.setRatio(4.0f);
+            compressor.setKnee(0.0f);
+            compressor.setLookahead(5.0f);
+            compressor.prepareToPlay(48000.0, 64);
+            
+            expectEquals(compressor.getLatencySamples(), 240, "Lookahead should be reported as latency");
+            
+            // A steady 0dBFS input is 18dB over the threshold; 4:1 leaves 4.5dB of it
+            juce::AudioBuffer<float> block(2, 64);
+            juce::MidiBuffer midi;
+            
+            for (int blockIndex = 0; blockIndex < 200; ++blockIndex)
+            {
+                for (int channel = 0; channel < 2; ++channel)
+                    juce::FloatVectorOperations::fill(block.getWritePointer(channel), 1.0f, 64);
+                
+                compressor.processBlock(block, midi);
+            }
+            
+            expectWithinAbsoluteError(compressor.getGainReduction(), 13.5f, 0.05f, "Gain reduction should follow the ratio");
+            expectWithinAbsoluteError(block.getSample(1, 63), juce::Decibels::decibelsToGain(-13.5f), 1.0e-3f,
+                                      "Both channels should get the same gain");
+        }
+        
+        beginTest("Sidechain Compression");
+        
+        {
+            // Both tracks hear the same input; the bass's compressor listens
+            // to the kick's post-fader output instead of its own
+            AudioEngine duckEngine(AudioEngine::DeviceMode::Offline);
+            duckEngine.prepareToPlay(64, 48000.0);
+            auto* kick = duckEngine.addTrack("Kick", Track::AudioTrack);
+            auto* bass = duckEngine.addTrack("Bass", Track::AudioTrack);
+            
+            auto ducker = std::make_unique<CompressorEffect>();
+            ducker->setThreshold(-18.0f);
+            ducker->setRatio(4.0f);
+            ducker->setKnee(0.0f);
+            auto* duckerEffect = ducker.get();
+            bass->getEffectChain().addEffect(std::move(ducker));
+            expect(duckEngine.addSidechain(kick, bass), "The sidechain should be accepted");
+            
+            juce::AudioBuffer<float> block(2, 64);
+            
+            auto processBlocks = [&](int numBlocks)
+            {
+                for (int i = 0; i < numBlocks; ++i)
+                {
+                    for (int channel = 0; channel < 2; ++channel)
+                        juce::FloatVectorOperations::fill(block.getWritePointer(channel), 1.0f, 64);
+                    
+                    duckEngine.processTracks(block, midiBuffer);
+                }
+            };
+            
+            // 40dB down, the kick is well under the threshold, so the bass
+            // isn't touched even though its own input is at 0dBFS
+            kick->setVolume(0.01f);
+            processBlocks(200);
+            expectWithinAbsoluteError(duckerEffect->getGainReduction(), 0.0f, 0.05f, "A quiet key shouldn't duck the bass");
+            
+            kick->setVolume(1.0f);
+            processBlocks(200);
+            expectWithinAbsoluteError(duckerEffect->getGainReduction(), 13.5f, 0.05f, "A loud key should duck the bass");
+        }
+        
+        beginTest("EQ Bands");
+        
+        {
+            // Three peaks share 250Hz to 4kHz between the shelves
+            EQEffect fiveBands(5);
+            expect(fiveBands.getBandShape(0) == EQEffect::BandShape::LowShelf);
+            expect(fiveBands.getBandShape(4) == EQEffect::BandShape::HighShelf);
+            expectWithinAbsoluteError(fiveBands.getBandFrequency(1), 396.9f, 0.1f);
+            expectWithinAbsoluteError(fiveBands.getBandFrequency(2), 1000.0f, 0.01f);
+            expectWithinAbsoluteError(fiveBands.getBandFrequency(3), 2519.8f, 0.1f);
+            
+            juce::MidiBuffer midi;
+            
+            // Runs a 1kHz sine through the EQ until it settles, and returns
+            // the last block
+            auto processSine = [&](EQEffect& eq)
+            {
+                eq.prepareToPlay(48000.0, 480);
+                juce::AudioBuffer<float> block(2, 480);
+                
+                for (int blockIndex = 0; blockIndex < 50; ++blockIndex)
+                {
+                    for (int i = 0; i < 480; ++i)
+                    {
+                        const auto phase = juce::MathConstants<double>::twoPi * 1000.0 * (blockIndex * 480 + i) / 48000.0;
+                        block.setSample(0, i, 0.1f * (float) std::sin(phase));
+                        block.setSample(1, i, 0.1f * (float) std::sin(phase));
+                    }
+                    
+                    eq.processBlock(block, midi);
+                }
+                
+                return block;
+            };
+            
+            // A peak's gain at its own frequency is the band's gain
+            EQEffect oneBand(1);
+            oneBand.setBandFrequency(0, 1000.0f);
+            oneBand.setBandGain(0, 12.0f);
+            const auto boosted = processSine(oneBand);
+            expectWithinAbsoluteError(juce::Decibels::gainToDecibels(boosted.getMagnitude(0, 0, 480) / 0.1f), 12.0f, 0.1f,
+                                      "The band's centre should be boosted by its gain");
+            
+            // Any number of bands runs as one cascade: flat bands pass the
+            // sine straight through, so seven bands with one boosted sound
+            // like that one band alone
+            EQEffect sevenBands(7);
+            sevenBands.setBandFrequency(3, 1000.0f);
+            sevenBands.setBandGain(3, 12.0f);
+            expectEquals(sevenBands.getNumBands(), 7);
+            const auto cascaded = processSine(sevenBands);
+            
+            for (int i = 0; i < 480; i += 37)
+                expectWithinAbsoluteError(cascaded.getSample(1, i), boosted.getSample(1, i), 1.0e-4f,
+                                          "Flat bands should leave the signal alone");
+        }
+        
+        beginTest("EQ Parameter Changes During Playback");
+        
+        {
+            EQEffect eq(1);
+            eq.setBandFrequency(0, 1000.0f);
+            eq.prepareToPlay(48000.0, 64);
+            
+            juce::AudioBuffer<float> block(2, 64);
+            juce::MidiBuffer midi;
+            int position = 0;
+            float previous = 0.0f, largestStep = 0.0f;
+            
+            auto processBlocks = [&](int numBlocks)
+            {
+                for (int blockIndex = 0; blockIndex < numBlocks; ++blockIndex)
+                {
+                    for (int i = 0; i < 64; ++i)
+                    {
+                        const auto phase = juce::MathConstants<double>::twoPi * 1000.0 * (position + i) / 48000.0;
+                        block.setSample(0, i, 0.1f * (float) std::sin(phase));
+                        block.setSample(1, i, 0.1f * (float) std::sin(phase));
+                    }
+                    
+                    eq.processBlock(block, midi);
+                    position += 64;
+                    
+                    for (int i = 0; i < 64; ++i)
+                    {
+                        largestStep = juce::jmax(largestStep, std::abs(block.getSample(0, i) - previous));
+                        previous = block.getSample(0, i);
+                    }
+                }
+            };
+            
+            processBlocks(20);
+            expectWithinAbsoluteError(block.getMagnitude(0, 0, 64), 0.1f, 1.0e-3f, "A flat band should pass the sine");
+            
+            // Published to the audio thread and faded in over 20ms
+            eq.setBandGain(0, 12.0f);
+            processBlocks(1);
+            expect(block.getMagnitude(0, 0, 64) < 0.2f, "The change should fade in, not jump");
+            
+            processBlocks(30);
+            expectWithinAbsoluteError(juce::Decibels::gainToDecibels(block.getMagnitude(0, 0, 64) / 0.1f), 12.0f, 0.1f,
+                                      "The new gain should reach the audio thread");
+            
+            // The steepest a 1kHz sine peaking at 0.4 gets is about 0.052 a
+            // sample. The fade may overshoot a little, but a click would be a
+            // far bigger step.
+            expect(largestStep < 0.08f, "The fade should have no discontinuity");
+        }
+        
+        beginTest("Effect Bypass And Sleep");
+        
+        {
+            EffectChain chain;
+            chain.prepareToPlay(48000.0, 64);
+            
+            // 12dB of makeup and nothing else: a plain gain with no tail
+            auto boost = std::make_unique<CompressorEffect>();
+            boost->setRatio(1.0f);
+            boost->setMakeupGain(12.0f);
+            auto* boostEffect = boost.get();
+            chain.addEffect(std::move(boost));
+            
+            const float boosted = 0.5f * juce::Decibels::decibelsToGain(12.0f);
+            juce::AudioBuffer<float> block(2, 64);
+            juce::MidiBuffer midi;
+            
+            auto processBlocks = [&](int numBlocks, float level)
+            {
+                for (int i = 0; i < numBlocks; ++i)
+                {
+                    for (int channel = 0; channel < 2; ++channel)
+                        juce::FloatVectorOperations::fill(block.getWritePointer(channel), level, 64);
+                    
+                    chain.processBlock(block, midi);
+                }
+            };
+            
+            processBlocks(1, 0.5f);
+            expectWithinAbsoluteError(block.getSample(0, 63), boosted, 1.0e-4f);
+            
+            // 10ms is 480 samples, so the first block is only part way there
+            boostEffect->setEnabled(false);
+            processBlocks(1, 0.5f);
+            expect(block.getSample(0, 63) > 0.5f && block.getSample(0, 63) < boosted, "Bypass should fade, not cut");
+            
+            processBlocks(10, 0.5f);
+            expectEquals(block.getSample(0, 63), 0.5f, "Bypassed effect should pass the dry signal");
+            expect(boostEffect->getActivityStats().blocksBypassed > 0, "Bypassed blocks should be counted");
+            
+            boostEffect->setEnabled(true);
+            processBlocks(10, 0.5f);
+            processBlocks(3, 0.0f);
+            expect(boostEffect->isSleeping(), "An effect with no tail should sleep through silence");
+            
+            processBlocks(1, 0.5f);
+            expect(!boostEffect->isSleeping(), "Signal should wake it");
+            expectWithinAbsoluteError(block.getSample(0, 63), boosted, 1.0e-4f);
+            expectEquals((int) chain.getActivityStats().wakeUps, 1);
+            expectEquals((int) chain.getActivityStats().blocksAsleep, 3);
+            
+            // A narrow low band rings on for a good while after its input stops
+            auto resonant = std::make_unique<EQEffect>(1);
+            resonant->setBandFrequency(0, 50.0f);
+            resonant->setBandQ(0, 10.0f);
+            resonant->setBandGain(0, 12.0f);
+            auto* resonantEffect = resonant.get();
+            expect(resonantEffect->getTailLengthSeconds() > 0.1, "A resonant band should have a tail");
+            
+            chain.removeEffect(0);
+            chain.addEffect(std::move(resonant));
+            processBlocks(10, 0.5f);
+            processBlocks(3, 0.0f);
+            expect(!resonantEffect->isSleeping(), "The EQ should stay awake while it rings");
+            expect(block.getMagnitude(0, 64) > 1.0e-5f, "Its ringing should still be heard");
+        }
+        
+        beginTest("Static Effect Chain");
+        
+        {
+            // The fused chain must sound exactly like its effects run one
+            // after the other, whatever the block size
+            StaticEffectChain<DelayEffect, EQEffect, ReverbEffect> fused;
+            DelayEffect delay;
+            EQEffect eq;
+            ReverbEffect reverb;
+            
+            fused.prepareToPlay(48000.0, 1000);
+            delay.prepareToPlay(48000.0, 1000);
+            eq.prepareToPlay(48000.0, 1000);
+            reverb.prepareToPlay(48000.0, 1000);
+            
+            for (auto* delayStage : { &fused.getStage<DelayEffect>(), &delay })
+                delayStage->setDelayTime(30.0f);
+            
+            for (auto* eqStage : { &fused.getStage<EQEffect>(), &eq })
+                eqStage->setBandGain(0, 6.0f);
+            
+            expectEquals(fused.getName(), juce::String("Delay > EQ > Reverb"));
+            expectEquals(fused.getTailLengthSeconds(),
+                         delay.getTailLengthSeconds() + eq.getTailLengthSeconds() + reverb.getTailLengthSeconds());
+            
+            juce::Random random(1);
+            juce::MidiBuffer midi;
+            float maxDifference = 0.0f;
+            
+            for (int blockSize : { 1000, 37, 256, 600 })
+            {
+                juce::AudioBuffer<float> fusedBlock(2, blockSize), referenceBlock(2, blockSize);
+                
+                for (int channel = 0; channel < 2; ++channel)
+                    for (int i = 0; i < blockSize; ++i)
+                        fusedBlock.setSample(channel, i, random.nextFloat() * 2.0f - 1.0f);
+                
+                referenceBlock.makeCopyOf(fusedBlock);
+                
+                fused.processBlock(fusedBlock, midi);
+                delay.processBlock(referenceBlock, midi);
+                eq.processBlock(referenceBlock, midi);
+                reverb.processBlock(referenceBlock, midi);
+                
+                for (int channel = 0; channel < 2; ++channel)
+                    for (int i = 0; i < blockSize; ++i)
+                        maxDifference = juce::jmax(maxDifference, std::abs(fusedBlock.getSample(channel, i) - referenceBlock.getSample(channel, i)));
+            }
+            
+            expectLessThan(maxDifference, 1.0e-5f);
+            
+            // Disabling a stage fades just that stage out; a flat EQ after
+            // 12dB of makeup leaves only the EQ once the makeup is bypassed
+            StaticEffectChain<CompressorEffect, EQEffect> boostThenEq;
+            auto& boostStage = boostThenEq.getStage<CompressorEffect>();
+            boostStage.setRatio(1.0f);
+            boostStage.setMakeupGain(12.0f);
+            boostThenEq.prepareToPlay(48000.0, 64);
+            
+            juce::AudioBuffer<float> block(2, 64);
+            const float boosted = 0.5f * juce::Decibels::decibelsToGain(12.0f);
+            
+            auto processBlocks = [&](int numBlocks)
+            {
+                for (int i = 0; i < numBlocks; ++i)
+                {
+                    for (int channel = 0; channel < 2; ++channel)
+                        juce::FloatVectorOperations::fill(block.getWritePointer(channel), 0.5f, 64);
+                    
+                    boostThenEq.processBlock(block, midi);
+                }
+            };
+            
+            processBlocks(1);
+            expectWithinAbsoluteError(block.getSample(0, 63), boosted, 1.0e-3f);
+            
+            boostStage.setEnabled(false);
+            processBlocks(1);
+            expect(block.getSample(0, 63) > 0.5f && block.getSample(0, 63) < boosted, "The stage should fade out, not cut");
+            
+            processBlocks(10);
+            expectWithinAbsoluteError(block.getSample(0, 63), 0.5f, 1.0e-3f, "A disabled stage should be bypassed");
+
+            // A fused compressor listens to the sidechain, not its own input
+            EqCompressorChain keyedChain;
+            auto& keyedStage = keyedChain.getStage<CompressorEffect>();
+            keyedStage.setThreshold(-18.0f);
+            keyedStage.setRatio(4.0f);
+            keyedStage.setKnee(0.0f);
+            keyedChain.prepareToPlay(48000.0, 64);
+
+            juce::AudioBuffer<float> key(2, 64);
+
+            auto processKeyedBlocks = [&](float keyLevel, int numBlocks)
+            {
+                for (int i = 0; i < numBlocks; ++i)
+                {
+                    for (int channel = 0; channel < 2; ++channel)
+                    {
+                        juce::FloatVectorOperations::fill(block.getWritePointer(channel), 1.0f, 64);
+                        juce::FloatVectorOperations::fill(key.getWritePointer(channel), keyLevel, 64);
+                    }
+
+                    keyedChain.processBlockWithSidechain(block, midi, key);
+                }
+            };
+
+            processKeyedBlocks(0.01f, 200);
+            expectWithinAbsoluteError(keyedStage.getGainReduction(), 0.0f, 0.05f, "A quiet key shouldn't duck the chain");
+
+            processKeyedBlocks(1.0f, 200);
+            expectWithinAbsoluteError(keyedStage.getGainReduction(), 13.5f, 0.05f, "A loud key should duck the chain");
+        }
+        
+        beginTest("Feedback Delay Network Reverb");
+        
+        {
+            ReverbEffect reverb;
+            reverb.setRoomSize(0.3f);
+            reverb.setDryLevel(0.0f);
+            reverb.setWetLevel(1.0f);
+            reverb.prepareToPlay(48000.0, 256);
+            
+            expect(reverb.getMode() == ReverbEffect::Mode::Algorithmic, "The network should be the default engine");
+            
+            // Peak level in each quarter second after an impulse
+            juce::AudioBuffer<float> block(2, 256);
+            juce::MidiBuffer midi;
+            std::vector<float> peaks(12, 0.0f);
+            
+            for (int blockIndex = 0; blockIndex < (int) peaks.size() * 12000 / 256; ++blockIndex)
+            {
+                block.clear();
+                
+                if (blockIndex == 0)
+                    block.setSample(0, 0, 1.0f);
+                
+                reverb.processBlock(block, midi);
+                
+                auto& peak = peaks[(size_t) (blockIndex * 256 / 12000)];
+                peak = juce::jmax(peak, block.getMagnitude(0, 256));
+            }
+            
+            expect(peaks[0] > 0.01f, "The impulse should excite the network");
+            expect(peaks[8] < peaks[0] * 0.001f, "The tail should have fallen by 60dB within its decay time");
+        }
+
+        beginTest("Convolution Reverb");
+
+        {
+            // Two taps with unit energy, so loading leaves them as they are
+            auto irFile = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("convolution_test_ir.wav");
+            irFile.deleteFile();
+            
+            {
+                juce::AudioBuffer<float> ir(1, 400);
+                ir.clear();
+                ir.setSample(0, 0, 0.6f);
+                ir.setSample(0, 300, 0.8f);
+                
+                juce::WavAudioFormat wav;
+                std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(irFile),
+                                                                                    48000.0, 1, 32, {}, 0));
+                expect(writer != nullptr && writer->writeFromAudioSampleBuffer(ir, 0, 400), "Test response should be written");
+            }
+            
+            ReverbEffect first, second;
+            juce::SharedResourcePointer<ImpulseResponseCache> cache;
+            
+            for (auto* reverb : { &first, &second })
+            {
+                reverb->prepareToPlay(48000.0, 128);
+                reverb->setMode(ReverbEffect::Mode::Convolution);
+                reverb->setDryLevel(0.0f);
+                reverb->setWetLevel(1.0f);
+                expect(reverb->loadImpulseResponse(irFile), "Response should load");
+            }
+            
+            expectEquals(cache->getNumCached(), 1, "Instances should share one copy of the response");
+            
+            juce::AudioBuffer<float> block(2, 128);
+            juce::MidiBuffer midi;
+            float tapAt300 = 0.0f;
+            
+            for (int blockIndex = 0; blockIndex < 4; ++blockIndex)
+            {
+                block.clear();
+                
+                if (blockIndex == 0)
+                    block.setSample(0, 0, 1.0f);
+                
+                first.processBlock(block, midi);
+                
+                if (blockIndex == 0)
+                    expectWithinAbsoluteError(block.getSample(0, 0), 0.6f, 1.0e-4f, "Direct tap should come out with no latency");
+                
+                if (blockIndex == 2)
+                    tapAt300 = block.getSample(0, 300 - 256);
+            }
+            
+            expectWithinAbsoluteError(tapAt300, 0.8f, 1.0e-4f, "Later tap should come from a later partition");
+            irFile.deleteFile();
+        }
+        
+        beginTest("Offline Render");
+        
+        {
+            AudioEngine offlineEngine(AudioEngine::DeviceMode::Offline);
+            expect(offlineEngine.isOffline(), "Engine should not open a device");
+            
+            offlineEngine.addTrack("Offline Track", Track::AudioTrack);
+            offlineEngine.addBus("Offline Bus");
+            
+            OfflineRenderer renderer(offlineEngine);
+            OfflineRenderer::Settings settings;
+            settings.sampleRate = 48000.0;
+            settings.blockSize = 128;
+            settings.lengthSeconds = 1.0;
+            
+            auto bounceFile = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                  .getChildFile("offline_render_test.wav");
+            
+            auto stats = renderer.renderToFile(bounceFile, settings);
+            expect(stats.succeeded, stats.errorMessage);
+            expectEquals(stats.samplesRendered, (juce::int64) 48000, "Whole length should be rendered, including the last partial block");
+            expect(stats.realtimeFactor > 0.0, "Realtime factor should be reported");
+            expect(bounceFile.existsAsFile(), "Bounce should be written to disk");
+            
+            bounceFile.deleteFile();
+        }
+        
+        beginTest("Recording Through The Disk Writer");
+        
+        {
+            auto recordFile = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("recorder_test.wav");
+            recordFile.deleteFile();
+            
+            Recorder recorder;
+            recorder.setSampleRate(48000.0);
+            recorder.startRecording(recordFile);
+            expect(recorder.isRecording(), "Recording should start");
+            
+            juce::AudioBuffer<float> block(2, 480);
+            
+            for (int blockIndex = 0; blockIndex < 100; ++blockIndex)
+            {
+                for (int i = 0; i < 480; ++i)
+                {
+                    block.setSample(0, i, 0.5f);
+                    block.setSample(1, i, -0.5f);
+                }
+                
+                recorder.addAudioBlock(block, 480);
+            }
+            
+            // More than the whole FIFO: dropped and counted, never waited for
+            juce::AudioBuffer<float> hugeBlock(2, 100000);
+            hugeBlock.clear();
+            recorder.addAudioBlock(hugeBlock, 100000);
+            
+            recorder.stopRecording();
+            
+            const auto stats = recorder.getStats();
+            expectEquals((int) stats.samplesWritten, 48000, "Every block that fitted should reach the file");
+            expectEquals((int) stats.overflows, 1);
+            expectEquals((int) stats.droppedSamples, 100000);
+            
+            juce::WavAudioFormat wav;
+            std::unique_ptr<juce::AudioFormatReader> reader(wav.createReaderFor(new juce::FileInputStream(recordFile), true));
+            expect(reader != nullptr && reader->lengthInSamples == 48000, "File should be complete once recording stops");
+            expect(reader != nullptr && reader->usesFloatingPointData, "Recordings should be float by default");
+            
+            // An undithered 24-bit recording is converted on the writer
+            // threads and comes back within half an LSB
+            Recorder::Format format;
+            format.sampleFormat = Recorder::Format::SampleFormat::Int24;
+            format.numChannels = 1;
+            format.dither = false;
+            
+            reader.reset();
+            recordFile.deleteFile();
+            recorder.startRecording(recordFile, format);
+            recorder.addAudioBlock(block, 480);
+            recorder.stopRecording();
+            
+            reader.reset(wav.createReaderFor(new juce::FileInputStream(recordFile), true));
+            expect(reader != nullptr && reader->bitsPerSample == 24 && reader->numChannels == 1, "Format should be as asked");
+            
+            if (reader != nullptr)
+            {
+                juce::AudioBuffer<float> readBack(1, 480);
+                reader->read(&readBack, 0, 480, 0, true, false);
+                expectWithinAbsoluteError(readBack.getSample(0, 479), 0.5f, 1.0e-6f);
+            }
+            
+            reader.reset();
+            recordFile.deleteFile();
+        }
+        
+        beginTest("Clip Streaming");
+        
+        {
+            auto clipFile = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("clip_test.wav");
+            clipFile.deleteFile();
+            
+            // A float file holding a ramp, so every sample says where it came from
+            {
+                juce::WavAudioFormat wav;
+                std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(clipFile),
+                                                                                    48000.0, 2, 32, {}, 0));
+                juce::AudioBuffer<float> ramp(2, 4000);
+                
+                for (int i = 0; i < 4000; ++i)
+                {
+                    ramp.setSample(0, i, (float) i / 4000.0f);
+                    ramp.setSample(1, i, -(float) i / 4000.0f);
+                }
+                
+                writer->writeFromAudioSampleBuffer(ramp, 0, 4000);
+            }
+            
+            AudioEngine clipEngine(AudioEngine::DeviceMode::Offline);
+            clipEngine.prepareToPlay(64, 48000.0);
+            auto* clipTrack = clipEngine.addTrack("Clips", Track::AudioTrack);
+            
+            AudioClip clip;
+            clip.file = clipFile;
+            clip.timelineStart = 1000;
+            clip.sourceStart = 100;
+            clip.length = 2000;
+            clip.gain = 0.5f;
+            expect(clipTrack->getClipPlayer().addClip(clip), "The clip's file should open");
+            expect(!clipTrack->getClipPlayer().addClip({ clipFile.getSiblingFile("missing.wav") }), "A missing file should be refused");
+            
+            juce::AudioBuffer<float> block(2, 64);
+            juce::MidiBuffer midi;
+            juce::Array<float> left, right;
+            
+            clipEngine.play();
+            
+            for (int blockIndex = 0; blockIndex < 4000 / 64; ++blockIndex)
+            {
+                block.clear();
+                clipEngine.processTracks(block, midi);
+                
+                for (int i = 0; i < 64; ++i)
+                {
+                    left.add(block.getSample(0, i));
+                    right.add(block.getSample(1, i));
+                }
+            }
+            
+            expectEquals((int) clipEngine.getPlayheadPosition(), 4000 / 64 * 64);
+            
+            bool allInPlace = true;
+            
+            for (int position = 0; position < left.size(); ++position)
+            {
+                const bool inClip = position >= 1000 && position < 3000;
+                const float expected = inClip ? 0.5f * (float) (100 + position - 1000) / 4000.0f : 0.0f;
+                allInPlace = allInPlace && std::abs(left[position] - expected) < 1.0e-6f
+                                        && std::abs(right[position] + expected) < 1.0e-6f;
+            }
+            
+            expect(allInPlace, "Every sample of the clip should land where it was placed, and nothing else");
+            expectEquals((int) clipTrack->getClipPlayer().getNumUnderruns(), 0, "An offline render should wait for the disk");
+            
+            // A locate restarts the buffer from the new position
+            clipEngine.setPlayheadPosition(1500);
+            block.clear();
+            clipEngine.processTracks(block, midi);
+            expectWithinAbsoluteError(block.getSample(0, 0), 0.5f * 600.0f / 4000.0f, 1.0e-6f);
+            
+            // Stopped, the playhead stays put and the track is silent
+            clipEngine.stop();
+            const auto stoppedAt = clipEngine.getPlayheadPosition();
+            block.clear();
+            clipEngine.processTracks(block, midi);
+            expectEquals((int) clipEngine.getPlayheadPosition(), (int) stoppedAt);
+            expectEquals(block.getMagnitude(0, 0, 64), 0.0f);
+            
+            clipTrack->getClipPlayer().clearClips();
+            clipFile.deleteFile();
+        }
+        
+        beginTest("Sample Pool");
+        
+        {
+            juce::SharedResourcePointer<SamplePool> pool;
+            pool->purgeUnused();
+            pool->resetStats();
+            
+            auto writeTestFile = [](const juce::File& file, float value)
+            {
+                file.deleteFile();
+                juce::WavAudioFormat wav;
+                std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(file),
+                                                                                    48000.0, 2, 32, {}, 0));
+                juce::AudioBuffer<float> samples(2, 1000);
+                
+                for (int channel = 0; channel < 2; ++channel)
+                    juce::FloatVectorOperations::fill(samples.getWritePointer(channel), value, 1000);
+                
+                writer->writeFromAudioSampleBuffer(samples, 0, 1000);
+            };
+            
+            const auto tempDirectory = juce::File::getSpecialLocation(juce::File::tempDirectory);
+            const auto loopFile = tempDirectory.getChildFile("pool_loop.wav");
+            const auto bigFile = tempDirectory.getChildFile("pool_big.wav");
+            writeTestFile(loopFile, 0.25f);
+            writeTestFile(bigFile, 0.5f);
+            
+            // Every clip of the same file shares one decoded copy
+            Track loopTrack("Loops", Track::AudioTrack);
+            loopTrack.prepareToPlay(48000.0, 64);
+            
+            for (int i = 0; i < 4; ++i)
+                loopTrack.getClipPlayer().addClip({ loopFile, i * 1000 });
+            
+            auto stats = pool->getStats();
+            expectEquals(stats.numSamples, 1);
+            expectEquals((int) stats.misses, 1, "The file should be read once");
+            expectEquals((int) stats.hits, 3);
+            expectEquals((int) stats.bytesHeld, 2 * 1000 * (int) sizeof(float));
+            
+            // Too big for the budget: streamed instead
+            pool->setMemoryBudget(4000);
+            expect(pool->getSample(bigFile) == nullptr, "A file over a quarter of the budget shouldn't be pooled");
+            expectEquals((int) pool->getStats().streamed, 1);
+            
+            // Nothing is evicted while a clip still uses it, and the least
+            // recently used sample goes first once nothing does
+            pool->setMemoryBudget(4 * 8000);
+            expect(pool->getSample(bigFile) != nullptr);
+            pool->setMemoryBudget(8000);
+            stats = pool->getStats();
+            expectEquals(stats.numSamples, 1, "The unused sample should make room");
+            expectEquals((int) stats.evictions, 1);
+            expect(pool->getSample(loopFile) != nullptr && pool->getStats().misses == 2, "The sample in use should stay pooled");
+            
+            // A finished recording is pooled without being read back
+            pool->setMemoryBudget(SamplePool::defaultMemoryBudget);
+            auto recordFile = tempDirectory.getChildFile("pool_recording.wav");
+            recordFile.deleteFile();
+            
+            Recorder recorder;
+            recorder.setSampleRate(48000.0);
+            recorder.startRecording(recordFile);
+            
+            juce::AudioBuffer<float> block(2, 480);
+            block.clear();
+            block.setSample(0, 100, 0.75f);
+            recorder.addAudioBlock(block, 480);
+            recorder.stopRecording();
+            
+            const auto missesBefore = pool->getStats().misses;
+            auto recorded = pool->getSample(recordFile);
+            expect(recorded != nullptr && pool->getStats().misses == missesBefore, "The recording should already be pooled");
+            expect(recorded != nullptr && recorded->getAudio().getNumSamples() == 480
+                   && recorded->getAudio().getSample(0, 100) == 0.75f, "The pooled recording should match the file");
+            expectEquals((int) pool->getStats().bytesReserved, 0, "The copy should count as pooled, not reserved");
+            
+            // While it records, the copy's memory comes out of the budget,
+            // and a pool that can't spare it doesn't get the copy
+            recorded = nullptr;
+            pool->purgeUnused();
+            pool->setMemoryBudget(65536);
+            auto unkeptFile = tempDirectory.getChildFile("pool_unkept.wav");
+            unkeptFile.deleteFile();
+            
+            recorder.startRecording(unkeptFile);
+            recorder.addAudioBlock(block, 480);
+            recorder.stopRecording();
+            
+            expectEquals((int) pool->getStats().bytesReserved, 0);
+            
+            const auto missesBeforeRead = pool->getStats().misses;
+            expect(pool->getSample(unkeptFile) != nullptr && pool->getStats().misses == missesBeforeRead + 1,
+                   "The recording should be read back instead");
+            
+            pool->setMemoryBudget(SamplePool::defaultMemoryBudget);
+            loopTrack.getClipPlayer().clearClips();
+            pool->purgeUnused();
+            loopFile.deleteFile();
+            bigFile.deleteFile();
+            recordFile.deleteFile();
+            unkeptFile.deleteFile();
+        }
+        
+        beginTest("Waveform Peaks");
+        
+        {
+            juce::SharedResourcePointer<PeakCache> peakCache;
+            auto audioFile = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("peaks_test.wav");
+            audioFile.deleteFile();
+            PeakFile::getPeakFileFor(audioFile).deleteFile();
+            
+            // Half a loud positive step, half a quieter negative one, on the
+            // left only
+            {
+                juce::WavAudioFormat wav;
+                std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(new juce::FileOutputStream(audioFile),
+                                                                                    48000.0, 2, 32, {}, 0));
+                juce::AudioBuffer<float> samples(2, 10000);
+                samples.clear();
+                
+                for (int i = 0; i < 10000; ++i)
+                    samples.setSample(0, i, i < 5000 ? 0.5f : -0.25f);
+                
+                writer->writeFromAudioSampleBuffer(samples, 0, 10000);
+            }
+            
+            expect(peakCache->getPeaks(audioFile) == nullptr, "The peaks should be built in the background");
+            
+            const auto deadline = juce::Time::getMillisecondCounter() + 5000;
+            
+            while (peakCache->getNumPending() > 0 && juce::Time::getMillisecondCounter() < deadline)
+                juce::Thread::sleep(1);
+            
+            auto peaks = peakCache->getPeaks(audioFile);
+            expect(peaks != nullptr, "The peak file should be ready");
+            
+            if (peaks != nullptr)
+            {
+                expectEquals((int) peaks->getLengthInSamples(), 10000);
+                expectEquals(peaks->getNumChannels(), 2);
+                expectEquals(peaks->getNumLevels(), 9, "Levels should halve down to a single peak");
+                expect(PeakFile::getPeakFileFor(audioFile).getSize() * 10 < audioFile.getSize(), "Peaks should be compact");
+                
+                // The whole file, from the coarsest level
+                auto peak = peaks->getPeak(0, 0, 10000);
+                expectWithinAbsoluteError(peak.max, 0.5f, 1.0e-4f);
+                expectWithinAbsoluteError(peak.min, -0.25f, 1.0e-4f);
+                
+                // A few samples, from the finest
+                peak = peaks->getPeak(0, 100, 110);
+                expectWithinAbsoluteError(peak.min, 0.5f, 1.0e-4f);
+                expectWithinAbsoluteError(peak.rms, 0.5f, 1.0e-4f);
+                expectEquals(peaks->getPeak(1, 0, 10000).max, 0.0f, "The right channel is silent");
+            }
+            
+            // Editing the audio leaves its peaks out of date
+            peaks = nullptr;
+            audioFile.setLastModificationTime(juce::Time(juce::Time::currentTimeMillis() + 10000));
+            expect(PeakFile::open(audioFile) == nullptr, "Stale peaks shouldn't be used");
+            
+            // While waveforms are shown, a recording's peaks are worked out
+            // while it records
+            auto recordFile = audioFile.getSiblingFile("peaks_recording.wav");
+            recordFile.deleteFile();
+            peakCache->addWaveformView();
+            
+            Recorder recorder;
+            recorder.setSampleRate(48000.0);
+            recorder.startRecording(recordFile);
+            
+            juce::AudioBuffer<float> block(2, 480);
+            block.clear();
+            block.setSample(1, 200, -0.75f);
+            recorder.addAudioBlock(block, 480);
+            recorder.stopRecording();
+            peakCache->removeWaveformView();
+            
+            while (peakCache->getNumPending() > 0 && juce::Time::getMillisecondCounter() < deadline)
+                juce::Thread::sleep(1);
+            
+            auto recordedPeaks = PeakFile::open(recordFile);
+            expect(recordedPeaks != nullptr && recordedPeaks->getLengthInSamples() == 480, "The recording's peaks should be written");
+            expect(recordedPeaks != nullptr && std::abs(recordedPeaks->getPeak(1, 0, 480).min + 0.75f) < 1.0e-4f);
+            
+            recordedPeaks = nullptr;
+            
+            for (auto& file : { audioFile, recordFile })
+            {
+                file.deleteFile();
+                PeakFile::getPeakFileFor(file).deleteFile();
+            }
+        }
+        
+        beginTest("Latency Compensation");
+        
+        {
+            AudioEngine pdcEngine(AudioEngine::DeviceMode::Offline);
+            pdcEngine.prepareToPlay(64, 48000.0);
+            
+            // A compressor that never compresses, for its 1ms lookahead alone
+            auto compressor = std::make_unique<CompressorEffect>();
+            compressor->setRatio(1.0f);
+            compressor->setLookahead(1.0f);
+            
+            auto* delayedTrack = pdcEngine.addTrack("Delayed", Track::AudioTrack);
+            pdcEngine.addTrack("Direct", Track::AudioTrack);
+            delayedTrack->getEffectChain().addEffect(std::move(compressor));
+            
+            expect(pdcEngine.updateLatencyCompensation(), "The new latency should be picked up");
+            expect(!pdcEngine.updateLatencyCompensation(), "Nothing should change the second time");
+            expectEquals(pdcEngine.getLatencySamples(), 48, "The master should lag by the lookahead");
+            
+            juce::AudioBuffer<float> block(2, 64);
+            juce::MidiBuffer midi;
+            block.clear();
+            block.setSample(0, 0, 1.0f);
+            block.setSample(1, 0, 1.0f);
+            pdcEngine.processTracks(block, midi);
+            
+            expectWithinAbsoluteError(block.getSample(0, 0), 0.0f, 1.0e-6f, "The direct path should be delayed too");
+            expectWithinAbsoluteError(block.getSample(0, 48), 2.0f, 1.0e-5f, "Both paths should arrive together");
+
+            // A device may deliver more than it asked to be prepared for
+            juce::AudioBuffer<float> longBlock(2, 200);
+            longBlock.clear();
+            longBlock.setSample(0, 100, 1.0f);
+            longBlock.setSample(1, 100, 1.0f);
+            pdcEngine.processTracks(longBlock, midi);
+
+            expectWithinAbsoluteError(longBlock.getSample(0, 100), 0.0f, 1.0e-6f, "A long block should be delayed too");
+            expectWithinAbsoluteError(longBlock.getSample(0, 148), 2.0f, 1.0e-5f,
+                                      "Both paths should line up across the pieces of a long block");
+        }
+        
+        beginTest("Track List Changes During Playback");
+        
+        {
+            AudioEngine liveEditEngine(AudioEngine::DeviceMode::Offline);
+            liveEditEngine.prepareToPlay(64, 44100.0);
+            
+            // Stands in for the device callback, hammering the engine while
+            // this thread edits the track list underneath it
+            struct BlockPump : public juce::Thread
+            {
+                explicit BlockPump(AudioEngine& e) : juce::Thread("Block Pump"), engineToPump(e) {}
+                
+                void run() override
+                {
+                    juce::AudioBuffer<float> block(2, 64);
+                    juce::MidiBuffer midi;
+                    
+                    while (!threadShouldExit())
+                    {
+                        for (int channel = 0; channel < 2; ++channel)
+                            juce::FloatVectorOperations::fill(block.getWritePointer(channel), 0.25f, 64);
+                        
+                        engineToPump.processTracks(block, midi);
+                        ++blocksRendered;
+                    }
+                }
+                
+                AudioEngine& engineToPump;
+                std::atomic<int> blocksRendered { 0 };
+            };
+            
+            BlockPump pump(liveEditEngine);
+            pump.startThread();
+            
+            for (int i = 0; i < 200; ++i)
+            {
+                auto* added = liveEditEngine.addTrack("Live " + juce::String(i), Track::AudioTrack);
+                
+                if (i % 3 == 0)
+                    liveEditEngine.setTrackOutput(added, liveEditEngine.addBus("Live Bus " + juce::String(i)));
+                
+                while (liveEditEngine.getNumTracks() > 8)
+                    liveEditEngine.removeTrack(i % liveEditEngine.getNumTracks());
+            }
+            
+            while (pump.blocksRendered.load() < 100)
+                juce::Thread::sleep(1);
+            
+            pump.stopThread(2000);
+            
+            juce::SharedResourcePointer<DeferredReleasePool> releasePool;
+            releasePool->collectNow();
+            
+            expectEquals(liveEditEngine.getNumTracks(), 8, "Track count should reflect every edit");
+            expectEquals(liveEditEngine.renderState.getNumRetired(), 0, "Retired snapshots should be reclaimed once the reader is idle");
+        }
+        
+        beginTest("Effect Chain Changes During Playback");
+        
+        {
+            EffectChain chain;
+            chain.prepareToPlay(44100.0, 64);
+            
+            // Stands in for the audio thread
+            struct ChainPump : public juce::Thread
+            {
+                explicit ChainPump(EffectChain& c) : juce::Thread("Chain Pump"), chainToPump(c) {}
+                
+                void run() override
+                {
+                    juce::AudioBuffer<float> block(2, 64);
+                    juce::MidiBuffer midi;
+                    
+                    while (!threadShouldExit())
+                    {
+                        block.clear();
+                        chainToPump.processBlock(block, midi);
+                        ++blocksRendered;
+                    }
+                }
+                
+                EffectChain& chainToPump;
+                std::atomic<int> blocksRendered { 0 };
+            };
+            
+            ChainPump pump(chain);
+            pump.startThread();
+            
+            for (int i = 0; i < 100; ++i)
+            {
+                if (i % 2 == 0)
+                    chain.addEffect(std::make_unique<DelayEffect>());
+                else
+                    chain.addEffect(std::make_unique<CompressorEffect>());
+                
+                chain.moveEffect(chain.getNumEffects() - 1, 0);
+                
+                if (chain.getNumEffects() > 4)
+                    chain.removeEffect(i % chain.getNumEffects());
+            }
+            
+            while (pump.blocksRendered.load() < 100)
+                juce::Thread::sleep(1);
+            
+            pump.stopThread(2000);
+            
+            expectEquals(chain.getNumEffects(), 4, "Chain should reflect every edit");
+            expect(chain.getEffect(0)->getType() == Effect::Type::Compressor, "Moved effect should be first");
+        }
+        
+        beginTest("Performance Overlay");
+        
+        {
+            // Hidden until toggled, and only polling the engine while shown
+            AudioEngine overlayEngine(AudioEngine::DeviceMode::Offline);
+            PerformanceOverlay overlay(overlayEngine);
+            expect(!overlay.isVisible() && !overlay.isRefreshing(), "The overlay should start out hidden and idle");
+            
+            overlay.setVisible(true);
+            expect(overlay.isRefreshing(), "Showing the overlay should start its refresh timer");
+            
+            overlay.setVisible(false);
+            expect(!overlay.isRefreshing(), "Hiding the overlay should stop its refresh timer");
+            
+            expect(PerformanceOverlay::getToggleKey().isValid(), "The overlay should have a toggle key");
+        }
+        
         beginTest("Device Manager Access");
         
         auto& deviceManager = engine.getDeviceManager();
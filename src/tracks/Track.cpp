@@ -1,7 +1,12 @@
 #include "Track.h"
 
+namespace
+{
+    std::atomic<juce::uint32> nextId { 1 };
+}
+
 Track::Track(const juce::String& trackName, TrackType trackType)
-    : name(trackName), type(trackType)
+    : name(trackName), type(trackType), id(nextId++)
 {
 }
 
@@ -12,8 +17,17 @@ Track::~Track()
 
 void Track::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
+    // Nothing can be prepared for a device that isn't running
+    if (sampleRate <= 0.0 || samplesPerBlock <= 0)
+        return;
+
+    currentSampleRate = sampleRate;
     trackBuffer.setSize(2, samplesPerBlock);
+    trackMidi.ensureSize(2048);
     recorder.setSampleRate(sampleRate);
+    clipPlayer.prepareToPlay(sampleRate, 2);
+    effectChain.prepareToPlay(sampleRate, samplesPerBlock);
+    gainRamps.setRampLength(juce::roundToInt(sampleRate * MixKernels::gainRampSeconds));
     
     if (plugin)
     {
@@ -21,68 +35,259 @@ void Track::prepareToPlay(double sampleRate, int samplesPerBlock)
     }
 }
 
-void Track::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void Track::releaseResources()
 {
-    if (muted)
+    // Keeps the sample rate, so the track can be prepared again as it was
+    trackBuffer.setSize(0, 0);
+    clipPlayer.releaseResources();
+    effectChain.reset();
+    
+    if (plugin)
     {
-        buffer.clear();
-        return;
+        plugin->releaseResources();
     }
+}
 
-    trackBuffer.makeCopyOf(buffer);
+const juce::AudioBuffer<float>& Track::renderBlock(const juce::AudioBuffer<float>& input,
+                                                   const juce::MidiBuffer& midiMessages,
+                                                   const juce::AudioBuffer<float>* sidechain)
+{
+    const TimingHistogram::ScopedTimer timer(renderTiming);
+    const int numSamples = input.getNumSamples();
+    const int numInputChannels = input.getNumChannels();
     
-    if (plugin)
+    // Storage was allocated in prepareToPlay; shrinking to the block length
+    // only moves the end marker. A block longer than prepared grows it once.
+    trackBuffer.setSize(trackBuffer.getNumChannels(), numSamples, false, false, true);
+    
+    // Silent tracks only render to keep recording; the mixer leaves them out
+    if ((isSilentThisBlock() && !recorder.isRecording()) || (numInputChannels == 0 && !clipPlayer.isPlayingThisBlock()))
+    {
+        trackBuffer.clear();
+        return trackBuffer;
+    }
+    
+    // The one copy per block: the input is shared by every track, so each
+    // track needs a private slot before any in-place processing
+    for (int channel = 0; channel < trackBuffer.getNumChannels(); ++channel)
     {
-        plugin->processBlock(trackBuffer, midiMessages);
+        if (numInputChannels > 0)
+            trackBuffer.copyFrom(channel, 0, input, juce::jmin(channel, numInputChannels - 1), 0, numSamples);
+        else
+            trackBuffer.clear(channel, 0, numSamples);
     }
     
-    // Apply volume and pan
-    trackBuffer.applyGain(volume);
+    // Clips play on top of the input, straight from the read-ahead buffer
+    clipPlayer.addNextBlock(trackBuffer, numSamples);
     
-    if (pan != 0.0f)
+    // Tracks may render concurrently and plugins and effects may rewrite
+    // their MIDI, so each track works on a private copy of the block's events
+    trackMidi.clear();
+    trackMidi.addEvents(midiMessages, 0, numSamples, 0);
+    
+    if (plugin)
     {
-        float leftGain = (pan <= 0.0f) ? 1.0f : 1.0f - pan;
-        float rightGain = (pan >= 0.0f) ? 1.0f : 1.0f + pan;
+        plugin->processBlock(trackBuffer, trackMidi);
+        
+        pluginWasSilent = true;
         
-        trackBuffer.applyGain(0, 0, leftGain);
-        trackBuffer.applyGain(1, 0, rightGain);
+        for (int channel = 0; channel < trackBuffer.getNumChannels() && pluginWasSilent; ++channel)
+            pluginWasSilent = trackBuffer.getMagnitude(channel, 0, numSamples) <= MixKernels::silenceThreshold;
     }
     
-    buffer.makeCopyOf(trackBuffer);
+    effectChain.processBlock(trackBuffer, trackMidi, sidechain);
     
     if (recorder.isRecording())
     {
-        recorder.addAudioBlock(buffer, buffer.getNumSamples());
+        recorder.addAudioBlock(trackBuffer, numSamples);
     }
+    
+    return trackBuffer;
 }
 
-void Track::setVolume(float newVolume)
+float Track::getChannelGain(const MixState& state, int channel)
+{
+    if (state.muted)
+        return 0.0f;
+    if (channel == 0 && state.pan > 0.0f)
+        return state.volume * (1.0f - state.pan);
+    if (channel == 1 && state.pan < 0.0f)
+        return state.volume * (1.0f + state.pan);
+    return state.volume;
+}
+
+void Track::planGainRamps(int numSamples)
+{
+    gainRamps.beginBlock();
+    
+    for (int segment = 0; segment < mixSegments.size(); ++segment)
+    {
+        const auto& state = mixSegments.getState(segment);
+        gainRamps.rampTo({ getChannelGain(state, 0), getChannelGain(state, 1) }, mixSegments.getEnd(segment, numSamples));
+    }
+}
+
+void Track::beginBlock(const PlayheadState& playhead)
+{
+    mixSegments.beginBlock();
+    clipPlayer.beginBlock(playhead);
+}
+
+bool Track::isSoloedThisBlock() const
+{
+    for (int segment = 0; segment < mixSegments.size(); ++segment)
+    {
+        if (mixSegments.getState(segment).soloed)
+            return true;
+    }
+    return false;
+}
+
+void Track::skipBlock()
+{
+    // Whatever the effects still hold is stale by the time the track is
+    // heard again
+    silentSamples = 0;
+    resetAfterSkip = true;
+    
+    // The plugin is reset before it is next heard, so nothing is held
+    heldNotes.reset();
+    pluginWasSilent = true;
+    
+    // Fade back in from silence when it is next heard
+    gainRamps.reset({ 0.0f, 0.0f });
+    processingState.store(ProcessingState::Skipped, std::memory_order_relaxed);
+}
+
+bool Track::shouldSleep(bool inputIsSilent, const juce::MidiBuffer& midiMessages, int numSamples)
+{
+    if (plugin != nullptr)
+    {
+        for (const auto metadata : midiMessages)
+        {
+            const auto message = metadata.getMessage();
+            const int note = (message.getChannel() - 1) * 128 + message.getNoteNumber();
+            
+            if (message.isNoteOn())
+                heldNotes.set((size_t) note);
+            else if (message.isNoteOff())
+                heldNotes.reset((size_t) note);
+            else if (message.isAllNotesOff() || message.isAllSoundOff())
+                heldNotes.reset();
+        }
+        
+        // A plugin's tail is often reported as zero, so a release is only
+        // over once the plugin has gone quiet
+        inputIsSilent = inputIsSilent && heldNotes.none() && pluginWasSilent;
+    }
+    
+    // A recording track keeps capturing, silence included, and a track
+    // playing clips has input of its own
+    if (inputIsSilent && !recorder.isRecording() && !clipPlayer.isPlayingThisBlock())
+        silentSamples += numSamples;
+    else
+        silentSamples = 0;
+    
+    const double tailSeconds = getTailLengthSeconds();
+    
+    // The samples before this block are what the tail had to ring out over
+    const bool asleep = silentSamples > 0
+                     && std::isfinite(tailSeconds)
+                     && (double) (silentSamples - numSamples) >= tailSeconds * currentSampleRate;
+    
+    if (!asleep && resetAfterSkip)
+    {
+        effectChain.reset();
+        
+        if (plugin)
+            plugin->reset();
+        
+        resetAfterSkip = false;
+    }
+    
+    processingState.store(asleep ? ProcessingState::Sleeping : ProcessingState::Active, std::memory_order_relaxed);
+    return asleep;
+}
+
+double Track::getTailLengthSeconds() const
+{
+    const double pluginTail = plugin != nullptr ? plugin->getTailLengthSeconds() : 0.0;
+    return pluginTail + effectChain.getTailLengthSeconds();
+}
+
+int Track::getLatencySamples() const
+{
+    const int pluginLatency = plugin != nullptr ? plugin->getLatencySamples() : 0;
+    return pluginLatency + effectChain.getLatencySamples();
+}
+
+void Track::applyCommand(const EngineCommand& command, int sampleOffset)
+{
+    auto& state = mixSegments.changeAt(sampleOffset);
+    
+    switch (command.type)
+    {
+        case EngineCommand::Type::TrackVolume:  state.volume = command.value; break;
+        case EngineCommand::Type::TrackPan:     state.pan = command.value; break;
+        case EngineCommand::Type::TrackMute:    state.muted = command.value != 0.0f; break;
+        case EngineCommand::Type::TrackSolo:    state.soloed = command.value != 0.0f; break;
+        case EngineCommand::Type::MasterVolume: break;
+    }
+}
+
+void Track::sendMixCommand(EngineCommand::Type commandType, float value, juce::int64 atSample)
+{
+    EngineCommand command;
+    command.type = commandType;
+    command.track = this;
+    command.trackId = id;
+    command.value = value;
+    command.timestamp = atSample;
+    
+    // Not part of an engine yet, so nothing is rendering it concurrently
+    if (commandQueue == nullptr)
+    {
+        applyCommand(command, 0);
+        return;
+    }
+    
+    // A full queue means the audio thread has stalled; the push counts the
+    // failure and the getters still report the requested value
+    commandQueue->push(command);
+}
+
+void Track::setVolume(float newVolume, juce::int64 atSample)
 {
     volume = juce::jlimit(0.0f, 2.0f, newVolume);
+    sendMixCommand(EngineCommand::Type::TrackVolume, volume, atSample);
     sendChangeMessage();
 }
 
-void Track::setPan(float newPan)
+void Track::setPan(float newPan, juce::int64 atSample)
 {
     pan = juce::jlimit(-1.0f, 1.0f, newPan);
+    sendMixCommand(EngineCommand::Type::TrackPan, pan, atSample);
     sendChangeMessage();
 }
 
-void Track::setMute(bool shouldMute)
+void Track::setMute(bool shouldMute, juce::int64 atSample)
 {
     muted = shouldMute;
+    sendMixCommand(EngineCommand::Type::TrackMute, muted ? 1.0f : 0.0f, atSample);
     sendChangeMessage();
 }
 
-void Track::setSolo(bool shouldSolo)
+void Track::setSolo(bool shouldSolo, juce::int64 atSample)
 {
     soloed = shouldSolo;
+    sendMixCommand(EngineCommand::Type::TrackSolo, soloed ? 1.0f : 0.0f, atSample);
     sendChangeMessage();
 }
 
-void Track::startRecording(const juce::File& file)
+void Track::startRecording(const juce::File& file, Recorder::Format format)
 {
-    recorder.startRecording(file);
+    format.numChannels = getNumOutputChannels();
+    recorder.startRecording(file, format);
 }
 
 void Track::stopRecording()
@@ -95,6 +300,15 @@ bool Track::isRecording() const
     return recorder.isRecording();
 }
 
+int Track::getNumOutputChannels() const
+{
+    // Tracks are mixed in stereo; a mono instrument stays mono
+    if (plugin != nullptr)
+        return juce::jlimit(1, 2, plugin->getTotalNumOutputChannels());
+
+    return 2;
+}
+
 void Track::loadPlugin(const juce::String& pluginIdentifier)
 {
     // This would use the PluginManager in a real implementation
@@ -1,7 +1,12 @@
 #pragma once
 #include <JuceHeader.h>
+#include <bitset>
 #include "../recording/Recorder.h"
 #include "../plugins/PluginManager.h"
+#include "../audio/EngineCommandQueue.h"
+#include "../audio/MixKernels.h"
+#include "../effects/Effect.h"
+#include "../playback/ClipPlayer.h"
 
 class Track : public juce::ChangeBroadcaster
 {
@@ -9,29 +14,115 @@ public:
     enum TrackType
     {
         AudioTrack,
-        MidiTrack
+        MidiTrack,
+        BusTrack    // sums the tracks routed into it instead of reading the engine input
+    };
+
+    // Volume, pan, mute and solo as the audio thread sees them
+    struct MixState
+    {
+        float volume = 1.0f;
+        float pan = 0.0f;
+        bool muted = false;
+        bool soloed = false;
+    };
+
+    using MixSegments = BlockSegments<MixState>;
+
+    enum class ProcessingState
+    {
+        Active,
+        Skipped,    // muted or soloed out, so not processed at all
+        Sleeping    // input silent for longer than the effect tails
     };
 
     Track(const juce::String& name, TrackType type);
     ~Track() override;
 
     void prepareToPlay(double sampleRate, int samplesPerBlock);
-    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+    void releaseResources();
+
+    // Renders the track from a shared input into its own scratch buffer, which is
+    // sized in prepareToPlay and reused every block. The returned buffer is the
+    // pre-fader slot the mixer sums from; volume and pan come from getMixSegments().
+    // The optional sidechain signal is only valid for the duration of the call.
+    const juce::AudioBuffer<float>& renderBlock(const juce::AudioBuffer<float>& input,
+                                                const juce::MidiBuffer& midiMessages,
+                                                const juce::AudioBuffer<float>* sidechain = nullptr);
+    const juce::AudioBuffer<float>& getRenderedBlock() const { return trackBuffer; }
+    
+    // Audio thread: the mix parameters over the current block. Parameter
+    // changes arrive as EngineCommands and take effect at their sample offset.
+    // The playhead tells the clip player what to play, or prefetch.
+    void beginBlock(const PlayheadState& playhead = {});
+    void applyCommand(const EngineCommand& command, int sampleOffset);
+    const MixSegments& getMixSegments() const { return mixSegments; }
+    bool isSoloedThisBlock() const;
+    
+    // Audio thread, once the block's parameter changes are in: turns the mix
+    // segments into per-channel gain ramps, which the mixer applies while
+    // summing. A track is silent once it is muted and its fade has finished.
+    void planGainRamps(int numSamples);
+    const GainRampPlanner<2>& getGainRamps() const { return gainRamps; }
+    bool isSilentThisBlock() const { return gainRamps.isSilent(); }
+    float getChannelGain(int channel) const { return getChannelGain(mixSegments.getFinalState(), channel); }
+    static float getChannelGain(const MixState& state, int channel);
+    
+    // Message thread. Once the track belongs to an engine, these update what
+    // the getters return and queue the change for the audio thread, to be
+    // applied at the given engine sample position or as soon as possible.
+    void setVolume(float newVolume, juce::int64 atSample = -1);
+    void setPan(float newPan, juce::int64 atSample = -1);
+    void setMute(bool shouldMute, juce::int64 atSample = -1);
+    void setSolo(bool shouldSolo, juce::int64 atSample = -1);
+    void setCommandQueue(EngineCommandQueue* queue) { commandQueue = queue; }
+    
+    // Audio thread: called instead of renderBlock() for a block in which the
+    // track is muted or soloed out
+    void skipBlock();
     
-    void setVolume(float newVolume);
-    void setPan(float newPan);
-    void setMute(bool shouldMute);
-    void setSolo(bool shouldSolo);
+    // Audio thread: called before renderBlock(). Returns true if the track's
+    // input has been silent for longer than its tail, in which case the
+    // block needn't be rendered because it would be silent too. A plugin
+    // counts as input while it holds a note or is still sounding, whatever
+    // tail it reports, so instruments aren't cut off mid-release.
+    bool shouldSleep(bool inputIsSilent, const juce::MidiBuffer& midiMessages, int numSamples);
+    
+    // Plugin tail plus effect chain tail
+    double getTailLengthSeconds() const;
+    
+    // Message thread: plugin latency plus effect chain latency, in samples
+    int getLatencySamples() const;
+    
+    // For diagnostics; safe to call from any thread
+    ProcessingState getProcessingState() const { return processingState.load(std::memory_order_relaxed); }
+    bool isSleeping() const { return getProcessingState() == ProcessingState::Sleeping; }
 
-    void startRecording(const juce::File& file);
+    // Audio clips on the track's timeline, streamed from disk and added to
+    // whatever the track reads from the engine input
+    ClipPlayer& getClipPlayer() { return clipPlayer; }
+
+    // The recording has as many channels as the track's output
+    void startRecording(const juce::File& file, Recorder::Format format = {});
     void stopRecording();
     bool isRecording() const;
+    Recorder::Stats getRecordingStats() const { return recorder.getStats(); }
+    int getNumOutputChannels() const;
 
     void loadPlugin(const juce::String& pluginIdentifier);
     void unloadPlugin();
+    
+    EffectChain& getEffectChain() { return effectChain; }
+    
+    // Time spent in renderBlock(), plugin and effects included
+    TimingHistogram& getRenderTiming() { return renderTiming; }
 
     const juce::String& getName() const { return name; }
     TrackType getType() const { return type; }
+    bool isBus() const { return type == BusTrack; }
+
+    // Unique for the life of the process, unlike the track's address
+    juce::uint32 getId() const { return id; }
     float getVolume() const { return volume; }
     float getPan() const { return pan; }
     bool isMuted() const { return muted; }
@@ -40,15 +131,36 @@ public:
 private:
     juce::String name;
     TrackType type;
+    const juce::uint32 id;
     
     float volume = 1.0f;
     float pan = 0.0f;
     bool muted = false;
     bool soloed = false;
     
+    MixSegments mixSegments;
+    GainRampPlanner<2> gainRamps;
+    EngineCommandQueue* commandQueue = nullptr;
+    
+    double currentSampleRate = 44100.0;
+    juce::int64 silentSamples = 0;
+    bool resetAfterSkip = false;
+    
+    // Audio thread: the plugin's held notes, by channel and note number,
+    // and whether it was silent when it last ran
+    std::bitset<16 * 128> heldNotes;
+    bool pluginWasSilent = true;
+    std::atomic<ProcessingState> processingState { ProcessingState::Active };
+    
     Recorder recorder;
+    ClipPlayer clipPlayer;
+    EffectChain effectChain;
+    TimingHistogram renderTiming;
     juce::AudioBuffer<float> trackBuffer;
+    juce::MidiBuffer trackMidi;
     juce::AudioPluginInstance* plugin = nullptr;
     
+    void sendMixCommand(EngineCommand::Type type, float value, juce::int64 atSample);
+    
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Track)
 };